@@ -0,0 +1,165 @@
+// times the TriangleBvh build on one thread and on all of them, then the
+// single ray and packet queries, over a bumpy uv sphere. packets must find
+// the same hits as single rays
+//
+// usage: bvh_benchmark [rings = 1024] [threads = 0, all cores]
+// the sphere has 4 * rings * rings triangles, 4.2M by default
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "triangle_bvh.h"
+#include "./base/parallel.h"
+
+namespace {
+struct mesh_t {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+// rings x 2 * rings quads between the poles, the radius rippled so the
+// surface is not trivially convex
+mesh_t makeBumpySphere(uint32_t rings) {
+	const uint32_t segments = 2 * rings;
+	const float pi = 3.14159265358979f;
+
+	mesh_t mesh;
+	mesh.positions.reserve(static_cast<size_t>(rings + 1) * (segments + 1));
+	for (uint32_t i = 0; i <= rings; ++i) {
+		const float theta = pi * i / rings;
+		for (uint32_t j = 0; j <= segments; ++j) {
+			const float phi = 2.0f * pi * j / segments;
+			const float radius = 1.0f + 0.05f * std::sin(13.0f * theta) * std::sin(17.0f * phi);
+			mesh.positions.push_back(radius * glm::vec3(
+				std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+		}
+	}
+
+	mesh.indices.reserve(static_cast<size_t>(rings) * segments * 6);
+	for (uint32_t i = 0; i < rings; ++i) {
+		for (uint32_t j = 0; j < segments; ++j) {
+			const uint32_t v00 = i * (segments + 1) + j;
+			const uint32_t v10 = v00 + segments + 1;
+			const uint32_t quad[6] = { v00, v10, v00 + 1, v00 + 1, v10, v10 + 1 };
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+		}
+	}
+	return mesh;
+}
+
+double getMilliseconds(std::chrono::high_resolution_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool isSameHit(const RayHit& lhs, const RayHit& rhs) {
+	return lhs.triangle == rhs.triangle && (!lhs.isHit() || std::abs(lhs.t - rhs.t) <= 1e-5f * lhs.t);
+}
+}
+
+int main(int argc, char** argv) {
+	const int rings = argc > 1 ? std::atoi(argv[1]) : 1024;
+	const unsigned threads = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 0;
+	if (rings <= 1) {
+		std::fprintf(stderr, "usage: %s [rings] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	const mesh_t mesh = makeBumpySphere(static_cast<uint32_t>(rings));
+	std::printf("%zu triangles, %u threads\n", mesh.indices.size() / 3, getWorkerCount(threads));
+
+	auto start = std::chrono::high_resolution_clock::now();
+	{
+		TriangleBvh serial(mesh.positions.data(), mesh.indices.data(), mesh.indices.size(), 1);
+	}
+	std::printf("build, 1 thread      %10.1f ms\n", getMilliseconds(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	const TriangleBvh bvh(mesh.positions.data(), mesh.indices.data(), mesh.indices.size(), threads);
+	std::printf("build, %2u threads    %10.1f ms  %zu nodes, %zu MB\n", getWorkerCount(threads),
+		getMilliseconds(start), bvh.getNodeCount(), bvh.getMemoryUsage() / (1024 * 1024));
+
+	// incoherent rays from random points around the sphere towards random
+	// points inside it
+	const size_t incoherentCount = 1 << 20;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Ray> incoherent(incoherentCount);
+	for (auto& ray : incoherent) {
+		const glm::vec3 origin = 3.0f * glm::normalize(glm::vec3(unit(random), unit(random), unit(random)));
+		const glm::vec3 target = 0.5f * glm::vec3(unit(random), unit(random), unit(random));
+		ray = Ray(origin, target - origin);
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	size_t hitCount = 0;
+	for (const auto& ray : incoherent) {
+		RayHit hit;
+		hitCount += bvh.intersect(ray, &hit);
+	}
+	const double incoherentTime = getMilliseconds(start);
+	std::printf("intersect, random    %10.1f ms  %.2f Mrays/s, %zu hits\n", incoherentTime,
+		incoherentCount / incoherentTime / 1000.0, hitCount);
+
+	start = std::chrono::high_resolution_clock::now();
+	size_t occludedCount = 0;
+	for (const auto& ray : incoherent) {
+		occludedCount += bvh.occluded(ray);
+	}
+	const double occludedTime = getMilliseconds(start);
+	std::printf("occluded, random     %10.1f ms  %.2f Mrays/s, %zu hits\n", occludedTime,
+		incoherentCount / occludedTime / 1000.0, occludedCount);
+
+	// a pinhole camera looking at the sphere, packets are 8 neighbouring
+	// pixels of a row
+	const int width = 1024;
+	const int height = 1024;
+	std::vector<Ray> coherent(static_cast<size_t>(width) * height);
+	const glm::vec3 eye(0.0f, 0.3f, 3.0f);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			const glm::vec3 direction(1.2f * (x + 0.5f) / width - 0.6f, 1.2f * (y + 0.5f) / height - 0.6f, -1.0f);
+			coherent[static_cast<size_t>(y) * width + x] = Ray(eye, direction);
+		}
+	}
+
+	std::vector<RayHit> singleHits(coherent.size());
+	start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < coherent.size(); ++i) {
+		bvh.intersect(coherent[i], &singleHits[i]);
+	}
+	const double singleTime = getMilliseconds(start);
+	std::printf("intersect, camera    %10.1f ms  %.2f Mrays/s\n", singleTime, coherent.size() / singleTime / 1000.0);
+
+	std::vector<RayHit> packetHits(coherent.size());
+	start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < coherent.size(); i += 4) {
+		bvh.intersect4(&coherent[i], &packetHits[i]);
+	}
+	const double packet4Time = getMilliseconds(start);
+	bool allMatch = true;
+	for (size_t i = 0; i < coherent.size(); ++i) {
+		allMatch = allMatch && isSameHit(singleHits[i], packetHits[i]);
+	}
+	std::printf("intersect4, camera   %10.1f ms  %.2f Mrays/s%s\n", packet4Time, coherent.size() / packet4Time / 1000.0,
+		allMatch ? "" : "  MISMATCH");
+
+	packetHits.assign(coherent.size(), RayHit());
+	start = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < coherent.size(); i += 8) {
+		bvh.intersect8(&coherent[i], &packetHits[i]);
+	}
+	const double packet8Time = getMilliseconds(start);
+	bool packet8Match = true;
+	for (size_t i = 0; i < coherent.size(); ++i) {
+		packet8Match = packet8Match && isSameHit(singleHits[i], packetHits[i]);
+	}
+	allMatch = allMatch && packet8Match;
+	std::printf("intersect8, camera   %10.1f ms  %.2f Mrays/s%s\n", packet8Time, coherent.size() / packet8Time / 1000.0,
+		packet8Match ? "" : "  MISMATCH");
+
+	return allMatch ? 0 : 1;
+}
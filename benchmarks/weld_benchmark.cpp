@@ -0,0 +1,162 @@
+// times the exact vertex weld of the loader against the std::unordered_map
+// pass it replaced, over the corners of a lattice of axis aligned cubes:
+// integer positions, axis normals and 0/1 texture coordinates, the input the
+// old hash collided most on. every method must produce the same output
+//
+// usage: weld_benchmark [cubes per axis = 66] [threads = 0, all cores]
+// 66 cubes per axis are 287496 cubes, 10.3M corners and 6.9M unique vertices
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+#include "vertex_welder.h"
+#include "./base/parallel.h"
+
+namespace {
+// the std::hash<Vertex> of the loader before hashVertex
+struct LegacyVertexHash {
+	size_t operator()(const Vertex& vertex) const {
+		return ((std::hash<glm::vec3>()(vertex.position) ^
+			(std::hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
+			(std::hash<glm::vec2>()(vertex.texCoord) << 1);
+	}
+};
+
+struct weld_result_t {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+// unit cubes one unit apart, 6 faces of 2 triangles each. the 4 corners of
+// a face share its normal, so each of them is used by 1 or 2 triangles
+std::vector<Vertex> makeCubeLattice(int cubesPerAxis) {
+	const glm::vec2 faceTexCoords[4] = {
+		glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)
+	};
+	const int faceCorners[6] = { 0, 1, 2, 0, 2, 3 };
+
+	std::vector<Vertex> corners;
+	corners.reserve(static_cast<size_t>(cubesPerAxis) * cubesPerAxis * cubesPerAxis * 36);
+	for (int x = 0; x < cubesPerAxis; ++x) {
+		for (int y = 0; y < cubesPerAxis; ++y) {
+			for (int z = 0; z < cubesPerAxis; ++z) {
+				const glm::vec3 origin(2.0f * x, 2.0f * y, 2.0f * z);
+				for (int axis = 0; axis < 3; ++axis) {
+					for (int side = 0; side < 2; ++side) {
+						glm::vec3 normal(0.0f);
+						normal[axis] = side == 0 ? -1.0f : 1.0f;
+
+						Vertex face[4];
+						for (int i = 0; i < 4; ++i) {
+							glm::vec3 offset(0.0f);
+							offset[axis] = static_cast<float>(side);
+							offset[(axis + 1) % 3] = faceTexCoords[i].x;
+							offset[(axis + 2) % 3] = faceTexCoords[i].y;
+							face[i] = Vertex(origin + offset, normal, faceTexCoords[i]);
+						}
+						for (int corner : faceCorners) {
+							corners.push_back(face[corner]);
+						}
+					}
+				}
+			}
+		}
+	}
+	return corners;
+}
+
+// the loop of the loader before VertexWelder: count, then two operator[]
+template <typename Hash>
+weld_result_t weldUnorderedMap(const std::vector<Vertex>& corners) {
+	weld_result_t result;
+	std::unordered_map<Vertex, uint32_t, Hash> uniqueVertices;
+	for (const auto& vertex : corners) {
+		if (uniqueVertices.count(vertex) == 0) {
+			uniqueVertices[vertex] = static_cast<uint32_t>(result.vertices.size());
+			result.vertices.push_back(vertex);
+		}
+		result.indices.push_back(uniqueVertices[vertex]);
+	}
+	return result;
+}
+
+weld_result_t weldTable(const std::vector<Vertex>& corners) {
+	weld_result_t result;
+	result.indices.reserve(corners.size());
+	VertexWelder welder(corners.size());
+	for (const auto& vertex : corners) {
+		result.indices.push_back(welder.weld(vertex));
+	}
+	result.vertices = welder.releaseVertices();
+	return result;
+}
+
+weld_result_t weldSort(const std::vector<Vertex>& corners, unsigned threads) {
+	weld_result_t result;
+	std::vector<uint32_t> firstCorners;
+	VertexWelder::weldSorted(corners, &result.indices, &firstCorners, threads);
+	result.vertices.reserve(firstCorners.size());
+	for (uint32_t corner : firstCorners) {
+		result.vertices.push_back(corners[corner]);
+	}
+	return result;
+}
+
+bool isSameResult(const weld_result_t& lhs, const weld_result_t& rhs) {
+	return lhs.indices == rhs.indices && lhs.vertices.size() == rhs.vertices.size() &&
+		std::equal(lhs.vertices.begin(), lhs.vertices.end(), rhs.vertices.begin());
+}
+}
+
+int main(int argc, char** argv) {
+	const int cubesPerAxis = argc > 1 ? std::atoi(argv[1]) : 66;
+	const unsigned threads = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 0;
+	if (cubesPerAxis <= 0) {
+		std::fprintf(stderr, "usage: %s [cubes per axis] [threads]\n", argv[0]);
+		return 1;
+	}
+
+	const std::vector<Vertex> corners = makeCubeLattice(cubesPerAxis);
+
+	struct method_t {
+		const char* name;
+		std::function<weld_result_t()> weld;
+	};
+	const method_t methods[] = {
+		{ "unordered_map, old hash", [&]() { return weldUnorderedMap<LegacyVertexHash>(corners); } },
+		{ "unordered_map, hashVertex", [&]() { return weldUnorderedMap<std::hash<Vertex>>(corners); } },
+		{ "VertexWelder", [&]() { return weldTable(corners); } },
+		{ "VertexWelder::weldSorted", [&]() { return weldSort(corners, threads); } },
+	};
+
+	std::printf("%zu corners, %u threads\n", corners.size(), getWorkerCount(threads));
+
+	// the first method is the reference the others are compared to
+	weld_result_t reference;
+	bool allMatch = true;
+	for (const auto& method : methods) {
+		auto start = std::chrono::high_resolution_clock::now();
+		weld_result_t result = method.weld();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		const bool isReference = reference.indices.empty();
+		const bool matches = isReference || isSameResult(result, reference);
+		allMatch = allMatch && matches;
+		std::printf("%-28s %10.1f ms  %zu vertices%s\n", method.name,
+			std::chrono::duration<double, std::milli>(end - start).count(), result.vertices.size(),
+			matches ? "" : "  MISMATCH");
+		if (isReference) {
+			reference = std::move(result);
+		}
+	}
+
+	return allMatch ? 0 : 1;
+}
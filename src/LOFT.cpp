@@ -2,11 +2,99 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <glm/gtc/type_ptr.hpp>
+
 #include "LOFT.h"
 #include "print_screen.h"
+#include "./base/gl_state.h"
 
 const GLuint SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
 
+const uint32_t MATERIAL_BLOCK_BINDING = 0;
+const uint32_t FRAME_CONSTANTS_BINDING = 1;
+// the GL_MAX_UNIFORM_BLOCK_SIZE every gl 3.3 implementation provides
+const size_t MATERIAL_BLOCK_SIZE = 16384;
+
+// the constants of a frame as declared in every shader, the loft being the
+// one model they draw with these lights
+const char* frameConstantsBlock =
+	"// ambient light data structure declaration\n"
+	"struct AmbientLight {\n"
+	"	vec3 color;\n"
+	"	float intensity;\n"
+	"};\n"
+
+	"// directional light data structure declaration\n"
+	"struct DirectionalLight {\n"
+	"	vec3 direction;\n"
+	"	float intensity;\n"
+	"	vec3 color;\n"
+	"};\n"
+
+	"// spot light data structure declaration\n"
+	"struct SpotLight {\n"
+	"	vec3 position;\n"
+	"	vec3 direction;\n"
+	"	float intensity;\n"
+	"	vec3 color;\n"
+	"	float angle;\n"
+	"	float kc;\n"
+	"	float kl;\n"
+	"	float kq;\n"
+	"};\n"
+
+	"layout(std140) uniform FrameConstants {\n"
+	"	mat4 projection;\n"
+	"	mat4 view;\n"
+	"	mat4 lightSpaceMatrix;\n"
+	"	vec3 cameraPosition;\n"
+	"	mat4 loftModel;\n"
+	"	// transpose(inverse(loftModel)), for the normals\n"
+	"	mat3 loftNormalMatrix;\n"
+	"	// the bounding box compact positions are quantized to\n"
+	"	vec3 positionOffset;\n"
+	"	vec3 positionScale;\n"
+	"	AmbientLight ambientLight;\n"
+	"	DirectionalLight directionalLight;\n"
+	"	SpotLight spotLight;\n"
+	"};\n";
+
+// the FrameConstants block above
+static Std140Layout getFrameConstantsLayout() {
+	Std140Layout ambientLight;
+	ambientLight.add("color", Std140Layout::Type::Vec3);
+	ambientLight.add("intensity", Std140Layout::Type::Float);
+
+	Std140Layout directionalLight;
+	directionalLight.add("direction", Std140Layout::Type::Vec3);
+	directionalLight.add("intensity", Std140Layout::Type::Float);
+	directionalLight.add("color", Std140Layout::Type::Vec3);
+
+	Std140Layout spotLight;
+	spotLight.add("position", Std140Layout::Type::Vec3);
+	spotLight.add("direction", Std140Layout::Type::Vec3);
+	spotLight.add("intensity", Std140Layout::Type::Float);
+	spotLight.add("color", Std140Layout::Type::Vec3);
+	spotLight.add("angle", Std140Layout::Type::Float);
+	spotLight.add("kc", Std140Layout::Type::Float);
+	spotLight.add("kl", Std140Layout::Type::Float);
+	spotLight.add("kq", Std140Layout::Type::Float);
+
+	Std140Layout layout;
+	layout.add("projection", Std140Layout::Type::Mat4);
+	layout.add("view", Std140Layout::Type::Mat4);
+	layout.add("lightSpaceMatrix", Std140Layout::Type::Mat4);
+	layout.add("cameraPosition", Std140Layout::Type::Vec3);
+	layout.add("loftModel", Std140Layout::Type::Mat4);
+	layout.add("loftNormalMatrix", Std140Layout::Type::Mat3);
+	layout.add("positionOffset", Std140Layout::Type::Vec3);
+	layout.add("positionScale", Std140Layout::Type::Vec3);
+	layout.add("ambientLight", ambientLight);
+	layout.add("directionalLight", directionalLight);
+	layout.add("spotLight", spotLight);
+	return layout;
+}
+
 const std::string obj_save_name = "six_basic.obj";
 const std::string modelRelPath = "obj/Bedroom.obj";
 const std::vector<std::string> paintingsTexturePath = { "texture/paintings1.png",
@@ -14,13 +102,75 @@ const std::vector<std::string> paintingsTexturePath = { "texture/paintings1.png"
 const std::string reference_bmp = "bmp/dummy.bmp";
 const std::string print_screen = "print_screen.bmp";
 
-LOFT::LOFT(const Options& options) : Application(options) {
+// the decoding of compact vertices, shared by the vertex shaders of the loft
+const char* dequantize =
+	"#ifdef COMPACT_VERTEX\n"
+	"// positions are unorm16 within the bounding box of the model\n"
+
+	"vec3 decodePosition(vec3 position) {\n"
+	"	return positionOffset + position * positionScale;\n"
+	"}\n"
+
+	"// normals are octahedral encoded\n"
+	"vec3 decodeNormal(vec2 e) {\n"
+	"	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));\n"
+	"	float t = max(-n.z, 0.0f);\n"
+	"	n.x += n.x >= 0.0f ? -t : t;\n"
+	"	n.y += n.y >= 0.0f ? -t : t;\n"
+	"	return normalize(n);\n"
+	"}\n"
+	"#else\n"
+	"vec3 decodePosition(vec3 position) {\n"
+	"	return position;\n"
+	"}\n"
+
+	"vec3 decodeNormal(vec3 n) {\n"
+	"	return n;\n"
+	"}\n"
+	"#endif\n";
+
+// the Material struct of the loft shader as an element of MaterialBlock,
+// three vec4 that are also the texels of a material in the material table
+static Std140Layout getMaterialLayout() {
+	Std140Layout layout;
+	layout.add("ka", Std140Layout::Type::Vec3);
+	layout.add("ns", Std140Layout::Type::Float);
+	layout.add("kd", Std140Layout::Type::Vec3);
+	layout.add("d", Std140Layout::Type::Float);
+	layout.add("ks", Std140Layout::Type::Vec3);
+	layout.add("textured", Std140Layout::Type::Float);
+	return layout;
+}
+
+LOFT::LOFT(const Options& options, bool pageLoft) : Application(options) {
 
 	// init model
-	_loft.reset(new Model(getAssetFullPath(modelRelPath)));
-	BoundingBox box = _loft->getBoundingBox();
-	box.min = glm::vec3(_loft->transform.getLocalMatrix() * glm::vec4(box.min, 1.0f));
-	box.max = glm::vec3(_loft->transform.getLocalMatrix() * glm::vec4(box.max, 1.0f));
+	if (pageLoft) {
+		// the octree is cut from the obj without loading it whole, once and
+		// again whenever the obj or its materials change
+		const std::string objPath = getAssetFullPath(modelRelPath);
+		const std::string octreePath = objPath.substr(0, objPath.find_last_of('.')) + ".octree";
+		std::string err;
+		bool current = false;
+		{
+			// unmapped before the build replaces the file
+			MeshOctree octree;
+			current = octree.open(octreePath, &err) && octree.isCurrent();
+		}
+		if (!current && !MeshOctree::build(objPath, octreePath, MeshOctreeOptions(), &err)) {
+			throw std::runtime_error(err);
+		}
+		_loftPager.reset(new OctreePager(octreePath));
+	}
+	else {
+		ModelLoadOptions loftOptions;
+		loftOptions.lodLevels = 4;
+		loftOptions.buildMeshlets = true;
+		loftOptions.loadInBackground = true;
+		// picking only needs the positions and the indices
+		loftOptions.cpuRetention = ModelLoadOptions::CpuRetention::Positions;
+		_loft.reset(new Model(getAssetFullPath(modelRelPath), loftOptions));
+	}
 
 	// init lights
 	_ambientLight.reset(new AmbientLight);
@@ -49,26 +199,7 @@ LOFT::LOFT(const Options& options) : Application(options) {
 	// perspective camera
 	_camera.reset(new PerspectiveCamera(
 		glm::radians(60.0f), aspect, 0.1f, 10000.0f));
-	_camera->transform.position = glm::vec3((box.min.x + box.max.x) / 2.0f, (box.min.y + box.max.y) / 2.0f, 5.0f);
-
-	// init six basic elements
-	_six_basic.resize(6);
-	_six_basic[0].reset(new Cube(_camera->transform.position + glm::vec3(-1.0f, 0.0f, 1.73f) * 0.1f, 0.05f));
-	_six_basic[1].reset(new Cone(_camera->transform.position + glm::vec3(1.0f, 0.0f, 1.73f) * 0.1f, 0.025f, 0.05f));
-	_six_basic[2].reset(new Cylinder(_camera->transform.position + glm::vec3(2.0f, 0.0f, 0.0f) * 0.1f, 0.025f, 0.05f));
-	_six_basic[3].reset(new Sphere(_camera->transform.position + glm::vec3(1.0f, 0.0f, -1.73f) * 0.1f, 0.025f));
-	_six_basic[4].reset(new Prism(_camera->transform.position + glm::vec3(-1.0f, 0.0f, -1.73f) * 0.1f, 3, 0.025f, 0.05f));
-	_six_basic[5].reset(new Frust(_camera->transform.position + glm::vec3(-2.0f, 0.0f, 0.0f) * 0.1f, 3, 0.025f, 0.05f, 0.05f));
-	for (int i = 0; i < _six_basic.size(); ++i) {
-		glm::mat4 translation = glm::mat4(1.0f);
-		translation = glm::translate(translation, _six_basic[i]->_global_position);
-		glm::mat4 rotation_self = glm::mat4(1.0f);
-		rotation_self = glm::rotate(rotation_self, _six_basic[i]->_rotate_angle_self, glm::vec3(-1.0f)); // resolve around z-axis
-		glm::mat4 scale = glm::mat4(1.0f);
-		scale = glm::scale(scale, _six_basic[i]->_scale);
-		glm::mat4 six_model = translation * rotation_self * scale;
-		_six_basic[i]->_model = six_model;
-	}
+	updateLoft();
 
 	// init shader
 	initShader();
@@ -100,6 +231,174 @@ LOFT::LOFT(const Options& options) : Application(options) {
 	ImGui_ImplOpenGL3_Init();
 }
 
+void LOFT::initSixBasic() {
+	_six_basic.resize(6);
+	_six_basic[0].reset(new Cube(_camera->transform.position + glm::vec3(-1.0f, 0.0f, 1.73f) * 0.1f, 0.05f));
+	_six_basic[1].reset(new Cone(_camera->transform.position + glm::vec3(1.0f, 0.0f, 1.73f) * 0.1f, 0.025f, 0.05f));
+	_six_basic[2].reset(new Cylinder(_camera->transform.position + glm::vec3(2.0f, 0.0f, 0.0f) * 0.1f, 0.025f, 0.05f));
+	_six_basic[3].reset(new Sphere(_camera->transform.position + glm::vec3(1.0f, 0.0f, -1.73f) * 0.1f, 0.025f));
+	_six_basic[4].reset(new Prism(_camera->transform.position + glm::vec3(-1.0f, 0.0f, -1.73f) * 0.1f, 3, 0.025f, 0.05f));
+	_six_basic[5].reset(new Frust(_camera->transform.position + glm::vec3(-2.0f, 0.0f, 0.0f) * 0.1f, 3, 0.025f, 0.05f, 0.05f));
+	for (int i = 0; i < _six_basic.size(); ++i) {
+		glm::mat4 translation = glm::mat4(1.0f);
+		translation = glm::translate(translation, _six_basic[i]->_global_position);
+		glm::mat4 rotation_self = glm::mat4(1.0f);
+		rotation_self = glm::rotate(rotation_self, _six_basic[i]->_rotate_angle_self, glm::vec3(-1.0f)); // resolve around z-axis
+		glm::mat4 scale = glm::mat4(1.0f);
+		scale = glm::scale(scale, _six_basic[i]->_scale);
+		glm::mat4 six_model = translation * rotation_self * scale;
+		_six_basic[i]->_model = six_model;
+	}
+}
+
+void LOFT::updateLoft() {
+	const bool loaded = _loft && _loft->updateLoad();
+
+	// the materials are known as soon as the obj is parsed
+	if (_loft_shader && _materialTableCount != getLoftMaterials().size()) {
+		updateMaterialTable();
+	}
+
+	// the box is known as soon as the obj is parsed
+	BoundingBox box = getLoftBoundingBox();
+	if (!_cameraPlaced && box.min.x <= box.max.x) {
+		box.min = glm::vec3(getLoftTransform().getLocalMatrix() * glm::vec4(box.min, 1.0f));
+		box.max = glm::vec3(getLoftTransform().getLocalMatrix() * glm::vec4(box.max, 1.0f));
+		_camera->transform.position = glm::vec3((box.min.x + box.max.x) / 2.0f, (box.min.y + box.max.y) / 2.0f, 5.0f);
+		_cameraPlaced = true;
+
+		// the six basics start out around the camera
+		initSixBasic();
+	}
+
+	if (_loftPager) {
+		_loftPager->update(*_camera, _deltaTime);
+		return;
+	}
+
+	if (!loaded || _loftBvh) {
+		return;
+	}
+
+	// picking starts once the bvh is built off the render thread
+	if (!_loftBvhBuild.valid()) {
+		const Model* loft = _loft.get();
+		_loftBvhBuild = std::async(std::launch::async, [loft]() {
+			return std::unique_ptr<TriangleBvh>(new TriangleBvh(*loft));
+		});
+	}
+	else if (_loftBvhBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		_loftBvh = _loftBvhBuild.get();
+	}
+}
+
+void LOFT::updateMaterialTable() {
+	const std::vector<Model::material_t>& materials = getLoftMaterials();
+	const Std140Layout element = getMaterialLayout();
+	const size_t stride = element.getSize();
+
+	// a uniform block is read through the constant cache, faster than the
+	// texel fetches of the table, which only holds libraries too large for it.
+	// the block is declared as large as the materials, so the shader is
+	// compiled again whenever their count changes while they fit
+	const bool inBlock = materials.size() <= MATERIAL_BLOCK_SIZE / stride;
+	const size_t blockCount = inBlock ? std::max<size_t>(materials.size(), 1) : 0;
+	if (!_loft_shader || inBlock || _materialBlock) {
+		initLoftShader(blockCount);
+	}
+
+	_materialTableCount = materials.size();
+	_materialBlock.reset();
+	_materialTable.reset();
+
+	std::vector<char> data(std::max<size_t>(blockCount, materials.size()) * stride, 0);
+	for (size_t i = 0; i < materials.size(); ++i) {
+		const Model::material_t& material = materials[i];
+		// the painting shown is picked in the ui, the map itself is not loaded
+		const float textured = material.unknown_parameter.count("map_Kd") != 0 ? 1.0f : 0.0f;
+		char* record = data.data() + i * stride;
+		memcpy(record + element.getOffset("ka"), material.ka, sizeof(material.ka));
+		memcpy(record + element.getOffset("ns"), &material.ns, sizeof(material.ns));
+		memcpy(record + element.getOffset("kd"), material.kd, sizeof(material.kd));
+		memcpy(record + element.getOffset("d"), &material.d, sizeof(material.d));
+		memcpy(record + element.getOffset("ks"), material.ks, sizeof(material.ks));
+		memcpy(record + element.getOffset("textured"), &textured, sizeof(textured));
+	}
+
+	if (inBlock) {
+		_materialBlock.reset(new UniformBuffer(data.size(), GL_STATIC_DRAW));
+		_materialBlock->setData(data.data(), data.size());
+		_materialBlock->setBindingPoint(MATERIAL_BLOCK_BINDING);
+	}
+	else {
+		_materialTable.reset(new TextureBuffer(GL_RGBA32F, data.size(), data.data()));
+	}
+}
+
+void LOFT::updateFrameConstants() {
+	const frame_constants_offsets_t& offsets = _frameConstantsOffsets;
+	char* const data = _frameConstantsStaging.data();
+	const auto write = [data](size_t offset, const void* value, size_t size) {
+		memcpy(data + offset, value, size);
+	};
+
+	const glm::mat4 projection = _camera->getProjectionMatrix();
+	const glm::mat4 view = _camera->getViewMatrix();
+	const glm::mat4 lightSpaceMatrix = _lightProjection * _lightView;
+	const glm::mat4 loftModel = getLoftTransform().getLocalMatrix();
+	const glm::mat3 loftNormalMatrix = glm::transpose(glm::inverse(glm::mat3(loftModel)));
+	// only read by the shaders with compact vertices
+	const BoundingBox loftBox = getLoftBoundingBox();
+	const glm::vec3 positionScale = loftBox.max - loftBox.min;
+	const glm::vec3 directionalLightDirection = -_directionalLight->transform.position;
+	const glm::vec3 spotLightDirection = _spotLight->transform.getFront();
+
+	write(offsets.projection, glm::value_ptr(projection), sizeof(projection));
+	write(offsets.view, glm::value_ptr(view), sizeof(view));
+	write(offsets.lightSpaceMatrix, glm::value_ptr(lightSpaceMatrix), sizeof(lightSpaceMatrix));
+	write(offsets.cameraPosition, glm::value_ptr(_camera->transform.position), sizeof(glm::vec3));
+	write(offsets.loftModel, glm::value_ptr(loftModel), sizeof(loftModel));
+	// the columns of a mat3 are vec4 aligned
+	for (int i = 0; i < 3; ++i) {
+		write(offsets.loftNormalMatrix + 16 * i, glm::value_ptr(loftNormalMatrix[i]), sizeof(glm::vec3));
+	}
+	write(offsets.positionOffset, glm::value_ptr(loftBox.min), sizeof(glm::vec3));
+	write(offsets.positionScale, glm::value_ptr(positionScale), sizeof(glm::vec3));
+	write(offsets.ambientLightColor, glm::value_ptr(_ambientLight->color), sizeof(glm::vec3));
+	write(offsets.ambientLightIntensity, &_ambientLight->intensity, sizeof(float));
+	write(offsets.directionalLightDirection, glm::value_ptr(directionalLightDirection), sizeof(glm::vec3));
+	write(offsets.directionalLightIntensity, &_directionalLight->intensity, sizeof(float));
+	write(offsets.directionalLightColor, glm::value_ptr(_directionalLight->color), sizeof(glm::vec3));
+	write(offsets.spotLightPosition, glm::value_ptr(_spotLight->transform.position), sizeof(glm::vec3));
+	write(offsets.spotLightDirection, glm::value_ptr(spotLightDirection), sizeof(glm::vec3));
+	write(offsets.spotLightIntensity, &_spotLight->intensity, sizeof(float));
+	write(offsets.spotLightColor, glm::value_ptr(_spotLight->color), sizeof(glm::vec3));
+	write(offsets.spotLightAngle, &_spotLight->angle, sizeof(float));
+	write(offsets.spotLightKc, &_spotLight->kc, sizeof(float));
+	write(offsets.spotLightKl, &_spotLight->kl, sizeof(float));
+	write(offsets.spotLightKq, &_spotLight->kq, sizeof(float));
+
+	// nothing is uploaded while the camera and the lights stay still
+	if (_frameConstantsStaging == _frameConstantsData) {
+		return;
+	}
+
+	_frameConstants->setData(_frameConstantsStaging.data(), _frameConstantsStaging.size());
+	_frameConstantsData = _frameConstantsStaging;
+}
+
+const std::vector<Model::material_t>& LOFT::getLoftMaterials() const {
+	return _loftPager ? _loftPager->getMaterials() : _loft->_materials;
+}
+
+BoundingBox LOFT::getLoftBoundingBox() const {
+	return _loftPager ? _loftPager->getBoundingBox() : _loft->getBoundingBox();
+}
+
+const Transform& LOFT::getLoftTransform() const {
+	return _loftPager ? _loftPager->transform : _loft->transform;
+}
+
 LOFT::~LOFT() {
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
@@ -186,7 +485,7 @@ void LOFT::handleInput() {
 		if (_input.mouse.move.xNow != _input.mouse.move.xOld) {
 			// rotate the camera around world up: glm::vec3(0.0f, 1.0f, 0.0f)
 			float theta = (_input.mouse.move.xNow - _input.mouse.move.xOld) * cameraRotateSpeed;
-			// q = cos(theta/2) + usin(theta/2)
+			// q = cos(theta/2) + u¡¤sin(theta/2)
 			glm::vec3 tmp = glm::normalize(_camera->transform.getUp())
 				* sin(glm::radians(theta / 2.0f));
 			glm::quat q(cos(glm::radians(theta / 2.0f)), tmp.x, tmp.y, tmp.z);
@@ -196,7 +495,7 @@ void LOFT::handleInput() {
 		if (_input.mouse.move.yNow != _input.mouse.move.yOld) {
 			// rotate the camera around its local right
 			float theta = (_input.mouse.move.yNow - _input.mouse.move.yOld) * cameraRotateSpeed;
-			// q = cos(theta/2) + usin(theta/2)
+			// q = cos(theta/2) + u¡¤sin(theta/2)
 			glm::vec3 tmp = glm::normalize(_camera->transform.getRight())
 				* sin(glm::radians(theta / 2.0f));
 			glm::quat q(cos(glm::radians(theta / 2.0f)), tmp.x, tmp.y, tmp.z);
@@ -293,98 +592,117 @@ void LOFT::handleInput() {
 			_NURBS->generateSplineBuffers();
 	}
 
+	// the loft triangle under the cursor, the ray goes from the near to the far plane in model space
+	if (_loftBvh) {
+		const float x = _input.mouse.move.xNow * 2.f / _windowWidth - 1;
+		const float y = -(_input.mouse.move.yNow * 2.f / _windowHeight - 1);
+		const glm::mat4 toModel = glm::inverse(
+			_camera->getProjectionMatrix() * _camera->getViewMatrix() * _loft->transform.getLocalMatrix());
+		glm::vec4 nearPoint = toModel * glm::vec4(x, y, -1.0f, 1.0f);
+		glm::vec4 farPoint = toModel * glm::vec4(x, y, 1.0f, 1.0f);
+		nearPoint /= nearPoint.w;
+		farPoint /= farPoint.w;
+		_pick = RayHit();
+		_loftBvh->intersect(Ray(glm::vec3(nearPoint), glm::vec3(farPoint - nearPoint), 0.0f, 1.0f), &_pick);
+	}
+
 	_input.forwardState();
 }
 
 void LOFT::renderFrame() {
 	showFpsInWindowTitle();
 
+	updateLoft();
+	updateFrameConstants();
+
 	// the 1st pass: generate depth map
 	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 	_depthMapFbo->bind();
 	glClear(GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
+	GLStateCache::get().setEnabled(GL_DEPTH_TEST, true);
 
-	// configure view and projection matrix
+	// the light matrices come from the frame constants
 	_depthMapShader->use();
-	_depthMapShader->setUniformMat4("projection", _lightProjection);
-	_depthMapShader->setUniformMat4("view", _lightView);
-	_depthMapShader->setUniformMat4("model", _loft->transform.getLocalMatrix());
 
-	glCullFace(GL_FRONT);
-	_loft->draw();
-	glCullFace(GL_BACK);
+	// the pager only holds the chunks around the camera, so the shadows
+	// of the loft farther away are missing
+	GLStateCache::get().setCullFace(GL_FRONT);
+	if (_loftPager) {
+		_loftPager->draw();
+	}
+	else {
+		_loft->drawDepth();
+	}
+	GLStateCache::get().setCullFace(GL_BACK);
 
 	// the 2nd pass: apply depth map
 	_depthMapFbo->unbind();
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, _windowWidth, _windowHeight);
 	glClearColor(_clearColor.r, _clearColor.g, _clearColor.b, _clearColor.a);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_DEPTH_TEST);
+	GLStateCache::get().setEnabled(GL_DEPTH_TEST, true);
 	
 	// glDisable(GL_DEPTH_TEST);
 	// _depthMapTestShader->use();
 	// _depthMap->bind();
 	// _fullscreenQuad->draw();
 	
-	glm::mat4 projection = _camera->getProjectionMatrix();
-	glm::mat4 view = _camera->getViewMatrix();
-
-	// draw the loft
+	// draw the loft, the camera and the lights come from the frame constants
 	_loft_shader->use();
-	_loft_shader->setUniformMat4("projection", projection);
-	_loft_shader->setUniformMat4("view", view);
-	_loft_shader->setUniformMat4("model", _loft->transform.getLocalMatrix());
-	_loft_shader->setUniformMat4("lightSpaceMatrix", _lightProjection * _lightView);
-	_loft_shader->setUniformBool("mode", _shadow);
+	_loft_shader->setUniformBool(_loftUniforms.mode, _shadow);
 	
-	for (int i = 0; i < _loft->_materials.size(); ++i) {
-		glm::vec3 vec;
-		vec = glm::vec3(_loft->_materials[i].ka[0], _loft->_materials[i].ka[1], _loft->_materials[i].ka[2]);
-		_loft_shader->setUniformVec3("materials[" + std::to_string(i) + "].ka", vec);
-		vec = glm::vec3(_loft->_materials[i].kd[0], _loft->_materials[i].kd[1], _loft->_materials[i].kd[2]);
-		_loft_shader->setUniformVec3("materials[" + std::to_string(i) + "].kd", vec);
-		vec = glm::vec3(_loft->_materials[i].ks[0], _loft->_materials[i].ks[1], _loft->_materials[i].ks[2]);
-		_loft_shader->setUniformVec3("materials[" + std::to_string(i) + "].ks", vec);
-
-		_loft_shader->setUniformFloat("materials[" + std::to_string(i) + "].ns", _loft->_materials[i].ns);
-	}
-
-	// light attributes
-	_loft_shader->setUniformVec3("spotLight.position", _spotLight->transform.position);
-	_loft_shader->setUniformVec3("spotLight.direction", _spotLight->transform.getFront());
-	_loft_shader->setUniformFloat("spotLight.intensity", _spotLight->intensity);
-	_loft_shader->setUniformVec3("spotLight.color", _spotLight->color);
-	_loft_shader->setUniformFloat("spotLight.angle", _spotLight->angle);
-	_loft_shader->setUniformFloat("spotLight.kc", _spotLight->kc);
-	_loft_shader->setUniformFloat("spotLight.kl", _spotLight->kl);
-	_loft_shader->setUniformFloat("spotLight.kq", _spotLight->kq);
-	_loft_shader->setUniformVec3("directionalLight.direction", -_directionalLight->transform.position);
-	_loft_shader->setUniformFloat("directionalLight.intensity", _directionalLight->intensity);
-	_loft_shader->setUniformVec3("directionalLight.color", _directionalLight->color);
-	_loft_shader->setUniformVec3("ambientLight.color", _ambientLight->color);
-	_loft_shader->setUniformFloat("ambientLight.intensity", _ambientLight->intensity);
-
-	// enable textures
+	// the shader looks the material of each run up in the material table,
+	// only its index is set right before the run is drawn
+	const Model::MaterialBinder bindMaterial = [this](int id) {
+		_loft_shader->setUniformInt(_loftUniforms.materialId, id);
+	};
+
+	// enable textures, the samplers are assigned their slots in initShader()
 	_paintingsTexture[_current_texture]->bind(0);
-	_loft_shader->setUniformInt("mapKd", 0);
 	_depthMap->bind(1);
-	_loft_shader->setUniformInt("shadowMap", 1);
+	if (_materialTable) {
+		_materialTable->bind(2);
+	}
 
-	_loft->draw();
+	// the pager culled its chunks against the frustum in updateLoft()
+	if (_loftPager) {
+		_loftPager->draw(bindMaterial);
+	}
+	else {
+		// only the submeshes that intersect the view frustum
+		const Frustum frustum = _camera->getFrustum();
+		const glm::mat4 loftModel = _loft->transform.getLocalMatrix();
+		const auto& submeshes = _loft->getSubmeshes();
+		_visibleSubmeshes.clear();
+		_visibleLods.clear();
+		_detailSubmeshes.clear();
+		for (uint32_t i = 0; i < submeshes.size(); ++i) {
+			if (frustum.intersect(submeshes[i].boundingBox, loftModel)) {
+				const uint32_t lod = _loft->selectLod(i, *_camera, static_cast<float>(_windowHeight), _lodPixelError);
+				if (lod == 0 && _meshletCulling) {
+					_detailSubmeshes.push_back(i);
+				}
+				else {
+					_visibleSubmeshes.push_back(i);
+					_visibleLods.push_back(lod);
+				}
+			}
+		}
+		_loft->drawSubmeshes(_visibleSubmeshes, _visibleLods, bindMaterial);
+
+		// the full detail ones are culled further per meshlet
+		_meshletStats = Model::MeshletCullStats();
+		_loft->drawMeshlets(_detailSubmeshes, *_camera, _meshletConeCulling, &_meshletStats, bindMaterial);
+	}
 
 	if (_show_six_basic) { // draw six basics
 
 		_six_basic_shader->use();
 
 		for (int i = 0; i < _six_basic.size(); ++i) {
-			_six_basic_shader->setUniformMat4("projection", projection);
-			_six_basic_shader->setUniformMat4("view", view);
-
 			glm::mat4 rotation_cam = glm::mat4(1.0f);
 			rotation_cam = glm::rotate(rotation_cam, _six_basic[i]->_rotate_angle_camera, _camera->transform.getUp());
-			_six_basic_shader->setUniformMat4("rotation", rotation_cam); // revolve round the camera
+			_six_basic_shader->setUniformMat4(_sixBasicUniforms.rotation, rotation_cam); // revolve round the camera
 
 			glm::mat4 translation = glm::mat4(1.0f);
 			translation = glm::translate(translation, _six_basic[i]->_global_position);
@@ -394,7 +712,7 @@ void LOFT::renderFrame() {
 			scale = glm::scale(scale, _six_basic[i]->_scale);
 			glm::mat4 six_model = translation * rotation_self * scale;
 			_six_basic[i]->_model = six_model;
-			_six_basic_shader->setUniformMat4("model", six_model);
+			_six_basic_shader->setUniformMat4(_sixBasicUniforms.model, six_model);
 			_six_basic[i]->draw();
 		}
 	}
@@ -420,6 +738,63 @@ void LOFT::renderFrame() {
 		ImGui::Separator();
 		ImGui::NewLine();
 
+		if (_loftPager) {
+			ImGui::Text("paged loft chunks: %llu resident, %llu visible, %llu pending / %llu",
+				static_cast<unsigned long long>(_loftPager->getResidentChunkCount()),
+				static_cast<unsigned long long>(_loftPager->getVisibleChunkCount()),
+				static_cast<unsigned long long>(_loftPager->getPendingChunkCount()),
+				static_cast<unsigned long long>(_loftPager->getChunkCount()));
+			ImGui::Text("loft gpu memory: %.1f MB, cpu memory: %.1f MB",
+				_loftPager->getGpuMemoryUsage() / (1024.0f * 1024.0f),
+				_loftPager->getCpuMemoryUsage() / (1024.0f * 1024.0f));
+			ImGui::Separator();
+			ImGui::NewLine();
+		}
+		else if (_loft->isLoading()) {
+			ImGui::Text("loading loft: %llu submeshes", static_cast<unsigned long long>(_loft->getSubmeshes().size()));
+			ImGui::ProgressBar(_loft->getLoadProgress());
+			ImGui::Separator();
+			ImGui::NewLine();
+		}
+		else {
+			if (!_loftBvh) {
+				ImGui::Text("building loft bvh");
+			}
+			ImGui::Text("loft cpu memory: %.1f MB", _loft->getMemoryUsage() / (1024.0f * 1024.0f));
+			ImGui::Separator();
+			ImGui::NewLine();
+		}
+
+		if (_loft) {
+			ImGui::SliderFloat("lod pixel error", &_lodPixelError, 0.0f, 8.0f);
+			ImGui::Checkbox("meshlet culling", &_meshletCulling);
+			ImGui::Checkbox("meshlet cone culling", &_meshletConeCulling);
+			ImGui::Text("culled meshlets: %llu / %llu",
+				static_cast<unsigned long long>(_meshletStats.frustumCulledMeshlets + _meshletStats.backfaceCulledMeshlets),
+				static_cast<unsigned long long>(_meshletStats.meshlets));
+			ImGui::Text("culled triangles: %llu / %llu (frustum %llu, cone %llu)",
+				static_cast<unsigned long long>(_meshletStats.getCulledTriangles()),
+				static_cast<unsigned long long>(_meshletStats.triangles),
+				static_cast<unsigned long long>(_meshletStats.frustumCulledTriangles),
+				static_cast<unsigned long long>(_meshletStats.backfaceCulledTriangles));
+		}
+		ImGui::Text("gl calls avoided last frame: %llu / %llu",
+			static_cast<unsigned long long>(GLStateCache::get().getAvoidedCalls()),
+			static_cast<unsigned long long>(GLStateCache::get().getIssuedCalls() + GLStateCache::get().getAvoidedCalls()));
+		ImGui::Separator();
+		ImGui::NewLine();
+
+		if (_pick.isHit()) {
+			const auto& submesh = _loft->getSubmeshes()[_pick.submesh];
+			ImGui::Text("under cursor: %s, triangle %u, material %s", submesh.name.c_str(), _pick.triangle,
+				_pick.material >= 0 ? _loft->_materials[_pick.material].name.c_str() : "none");
+		}
+		else {
+			ImGui::Text("under cursor: nothing");
+		}
+		ImGui::Separator();
+		ImGui::NewLine();
+
 		ImGui::Text("ambient light");
 		ImGui::Separator();
 		ImGui::SliderFloat("intensity##1", &_ambientLight->intensity, 0.0f, 1.0f);
@@ -456,11 +831,9 @@ void LOFT::renderFrame() {
 }
 
 void LOFT::initShader() {
-	const char* six_basics_vs = 
-		"#version 330 core\n"
+	const std::string six_basics_vs =
+		"#version 330 core\n" + std::string(frameConstantsBlock) +
 		"layout(location = 0) in vec3 aPosition;\n"
-		"uniform mat4 projection;\n"
-		"uniform mat4 view;\n"
 		"uniform mat4 model;\n"
 		"uniform mat4 rotation;\n"
 		"void main() {\n"
@@ -478,89 +851,173 @@ void LOFT::initShader() {
 	_six_basic_shader->attachVertexShader(six_basics_vs);
 	_six_basic_shader->attachFragmentShader(six_basics_fs);
 	_six_basic_shader->link();
+	_six_basic_shader->setUniformBlockBinding("FrameConstants", FRAME_CONSTANTS_BINDING);
+	_sixBasicUniforms.model = _six_basic_shader->getUniform("model");
+	_sixBasicUniforms.rotation = _six_basic_shader->getUniform("rotation");
+
+	// compact vertices are dequantized in the vertex shaders, the paged
+	// chunks are full floats
+	const std::string vertexFormat =
+		_loft && _loft->getVertexFormat() == ModelLoadOptions::VertexFormat::Compact ? "#define COMPACT_VERTEX\n" : "";
+
+	// the loft program is compiled for the materials it reads
+	updateMaterialTable();
+
+	// shader for depth mapping
+	const std::string shadow_vs =
+		"#version 330 core\n" + vertexFormat +
+		"layout(location = 0) in vec3 aPosition;\n"
+
+		+ std::string(frameConstantsBlock) + dequantize +
+
+		"void main() {\n"
+		"	gl_Position = lightSpaceMatrix * loftModel * vec4(decodePosition(aPosition), 1.0f);\n"
+		"}\n";
+
+	const char* shadow_fs = 
+		"#version 330 core\n"
+		"void main() {\n"
+		"	// gl_FragDepth = gl_FragCoord.z;\n"
+		"}\n";
+
+	_depthMapShader.reset(new GLSLProgram);
+	_depthMapShader->attachVertexShader(shadow_vs);
+	_depthMapShader->attachFragmentShader(shadow_fs);
+	_depthMapShader->link();
+	_depthMapShader->setUniformBlockBinding("FrameConstants", FRAME_CONSTANTS_BINDING);
+
+	// one buffer behind the frame constants of every program
+	const Std140Layout frameConstantsLayout = getFrameConstantsLayout();
+	_frameConstants.reset(new UniformBuffer(frameConstantsLayout, GL_DYNAMIC_DRAW));
+	_frameConstants->setBindingPoint(FRAME_CONSTANTS_BINDING);
+	_frameConstantsStaging.assign(frameConstantsLayout.getSize(), 0);
+	_frameConstantsData.clear();
+
+	frame_constants_offsets_t& offsets = _frameConstantsOffsets;
+	offsets.projection = frameConstantsLayout.getOffset("projection");
+	offsets.view = frameConstantsLayout.getOffset("view");
+	offsets.lightSpaceMatrix = frameConstantsLayout.getOffset("lightSpaceMatrix");
+	offsets.cameraPosition = frameConstantsLayout.getOffset("cameraPosition");
+	offsets.loftModel = frameConstantsLayout.getOffset("loftModel");
+	offsets.loftNormalMatrix = frameConstantsLayout.getOffset("loftNormalMatrix");
+	offsets.positionOffset = frameConstantsLayout.getOffset("positionOffset");
+	offsets.positionScale = frameConstantsLayout.getOffset("positionScale");
+	offsets.ambientLightColor = frameConstantsLayout.getOffset("ambientLight.color");
+	offsets.ambientLightIntensity = frameConstantsLayout.getOffset("ambientLight.intensity");
+	offsets.directionalLightDirection = frameConstantsLayout.getOffset("directionalLight.direction");
+	offsets.directionalLightIntensity = frameConstantsLayout.getOffset("directionalLight.intensity");
+	offsets.directionalLightColor = frameConstantsLayout.getOffset("directionalLight.color");
+	offsets.spotLightPosition = frameConstantsLayout.getOffset("spotLight.position");
+	offsets.spotLightDirection = frameConstantsLayout.getOffset("spotLight.direction");
+	offsets.spotLightIntensity = frameConstantsLayout.getOffset("spotLight.intensity");
+	offsets.spotLightColor = frameConstantsLayout.getOffset("spotLight.color");
+	offsets.spotLightAngle = frameConstantsLayout.getOffset("spotLight.angle");
+	offsets.spotLightKc = frameConstantsLayout.getOffset("spotLight.kc");
+	offsets.spotLightKl = frameConstantsLayout.getOffset("spotLight.kl");
+	offsets.spotLightKq = frameConstantsLayout.getOffset("spotLight.kq");
+
+	const char* quad_vs =
+		"#version 330 core\n"
+		"layout(location = 0) in vec2 aPosition;\n"
+		"layout(location = 1) in vec2 aTexCoords;\n"
+
+		"out vec2 fTexCoords;\n"
+
+		"void main() {\n"
+		"	fTexCoords = aTexCoords;\n"
+		"	gl_Position = vec4(aPosition, 0.0f, 1.0f);\n"
+		"}\n";
 
-	const char* loft_vs =
+	const char* quad_fs = 
 		"#version 330 core\n"
+		"in vec2 fTexCoords;\n"
+		"out vec4 color;\n"
+
+		"uniform sampler2D depthMap;\n"
+
+		"void main() {\n"
+		"	float depthValue = texture(depthMap, fTexCoords).r;\n"
+		"	color = vec4(vec3(depthValue), 1.0);\n"
+		"}\n";
+
+	_depthMapTestShader.reset(new GLSLProgram);
+	_depthMapTestShader->attachVertexShader(quad_vs);
+	_depthMapTestShader->attachFragmentShader(quad_fs);
+	_depthMapTestShader->link();
+}
+
+void LOFT::initLoftShader(size_t blockMaterials) {
+	const std::string vertexFormat =
+		_loft && _loft->getVertexFormat() == ModelLoadOptions::VertexFormat::Compact ? "#define COMPACT_VERTEX\n" : "";
+
+	const std::string loft_vs =
+		"#version 330 core\n" + vertexFormat +
 		"layout(location = 0) in vec3 aPosition;\n"
+		"#ifdef COMPACT_VERTEX\n"
+		"layout(location = 1) in vec2 aNormal;\n"
+		"#else\n"
 		"layout(location = 1) in vec3 aNormal;\n"
+		"#endif\n"
 		"layout(location = 2) in vec2 aTexCoord;\n"
-		"layout(location = 3) in int aMaterial;\n"
 
 		"out vec3 fPosition;\n"
 		"out vec3 fNormal;\n"
 		"out vec2 fTexCoord;\n"
 		"out vec4 fPositionLightSpace;\n"
-		"flat out int material_id;\n"
 
-		"uniform mat4 model;\n"
-		"uniform mat4 view;\n"
-		"uniform mat4 projection;\n"
-		"uniform mat4 lightSpaceMatrix;\n"
+		+ std::string(frameConstantsBlock) + dequantize +
 
 		"void main() {\n"
-		"	fPosition = vec3(model * vec4(aPosition, 1.0f));\n"
+		"	vec3 position = decodePosition(aPosition);\n"
+		"	fPosition = vec3(loftModel * vec4(position, 1.0f));\n"
 		"	fPositionLightSpace = lightSpaceMatrix * vec4(fPosition, 1.0f);\n"
-		"	fNormal = mat3(transpose(inverse(model))) * aNormal;\n"
+		"	fNormal = loftNormalMatrix * decodeNormal(aNormal);\n"
 		"	fTexCoord = aTexCoord;\n"
-		"	gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
-		"	material_id = aMaterial;\n"
+		"	gl_Position = projection * view * vec4(fPosition, 1.0f);\n"
 		"}\n";
 
-	const char* loft_fs = 
-		"#version 330 core\n"
+	// the materials are read from a block of blockMaterials, or from the table
+	const std::string materialStorage =
+		blockMaterials > 0 ? "#define MATERIAL_COUNT " + std::to_string(blockMaterials) + "\n" : "";
+
+	const std::string loft_fs =
+		"#version 330 core\n" + materialStorage +
 		"in vec3 fPosition;\n"
 		"in vec3 fNormal;\n"
 		"in vec2 fTexCoord;\n"
 		"in vec4 fPositionLightSpace;\n"
-		"flat in int material_id;\n"
 		"out vec4 color;\n"
-
-		"// ambient light data structure declaration\n"
-		"struct AmbientLight {\n"
-		"	vec3 color;\n"
-		"	float intensity;\n"
-		"};\n"
-
-		"// directional light data structure declaration\n"
-		"struct DirectionalLight {\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"};\n"
-
-		"// spot light data structure declaration\n"
-		"struct SpotLight {\n"
-		"	vec3 position;\n"
-		"	vec3 direction;\n"
-		"	float intensity;\n"
-		"	vec3 color;\n"
-		"	float angle;\n"
-		"	float kc;\n"
-		"	float kl;\n"
-		"	float kq;\n"
-		"};\n"
+		+ std::string(frameConstantsBlock) +
 
 		"// material data structure declaration\n"
 		"struct Material {\n"
 		"	vec3 ka;\n"
+		"	float ns;\n"
 		"	vec3 kd;\n"
+		"	float d;\n"
 		"	vec3 ks;\n"
-		"	float ns;\n"
+		"	// 1 when it has a map_Kd\n"
+		"	float textured;\n"
 		"};\n"
 
 		"// uniform variables\n"
-		"uniform DirectionalLight directionalLight;\n"
-		"uniform SpotLight spotLight;\n"
-		"uniform AmbientLight ambientLight;\n"
-		"uniform vec3 cameraPosition;\n"
-		"uniform Material materials[20];\n"
+		"#ifdef MATERIAL_COUNT\n"
+		"layout(std140) uniform MaterialBlock {\n"
+		"	Material materials[MATERIAL_COUNT];\n"
+		"};\n"
+		"#else\n"
+		"// three texels per material, the members of Material in order\n"
+		"uniform samplerBuffer materialTable;\n"
+		"#endif\n"
+		"uniform int material_id;\n"
+		"Material material;\n"
 		"uniform sampler2D mapKd;\n"
 		"uniform sampler2D shadowMap;\n"
 		"uniform bool mode;\n"
 
 		"vec3 calcDirectionalLight_diffuse(vec3 normal) {\n"
 		"	vec3 lightDir = normalize(-directionalLight.direction);\n"
-		"	vec3 diffuse = directionalLight.color * max(dot(lightDir, normal), 0.0f) * materials[material_id].kd;\n"
+		"	vec3 diffuse = directionalLight.color * max(dot(lightDir, normal), 0.0f) * material.kd;\n"
 		"	return directionalLight.intensity * diffuse ;\n"
 		"}\n"
 
@@ -568,8 +1025,8 @@ void LOFT::initShader() {
 		"	vec3 lightDir = normalize(-directionalLight.direction);\n"
 		"	vec3 reflectDir = reflect(-lightDir, normal);\n"
 		"	vec3 viewDir = cameraPosition - fPosition;\n"
-		"	float spec = pow(max(dot(normalize(viewDir), normalize(reflectDir)), 0.0), materials[material_id].ns);\n"
-		"	return directionalLight.intensity * directionalLight.color * spec * materials[material_id].ks;\n"
+		"	float spec = pow(max(dot(normalize(viewDir), normalize(reflectDir)), 0.0), material.ns);\n"
+		"	return directionalLight.intensity * directionalLight.color * spec * material.ks;\n"
 		"}\n"
 
 		"vec3 calcSpotLight_diffuse(vec3 normal) {\n"
@@ -578,7 +1035,7 @@ void LOFT::initShader() {
 		"	if (theta > spotLight.angle) {\n"
 		"		return vec3(0.0f, 0.0f, 0.0f);\n"
 		"	}\n"
-		"	vec3 diffuse = spotLight.color * max(dot(lightDir, normal), 0.0f) * materials[material_id].kd;\n"
+		"	vec3 diffuse = spotLight.color * max(dot(lightDir, normal), 0.0f) * material.kd;\n"
 		"	float distance = length(spotLight.position - fPosition);\n"
 		"	float attenuation = 1.0f / (spotLight.kc + spotLight.kl * distance + spotLight.kq * distance * distance);\n"
 		"	return spotLight.intensity * attenuation * diffuse;\n"
@@ -592,10 +1049,10 @@ void LOFT::initShader() {
 		"	}\n"
 		"	vec3 reflectDir = reflect(-lightDir, normal);\n"
 		"	vec3 viewDir = cameraPosition - fPosition;\n"
-		"	float spec = pow(max(dot(normalize(viewDir), normalize(reflectDir)), 0.0), materials[material_id].ns);\n"
+		"	float spec = pow(max(dot(normalize(viewDir), normalize(reflectDir)), 0.0), material.ns);\n"
 		"	float distance = length(spotLight.position - fPosition);\n"
 		"	float attenuation = 1.0f / (spotLight.kc + spotLight.kl * distance + spotLight.kq * distance * distance);\n"
-		"	return spotLight.intensity * distance * attenuation * spotLight.color * spec * materials[material_id].ks;\n"
+		"	return spotLight.intensity * distance * attenuation * spotLight.color * spec * material.ks;\n"
 		"}\n"
 
 		"float shadowCalculation(vec4 fragPosLightSpace) {\n"
@@ -618,8 +1075,24 @@ void LOFT::initShader() {
 		"	return shadow;\n"
 		"}\n"
 		
+		"Material fetchMaterial(int id) {\n"
+		"	// faces without a material are left black\n"
+		"	if (id < 0) {\n"
+		"		return Material(vec3(0.0f), 1.0f, vec3(0.0f), 1.0f, vec3(0.0f), 0.0f);\n"
+		"	}\n"
+		"#ifdef MATERIAL_COUNT\n"
+		"	return materials[id];\n"
+		"#else\n"
+		"	vec4 t0 = texelFetch(materialTable, 3 * id);\n"
+		"	vec4 t1 = texelFetch(materialTable, 3 * id + 1);\n"
+		"	vec4 t2 = texelFetch(materialTable, 3 * id + 2);\n"
+		"	return Material(t0.rgb, t0.a, t1.rgb, t1.a, t2.rgb, t2.a);\n"
+		"#endif\n"
+		"}\n"
+
 		"void main() {\n"
-		"	vec3 ambient = materials[material_id].ka * ambientLight.color * ambientLight.intensity;\n"
+		"	material = fetchMaterial(material_id);\n"
+		"	vec3 ambient = material.ka * ambientLight.color * ambientLight.intensity;\n"
 		"	vec3 normal = normalize(fNormal);\n"
 		"	vec3 diffuse = calcDirectionalLight_diffuse(normal) + calcSpotLight_diffuse(normal);\n"
 		"	vec3 specular = calcDirectionalLight_specular(normal) + calcSpotLight_specular(normal);\n"
@@ -629,64 +1102,25 @@ void LOFT::initShader() {
 		"		coef = vec4(ambient + (1.0 - shadow) * (diffuse + specular), 1.0f);\n"
 		"	else\n"
 		"		coef = vec4(ambient + diffuse + specular, 1.0f);\n"
-		"	color = material_id == 11 ? coef * texture(mapKd, fTexCoord) : coef;\n"
+		"	color = material.textured > 0.5f ? coef * texture(mapKd, fTexCoord) : coef;\n"
 		"}\n";
 
 	_loft_shader.reset(new GLSLProgram);
 	_loft_shader->attachVertexShader(loft_vs);
 	_loft_shader->attachFragmentShader(loft_fs);
 	_loft_shader->link();
+	_loftUniforms.mode = _loft_shader->getUniform("mode");
+	_loftUniforms.materialId = _loft_shader->getUniform("material_id");
 
-	// shader for depth mapping
-	const char* shadow_vs =
-		"#version 330 core\n"
-		"layout(location = 0) in vec3 aPosition;\n"
-
-		"uniform mat4 projection;\n"
-		"uniform mat4 view;\n"
-		"uniform mat4 model;\n"
-
-		"void main() {\n"
-		"	gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
-		"}\n";
-
-	const char* shadow_fs = 
-		"#version 330 core\n"
-		"void main() {\n"
-		"	// gl_FragDepth = gl_FragCoord.z;\n"
-		"}\n";
-
-	_depthMapShader.reset(new GLSLProgram);
-	_depthMapShader->attachVertexShader(shadow_vs);
-	_depthMapShader->attachFragmentShader(shadow_fs);
-	_depthMapShader->link();
-
-	const char* quad_vs =
-		"#version 330 core\n"
-		"layout(location = 0) in vec2 aPosition;\n"
-		"layout(location = 1) in vec2 aTexCoords;\n"
-
-		"out vec2 fTexCoords;\n"
-
-		"void main() {\n"
-		"	fTexCoords = aTexCoords;\n"
-		"	gl_Position = vec4(aPosition, 0.0f, 1.0f);\n"
-		"}\n";
-
-	const char* quad_fs = 
-		"#version 330 core\n"
-		"in vec2 fTexCoords;\n"
-		"out vec4 color;\n"
-
-		"uniform sampler2D depthMap;\n"
-
-		"void main() {\n"
-		"	float depthValue = texture(depthMap, fTexCoords).r;\n"
-		"	color = vec4(vec3(depthValue), 1.0);\n"
-		"}\n";
-
-	_depthMapTestShader.reset(new GLSLProgram);
-	_depthMapTestShader->attachVertexShader(quad_vs);
-	_depthMapTestShader->attachFragmentShader(quad_fs);
-	_depthMapTestShader->link();
+	// the texture slots never change
+	_loft_shader->use();
+	_loft_shader->setUniformInt("mapKd", 0);
+	_loft_shader->setUniformInt("shadowMap", 1);
+	if (blockMaterials > 0) {
+		_loft_shader->setUniformBlockBinding("MaterialBlock", MATERIAL_BLOCK_BINDING);
+	}
+	else {
+		_loft_shader->setUniformInt("materialTable", 2);
+	}
+	_loft_shader->setUniformBlockBinding("FrameConstants", FRAME_CONSTANTS_BINDING);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -8,16 +9,22 @@
 #include "./base/camera.h"
 #include "./base/light.h"
 #include "./base/texture2d.h"
+#include "./base/texture_buffer.h"
+#include "./base/uniform_buffer.h"
 #include "./base/framebuffer.h"
 #include "./base/fullscreen_quad.h"
 
 #include "model.h"
+#include "octree_pager.h"
+#include "triangle_bvh.h"
 #include "six_basic.h"
 #include "NURBS.h"
 
 class LOFT : public Application {
 public:
-	LOFT(const Options& options);
+	// pageLoft draws the loft through an OctreePager over a mesh octree built
+	// next to the obj on the first run, instead of loading it whole
+	LOFT(const Options& options, bool pageLoft = false);
 
 	~LOFT();
 
@@ -29,12 +36,87 @@ private:
 	std::unique_ptr<PerspectiveCamera> _camera;
 
 	std::unique_ptr<Model> _loft;
+	// set instead of _loft when the loft is paged, which has no lods,
+	// meshlets or picking
+	std::unique_ptr<OctreePager> _loftPager;
+	// submeshes of the loft inside the camera frustum, refilled every frame
+	std::vector<uint32_t> _visibleSubmeshes;
+	// and the level each of them is drawn at
+	std::vector<uint32_t> _visibleLods;
+	// screen space error allowed when picking a level, 0 always draws the full mesh
+	float _lodPixelError = 1.0f;
+	// visible submeshes at full detail, drawn through meshlet culling
+	std::vector<uint32_t> _detailSubmeshes;
+	bool _meshletCulling = true;
+	// also drop meshlets facing away from the camera. the lit pass does not
+	// cull back faces, so this would remove open and double sided geometry
+	// seen from behind, only enable it for closed models
+	bool _meshletConeCulling = false;
+	// what meshlet culling removed in the last frame
+	Model::MeshletCullStats _meshletStats;
+	// ray queries against the loft in its model space
+	std::unique_ptr<TriangleBvh> _loftBvh;
+	// the loft triangle under the mouse cursor
+	RayHit _pick;
+	// the bvh build started when the loft finished loading
+	std::future<std::unique_ptr<TriangleBvh>> _loftBvhBuild;
+	// the camera is centered on the loft once its bounding box is known
+	bool _cameraPlaced = false;
+	// empty until the camera is placed
 	std::vector<std::unique_ptr<BaseGeo> > _six_basic;
 
 	std::unique_ptr<GLSLProgram> _six_basic_shader;
 	bool _show_six_basic = false;
 	std::unique_ptr<GLSLProgram> _loft_shader;
 
+	// uniforms set every frame, resolved once after the shaders are linked
+	struct six_basic_uniforms_t {
+		GLSLProgram::Uniform model;
+		GLSLProgram::Uniform rotation;
+	} _sixBasicUniforms;
+
+	struct loft_uniforms_t {
+		GLSLProgram::Uniform mode;
+		GLSLProgram::Uniform materialId;
+	} _loftUniforms;
+
+	// the camera, the lights and the loft transform, in one uniform block
+	// shared by every program and uploaded only in the frames they change
+	std::unique_ptr<UniformBuffer> _frameConstants;
+	std::vector<char> _frameConstantsStaging;
+	// what the buffer holds
+	std::vector<char> _frameConstantsData;
+	// the std140 offsets of its members
+	struct frame_constants_offsets_t {
+		size_t projection;
+		size_t view;
+		size_t lightSpaceMatrix;
+		size_t cameraPosition;
+		size_t loftModel;
+		size_t loftNormalMatrix;
+		size_t positionOffset;
+		size_t positionScale;
+		size_t ambientLightColor;
+		size_t ambientLightIntensity;
+		size_t directionalLightDirection;
+		size_t directionalLightIntensity;
+		size_t directionalLightColor;
+		size_t spotLightPosition;
+		size_t spotLightDirection;
+		size_t spotLightIntensity;
+		size_t spotLightColor;
+		size_t spotLightAngle;
+		size_t spotLightKc;
+		size_t spotLightKl;
+		size_t spotLightKq;
+	} _frameConstantsOffsets;
+	// the materials of the loft, uploaded once they are parsed into a uniform
+	// block sized to them, or into a texture buffer when there are more than
+	// the smallest block holds
+	std::unique_ptr<UniformBuffer> _materialBlock;
+	std::unique_ptr<TextureBuffer> _materialTable;
+	size_t _materialTableCount = 0;
+
 	std::unique_ptr<AmbientLight> _ambientLight;
 	std::unique_ptr<DirectionalLight> _directionalLight;
 	std::unique_ptr<SpotLight> _spotLight;
@@ -56,4 +138,28 @@ private:
 	bool _drawNURBS = false;
 
 	void initShader();
+
+	// build the six basics around the camera
+	void initSixBasic();
+
+	// the loft program, reading blockMaterials from the material block, or
+	// every material from the table when it is 0
+	void initLoftShader(size_t blockMaterials);
+
+	// upload the loft batches loaded since the last frame, or page in the
+	// chunks around the camera
+	void updateLoft();
+
+	// upload the materials, compiling the loft program again for their count
+	void updateMaterialTable();
+
+	// fill the frame constants and upload them if they changed
+	void updateFrameConstants();
+
+	// of the loaded or the paged loft
+	const std::vector<Model::material_t>& getLoftMaterials() const;
+
+	BoundingBox getLoftBoundingBox() const;
+
+	const Transform& getLoftTransform() const;
 };
\ No newline at end of file
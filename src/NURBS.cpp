@@ -1,4 +1,5 @@
 #include "NURBS.h"
+#include "./base/gl_state.h"
 
 #define FLOAT_ERR 0.00001f
 
@@ -25,11 +26,13 @@ NURBS::NURBS() {
 	_NURBSshader->attachVertexShader(NURBS_vs);
 	_NURBSshader->attachFragmentShader(NURBS_fs);
 	_NURBSshader->link();
+	_colorUniform = _NURBSshader->getUniform("color_in");
 }
 
 void NURBS::generateSplineBuffers() {
 	// release previous resources
 	if (_splineVao) {
+		GLStateCache::get().forgetVertexArray(_splineVao);
 		glDeleteVertexArrays(1, &_splineVao);
 		_splineVao = 0;
 	}
@@ -40,7 +43,7 @@ void NURBS::generateSplineBuffers() {
 
 	// init new resources
 	glGenVertexArrays(1, &_splineVao);
-	glBindVertexArray(_splineVao);
+	GLStateCache::get().bindVertexArray(_splineVao);
 
 	nurbsSpline();
 	if (_geometric)
@@ -52,12 +55,13 @@ void NURBS::generateSplineBuffers() {
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	glEnableVertexAttribArray(0);
 
-	glBindVertexArray(0);
+	GLStateCache::get().bindVertexArray(0);
 }
 
 void NURBS::generateControlPointsBuffers() {
 	// release previous resources
 	if (_controlPointsVao) {
+		GLStateCache::get().forgetVertexArray(_controlPointsVao);
 		glDeleteVertexArrays(1, &_controlPointsVao);
 		_controlPointsVao = 0;
 	}
@@ -68,19 +72,20 @@ void NURBS::generateControlPointsBuffers() {
 
 	// init new resources
 	glGenVertexArrays(1, &_controlPointsVao);
-	glBindVertexArray(_controlPointsVao);
+	GLStateCache::get().bindVertexArray(_controlPointsVao);
 	glGenBuffers(1, &_controlPointsVbo);
 	glBindBuffer(GL_ARRAY_BUFFER, _controlPointsVbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * _controlPoints.size(), _controlPoints.data(), GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	glEnableVertexAttribArray(0);
 
-	glBindVertexArray(0);
+	GLStateCache::get().bindVertexArray(0);
 }
 
 void NURBS::generateGeometricBuffers(std::vector<glm::vec2> geom) {
 	// release previous resources
 	if (_geomVao) {
+		GLStateCache::get().forgetVertexArray(_geomVao);
 		glDeleteVertexArrays(1, &_geomVao);
 		_geomVao = 0;
 	}
@@ -91,61 +96,63 @@ void NURBS::generateGeometricBuffers(std::vector<glm::vec2> geom) {
 
 	// init new resources
 	glGenVertexArrays(1, &_geomVao);
-	glBindVertexArray(_geomVao);
+	GLStateCache::get().bindVertexArray(_geomVao);
 	glGenBuffers(1, &_geomVbo);
 	glBindBuffer(GL_ARRAY_BUFFER, _geomVbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * geom.size(), geom.data(), GL_STATIC_DRAW);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 	glEnableVertexAttribArray(0);
 
-	glBindVertexArray(0);
+	GLStateCache::get().bindVertexArray(0);
 }
 
 void NURBS::draw() {
 	// draw control points
 	if (_controlPoints.size() > 0) {
-		glBindVertexArray(_controlPointsVao);
+		GLStateCache::get().bindVertexArray(_controlPointsVao);
 		_NURBSshader->use();
-		_NURBSshader->setUniformVec4("color_in", glm::vec4(1.f, 1.f, 0.f, 0.f));
+		_NURBSshader->setUniformVec4(_colorUniform, glm::vec4(1.f, 1.f, 0.f, 0.f));
 
+		// points of equal weight only change the state once
+		GLStateCache& state = GLStateCache::get();
 		for (int i = 0; i < _controlPoints.size(); i++)
 		{
-			glPointSize(15 * _weights[i]);
+			state.setPointSize(15 * _weights[i]);
 			if (_weights[i] == 0.f)
-				glColorMask(GL_FALSE, GL_TRUE, GL_TRUE, GL_TRUE);
+				state.setColorMask(GL_FALSE, GL_TRUE, GL_TRUE, GL_TRUE);
 			else
-				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+				state.setColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 			glDrawArrays(GL_POINTS, i, 1);
 		}
 
-		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		state.setColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-		glBindVertexArray(0);
+		GLStateCache::get().bindVertexArray(0);
 	}
 	// draw splines
 	if (_controlPoints.size() > 1) {
-		glBindVertexArray(_splineVao);
+		GLStateCache::get().bindVertexArray(_splineVao);
 		_NURBSshader->use();
-		_NURBSshader->setUniformVec4("color_in", glm::vec4(1.f, 1.f, 1.f, 0.f));
+		_NURBSshader->setUniformVec4(_colorUniform, glm::vec4(1.f, 1.f, 1.f, 0.f));
 
 		glDrawArrays(GL_LINE_STRIP, 0, _spline.size());
 
-		glBindVertexArray(0);
+		GLStateCache::get().bindVertexArray(0);
 
 		if (_geometric) {
 			for (int i = 0; i < _geom.size(); i++)
 			{
 				generateGeometricBuffers(_geom[i]);
 
-				glBindVertexArray(_geomVao);
+				GLStateCache::get().bindVertexArray(_geomVao);
 				_NURBSshader->use();
-				_NURBSshader->setUniformVec4("color_in", glm::vec4(1.f, 0.f, 0.f, 0.f));
+				_NURBSshader->setUniformVec4(_colorUniform, glm::vec4(1.f, 0.f, 0.f, 0.f));
 
-				glPointSize(10);
+				GLStateCache::get().setPointSize(10);
 				glDrawArrays(GL_POINTS, 0, _geom[i].size());
 				glDrawArrays(GL_LINE_STRIP, 0, _geom[i].size());
 
-				glBindVertexArray(0);
+				GLStateCache::get().bindVertexArray(0);
 			}
 		}
 	}
@@ -43,4 +43,5 @@ public:
 	GLuint _geomVbo = 0;
 
 	std::unique_ptr<GLSLProgram> _NURBSshader;
+	GLSLProgram::Uniform _colorUniform;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "application.h"
+#include "gl_state.h"
 
 Application::Application(const Options& options)
 	: _assetRootDir(options.assetRootDir),
@@ -75,6 +76,7 @@ void Application::run() {
 		updateTime();
 		handleInput();
 		renderFrame();
+		GLStateCache::get().endFrame();
 
 		glfwSwapBuffers(_window);
 		glfwPollEvents();
@@ -3,6 +3,7 @@
 #include <vector>
 #include <glad/glad.h>
 
+#include "gl_state.h"
 #include "texture.h"
 
 class Framebuffer {
@@ -20,17 +21,18 @@ public:
 
 	~Framebuffer() {
 		if (_handle != 0) {
+			GLStateCache::get().forgetFramebuffer(_handle);
 			glDeleteFramebuffers(1, &_handle);
 			_handle = 0;
 		}
 	}
 
 	void bind() {
-		glBindFramebuffer(GL_FRAMEBUFFER, _handle);
+		GLStateCache::get().bindFramebuffer(_handle);
 	}
 
 	void unbind() {
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLStateCache::get().bindFramebuffer(0);
 	}
 
 	void attachTexture(const Texture& texture, GLenum attachment, int level = 0) {
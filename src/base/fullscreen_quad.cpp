@@ -1,4 +1,5 @@
 #include "fullscreen_quad.h"
+#include "gl_state.h"
 
 FullscreenQuad::FullscreenQuad() {
 	float _vertices[] = {
@@ -13,7 +14,7 @@ FullscreenQuad::FullscreenQuad() {
 	glGenVertexArrays(1, &_vao);
 	glGenBuffers(1, &_vbo);
 
-	glBindVertexArray(_vao);
+	GLStateCache::get().bindVertexArray(_vao);
 	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
 
 	glBufferData(GL_ARRAY_BUFFER, sizeof(_vertices), &_vertices, GL_STATIC_DRAW);
@@ -25,7 +26,7 @@ FullscreenQuad::FullscreenQuad() {
 						  reinterpret_cast<float*>(2 * sizeof(float)));
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	GLStateCache::get().bindVertexArray(0);
 }
 
 FullscreenQuad::FullscreenQuad(FullscreenQuad&& rhs) noexcept
@@ -36,6 +37,7 @@ FullscreenQuad::FullscreenQuad(FullscreenQuad&& rhs) noexcept
 
 FullscreenQuad::~FullscreenQuad() {
 	if (_vao) {
+		GLStateCache::get().forgetVertexArray(_vao);
 		glDeleteVertexArrays(1, &_vao);
 		_vao = 0;
 	}
@@ -47,7 +49,7 @@ FullscreenQuad::~FullscreenQuad() {
 }
 
 void FullscreenQuad::draw() const {
-	glBindVertexArray(_vao);
+	GLStateCache::get().bindVertexArray(_vao);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
+	GLStateCache::get().bindVertexArray(0);
 }
\ No newline at end of file
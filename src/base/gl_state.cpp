@@ -0,0 +1,208 @@
+#include "gl_state.h"
+
+GLStateCache& GLStateCache::get() {
+	static GLStateCache cache;
+	return cache;
+}
+
+GLStateCache::GLStateCache() {
+	invalidate();
+}
+
+void GLStateCache::useProgram(GLuint program) {
+	if (changes(_program != program)) {
+		glUseProgram(program);
+		_program = program;
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray) {
+	if (changes(_vertexArray != vertexArray)) {
+		glBindVertexArray(vertexArray);
+		_vertexArray = vertexArray;
+	}
+}
+
+void GLStateCache::bindFramebuffer(GLuint framebuffer) {
+	if (changes(_framebuffer != framebuffer)) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		_framebuffer = framebuffer;
+	}
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+	int index = TextureTargetCount;
+	switch (target) {
+	case GL_TEXTURE_2D:       index = Texture2D;      break;
+	case GL_TEXTURE_2D_ARRAY: index = Texture2DArray; break;
+	case GL_TEXTURE_CUBE_MAP: index = TextureCubeMap; break;
+	case GL_TEXTURE_BUFFER:   index = TextureBuffer;  break;
+	default: break;
+	}
+
+	const int unit = _activeTexture == unknownEnum ? -1 : static_cast<int>(_activeTexture - GL_TEXTURE0);
+	if (index == TextureTargetCount || unit < 0 || unit >= maxTextureUnits) {
+		changes(true);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	GLuint& bound = _textures[unit][index];
+	if (changes(bound != texture)) {
+		glBindTexture(target, texture);
+		bound = texture;
+	}
+}
+
+void GLStateCache::bindTexture(int unit, GLenum target, GLuint texture) {
+	setActiveTexture(unit);
+	bindTexture(target, texture);
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint sampler) {
+	if (unit >= static_cast<GLuint>(maxTextureUnits)) {
+		changes(true);
+		glBindSampler(unit, sampler);
+		return;
+	}
+
+	if (changes(_samplers[unit] != sampler)) {
+		glBindSampler(unit, sampler);
+		_samplers[unit] = sampler;
+	}
+}
+
+void GLStateCache::setCullFace(GLenum face) {
+	if (changes(_cullFace != face)) {
+		glCullFace(face);
+		_cullFace = face;
+	}
+}
+
+void GLStateCache::setColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+	const int mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if (changes(_colorMask != mask)) {
+		glColorMask(red, green, blue, alpha);
+		_colorMask = mask;
+	}
+}
+
+void GLStateCache::setPointSize(float size) {
+	if (changes(_pointSize != size)) {
+		glPointSize(size);
+		_pointSize = size;
+	}
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled) {
+	int index = CapabilityCount;
+	switch (capability) {
+	case GL_DEPTH_TEST: index = DepthTest; break;
+	case GL_CULL_FACE:  index = CullFace;  break;
+	case GL_BLEND:      index = Blend;     break;
+	default: break;
+	}
+
+	const int state = enabled ? 1 : 0;
+	if (changes(index == CapabilityCount || _capabilities[index] != state)) {
+		if (enabled) {
+			glEnable(capability);
+		}
+		else {
+			glDisable(capability);
+		}
+
+		if (index != CapabilityCount) {
+			_capabilities[index] = state;
+		}
+	}
+}
+
+void GLStateCache::forgetProgram(GLuint program) {
+	if (_program == program) {
+		_program = unknownName;
+	}
+}
+
+void GLStateCache::forgetVertexArray(GLuint vertexArray) {
+	if (_vertexArray == vertexArray) {
+		_vertexArray = 0;
+	}
+}
+
+void GLStateCache::forgetFramebuffer(GLuint framebuffer) {
+	if (_framebuffer == framebuffer) {
+		_framebuffer = 0;
+	}
+}
+
+void GLStateCache::forgetTexture(GLuint texture) {
+	for (int unit = 0; unit < maxTextureUnits; ++unit) {
+		for (int target = 0; target < TextureTargetCount; ++target) {
+			if (_textures[unit][target] == texture) {
+				_textures[unit][target] = 0;
+			}
+		}
+	}
+}
+
+void GLStateCache::forgetSampler(GLuint sampler) {
+	for (int unit = 0; unit < maxTextureUnits; ++unit) {
+		if (_samplers[unit] == sampler) {
+			_samplers[unit] = 0;
+		}
+	}
+}
+
+void GLStateCache::invalidate() {
+	_program = unknownName;
+	_vertexArray = unknownName;
+	_framebuffer = unknownName;
+	_activeTexture = unknownEnum;
+	for (int unit = 0; unit < maxTextureUnits; ++unit) {
+		for (int target = 0; target < TextureTargetCount; ++target) {
+			_textures[unit][target] = unknownName;
+		}
+		_samplers[unit] = unknownName;
+	}
+	_cullFace = unknownEnum;
+	_colorMask = -1;
+	_pointSize = -1.0f;
+	for (int capability = 0; capability < CapabilityCount; ++capability) {
+		_capabilities[capability] = -1;
+	}
+}
+
+void GLStateCache::endFrame() {
+	_lastIssuedCalls = _issuedCalls;
+	_lastAvoidedCalls = _avoidedCalls;
+	_issuedCalls = 0;
+	_avoidedCalls = 0;
+}
+
+size_t GLStateCache::getIssuedCalls() const {
+	return _lastIssuedCalls;
+}
+
+size_t GLStateCache::getAvoidedCalls() const {
+	return _lastAvoidedCalls;
+}
+
+bool GLStateCache::changes(bool changed) {
+	if (changed) {
+		++_issuedCalls;
+	}
+	else {
+		++_avoidedCalls;
+	}
+
+	return changed;
+}
+
+void GLStateCache::setActiveTexture(int unit) {
+	const GLenum activeTexture = GL_TEXTURE0 + unit;
+	if (changes(_activeTexture != activeTexture)) {
+		glActiveTexture(activeTexture);
+		_activeTexture = activeTexture;
+	}
+}
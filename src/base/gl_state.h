@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// the gl state last set through it, so binds and state changes that would
+// not change anything are skipped. the tracked state must only be changed
+// through the cache of the gl thread, and deleted objects must be forgotten
+// since gl unbinds them and hands their names out again
+class GLStateCache {
+public:
+	static constexpr int maxTextureUnits = 32;
+
+	static GLStateCache& get();
+
+	GLStateCache(const GLStateCache&) = delete;
+
+	void useProgram(GLuint program);
+
+	void bindVertexArray(GLuint vertexArray);
+
+	// both the draw and the read framebuffer
+	void bindFramebuffer(GLuint framebuffer);
+
+	// bind to the active texture unit
+	void bindTexture(GLenum target, GLuint texture);
+
+	// make the unit active and bind to it
+	void bindTexture(int unit, GLenum target, GLuint texture);
+
+	void bindSampler(GLuint unit, GLuint sampler);
+
+	void setCullFace(GLenum face);
+
+	void setColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+
+	void setPointSize(float size);
+
+	// glEnable / glDisable of GL_DEPTH_TEST, GL_CULL_FACE or GL_BLEND, other
+	// capabilities are set without tracking
+	void setEnabled(GLenum capability, bool enabled);
+
+	void forgetProgram(GLuint program);
+
+	void forgetVertexArray(GLuint vertexArray);
+
+	void forgetFramebuffer(GLuint framebuffer);
+
+	void forgetTexture(GLuint texture);
+
+	void forgetSampler(GLuint sampler);
+
+	// forget everything, after gl calls made around the cache
+	void invalidate();
+
+	// the counts of the frame become those of the last frame
+	void endFrame();
+
+	// gl calls the cache made and skipped in the last frame
+	size_t getIssuedCalls() const;
+
+	size_t getAvoidedCalls() const;
+
+private:
+	// none of them is a valid name or value
+	static constexpr GLuint unknownName = ~GLuint(0);
+	static constexpr GLenum unknownEnum = 0;
+
+	// the texture targets tracked per unit
+	enum TextureTarget {
+		Texture2D, Texture2DArray, TextureCubeMap, TextureBuffer, TextureTargetCount
+	};
+
+	enum Capability {
+		DepthTest, CullFace, Blend, CapabilityCount
+	};
+
+	GLuint _program = unknownName;
+	GLuint _vertexArray = unknownName;
+	GLuint _framebuffer = unknownName;
+	GLenum _activeTexture = unknownEnum;
+	GLuint _textures[maxTextureUnits][TextureTargetCount];
+	GLuint _samplers[maxTextureUnits];
+	GLenum _cullFace = unknownEnum;
+	// 4 bits, -1 unknown
+	int _colorMask = -1;
+	// < 0 unknown
+	float _pointSize = -1.0f;
+	// 0 disabled, 1 enabled, -1 unknown
+	int _capabilities[CapabilityCount];
+
+	size_t _issuedCalls = 0;
+	size_t _avoidedCalls = 0;
+	size_t _lastIssuedCalls = 0;
+	size_t _lastAvoidedCalls = 0;
+
+	GLStateCache();
+
+	// count the call, true if it has to be made
+	bool changes(bool changed);
+
+	void setActiveTexture(int unit);
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -5,6 +6,7 @@
 
 #include <glm/ext.hpp>
 
+#include "gl_state.h"
 #include "glsl_program.h"
 
 GLSLProgram::GLSLProgram() {
@@ -18,7 +20,8 @@ GLSLProgram::GLSLProgram(GLSLProgram&& rhs) noexcept
     : _handle(rhs._handle),
       _vertexShaders(std::move(rhs._vertexShaders)),
       _geometryShaders(std::move(rhs._geometryShaders)),
-      _fragmentShaders(std::move(rhs._fragmentShaders)) {
+      _fragmentShaders(std::move(rhs._fragmentShaders)),
+      _uniformLocations(std::move(rhs._uniformLocations)) {
     rhs._handle = 0;
     rhs._vertexShaders.clear();
     rhs._geometryShaders.clear();
@@ -39,6 +42,7 @@ GLSLProgram::~GLSLProgram() {
     }
 
     if (_handle) {
+        GLStateCache::get().forgetProgram(_handle);
         glDeleteProgram(_handle);
         _handle = 0;
     }
@@ -93,10 +97,12 @@ void GLSLProgram::link() {
         glGetProgramInfoLog(_handle, sizeof(buffer), NULL, buffer);
         throw std::runtime_error("link program error: " + std::string(buffer));
     }
+
+    reflectUniforms();
 }
 
 void GLSLProgram::use() {
-    glUseProgram(_handle);
+    GLStateCache::get().useProgram(_handle);
 }
 
 int GLSLProgram::getUniformBlockSize(const std::string& name) const {
@@ -134,94 +140,94 @@ int GLSLProgram::getUniformBlockVariableOffset(const std::string& name) const {
     return offset;
 }
 
-void GLSLProgram::setUniformBool(const std::string& name, bool value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
+GLSLProgram::Uniform GLSLProgram::getUniform(const std::string& name) const {
+    Uniform uniform;
+    const auto iter = _uniformLocations.find(name);
+    if (iter != _uniformLocations.end()) {
+        uniform.location = iter->second;
     }
 
-    glUniform1i(location, static_cast<int>(value));
+    return uniform;
+}
+
+void GLSLProgram::setUniformBool(const std::string& name, bool value) const {
+    setUniformBool(findUniform(name), value);
+}
+
+void GLSLProgram::setUniformBool(Uniform uniform, bool value) const {
+    glUniform1i(uniform.location, static_cast<int>(value));
 }
 
 void GLSLProgram::setUniformInt(const std::string& name, int value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformInt(findUniform(name), value);
+}
 
-    glUniform1i(location, value);
+void GLSLProgram::setUniformInt(Uniform uniform, int value) const {
+    glUniform1i(uniform.location, value);
 }
 
 void GLSLProgram::setUniformUint(const std::string& name, uint32_t value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformUint(findUniform(name), value);
+}
 
-    glUniform1ui(location, value);
+void GLSLProgram::setUniformUint(Uniform uniform, uint32_t value) const {
+    glUniform1ui(uniform.location, value);
 }
 
 void GLSLProgram::setUniformFloat(const std::string& name, float value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformFloat(findUniform(name), value);
+}
 
-    glUniform1f(location, value);
+void GLSLProgram::setUniformFloat(Uniform uniform, float value) const {
+    glUniform1f(uniform.location, value);
 }
 
 void GLSLProgram::setUniformVec2(const std::string& name, const glm::vec2& v2) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformVec2(findUniform(name), v2);
+}
 
-    glUniform2fv(location, 1, glm::value_ptr(v2));
+void GLSLProgram::setUniformVec2(Uniform uniform, const glm::vec2& v2) const {
+    glUniform2fv(uniform.location, 1, glm::value_ptr(v2));
 }
 
 void GLSLProgram::setUniformVec3(const std::string& name, const glm::vec3& v3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformVec3(findUniform(name), v3);
+}
 
-    glUniform3fv(location, 1, glm::value_ptr(v3));
+void GLSLProgram::setUniformVec3(Uniform uniform, const glm::vec3& v3) const {
+    glUniform3fv(uniform.location, 1, glm::value_ptr(v3));
 }
 
 void GLSLProgram::setUniformVec4(const std::string& name, const glm::vec4& v4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformVec4(findUniform(name), v4);
+}
 
-    glUniform4fv(location, 1, glm::value_ptr(v4));
+void GLSLProgram::setUniformVec4(Uniform uniform, const glm::vec4& v4) const {
+    glUniform4fv(uniform.location, 1, glm::value_ptr(v4));
 }
 
 void GLSLProgram::setUniformMat2(const std::string& name, const glm::mat2& mat2) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformMat2(findUniform(name), mat2);
+}
 
-    glUniform3fv(location, 1, glm::value_ptr(mat2));
+void GLSLProgram::setUniformMat2(Uniform uniform, const glm::mat2& mat2) const {
+    glUniformMatrix2fv(uniform.location, 1, GL_FALSE, glm::value_ptr(mat2));
 }
 
 void GLSLProgram::setUniformMat3(const std::string& name, const glm::mat3& mat3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformMat3(findUniform(name), mat3);
+}
 
-    glUniform3fv(location, 1, glm::value_ptr(mat3));
+void GLSLProgram::setUniformMat3(Uniform uniform, const glm::mat3& mat3) const {
+    glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(mat3));
 }
 
 void GLSLProgram::setUniformMat4(const std::string& name, const glm::mat4& mat4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    setUniformMat4(findUniform(name), mat4);
+}
 
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat4));
+void GLSLProgram::setUniformMat4(Uniform uniform, const glm::mat4& mat4) const {
+    glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(mat4));
 }
 
 void GLSLProgram::setUniformBlockBinding(const std::string& name, uint32_t binding) const {
@@ -233,6 +239,60 @@ void GLSLProgram::setUniformBlockBinding(const std::string& name, uint32_t bindi
     glUniformBlockBinding(_handle, blockIndex, binding);
 }
 
+void GLSLProgram::reflectUniforms() {
+    _uniformLocations.clear();
+
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> buffer(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(_handle, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()),
+            &length, &size, &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        // members of uniform blocks have no location
+        const GLint location = glGetUniformLocation(_handle, name.c_str());
+        if (location == -1) {
+            continue;
+        }
+
+        // an array is reported as its first element, register the bare
+        // name and every element, their locations need not be contiguous
+        const size_t bracket = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0 ?
+            name.size() - 3 : std::string::npos;
+        if (bracket == std::string::npos) {
+            _uniformLocations[name] = location;
+            continue;
+        }
+
+        const std::string base = name.substr(0, bracket);
+        _uniformLocations[base] = location;
+        _uniformLocations[name] = location;
+        for (GLint element = 1; element < size; ++element) {
+            const std::string elementName = base + "[" + std::to_string(element) + "]";
+            const GLint elementLocation = glGetUniformLocation(_handle, elementName.c_str());
+            if (elementLocation != -1) {
+                _uniformLocations[elementName] = elementLocation;
+            }
+        }
+    }
+}
+
+GLSLProgram::Uniform GLSLProgram::findUniform(const std::string& name) const {
+    const Uniform uniform = getUniform(name);
+    if (!uniform.isActive()) {
+        std::cerr << "find uniform " + name + " location failure" << std::endl;
+    }
+
+    return uniform;
+}
+
 std::string GLSLProgram::readFile(const std::string& filePath) {
     std::ifstream is;
     is.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <glad/glad.h>
@@ -8,6 +9,14 @@
 
 class GLSLProgram {
 public:
+    // an active uniform resolved at link(), setting it costs no lookup at all.
+    // location is -1 for a name the program does not use, which gl ignores
+    struct Uniform {
+        GLint location = -1;
+
+        bool isActive() const { return location != -1; }
+    };
+
     GLSLProgram();
 
     GLSLProgram(GLSLProgram&& rhs) noexcept;
@@ -39,26 +48,50 @@ public:
 
     int getUniformBlockVariableOffset(const std::string& name) const;
 
+    // the uniform of the given name from the table link() fills, for the
+    // handles resolved once; setting by name does this lookup every call
+    Uniform getUniform(const std::string& name) const;
+
     void setUniformBool(const std::string& name, bool value) const;
 
+    void setUniformBool(Uniform uniform, bool value) const;
+
     void setUniformInt(const std::string& name, int value) const;
 
+    void setUniformInt(Uniform uniform, int value) const;
+
     void setUniformUint(const std::string& name, uint32_t value) const;
 
+    void setUniformUint(Uniform uniform, uint32_t value) const;
+
     void setUniformFloat(const std::string& name, float value) const;
 
+    void setUniformFloat(Uniform uniform, float value) const;
+
     void setUniformVec2(const std::string& name, const glm::vec2& v2) const;
 
+    void setUniformVec2(Uniform uniform, const glm::vec2& v2) const;
+
     void setUniformVec3(const std::string& name, const glm::vec3& v3) const;
 
+    void setUniformVec3(Uniform uniform, const glm::vec3& v3) const;
+
     void setUniformVec4(const std::string& name, const glm::vec4& v4) const;
 
+    void setUniformVec4(Uniform uniform, const glm::vec4& v4) const;
+
     void setUniformMat2(const std::string& name, const glm::mat2& mat2) const;
 
+    void setUniformMat2(Uniform uniform, const glm::mat2& mat2) const;
+
     void setUniformMat3(const std::string& name, const glm::mat3& mat3) const;
 
+    void setUniformMat3(Uniform uniform, const glm::mat3& mat3) const;
+
     void setUniformMat4(const std::string& name, const glm::mat4& mat4) const;
 
+    void setUniformMat4(Uniform uniform, const glm::mat4& mat4) const;
+
     void setUniformBlockBinding(const std::string& name, uint32_t binding) const;
 
 public:
@@ -70,6 +103,14 @@ public:
 
     std::vector<GLuint> _fragmentShaders;
 
+    // locations of the active uniforms by name, array elements included
+    std::unordered_map<std::string, GLint> _uniformLocations;
+
+    void reflectUniforms();
+
+    // getUniform() that reports names the program does not use
+    Uniform findUniform(const std::string& name) const;
+
     std::string readFile(const std::string& filePath);
 
     GLuint createShader(const std::string& code, GLenum shaderType);
@@ -0,0 +1,148 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filepath) {
+	open(filepath);
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+	: _data(rhs._data), _size(rhs._size), _opened(rhs._opened)
+#ifdef _WIN32
+	, _file(rhs._file), _mapping(rhs._mapping)
+#endif
+{
+	rhs._data = nullptr;
+	rhs._size = 0;
+	rhs._opened = false;
+#ifdef _WIN32
+	rhs._file = nullptr;
+	rhs._mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& filepath) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	_file = file;
+	_size = static_cast<size_t>(fileSize.QuadPart);
+	_opened = true;
+
+	// an empty file cannot be mapped, but it is still a valid (empty) view
+	if (_size == 0) {
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+	_mapping = mapping;
+
+	_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (_data == nullptr) {
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(filepath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	_size = static_cast<size_t>(st.st_size);
+	_opened = true;
+
+	// an empty file cannot be mapped, but it is still a valid (empty) view
+	if (_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		_size = 0;
+		_opened = false;
+		return false;
+	}
+
+	madvise(addr, _size, MADV_SEQUENTIAL);
+	_data = static_cast<const char*>(addr);
+#endif
+
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+	}
+
+	if (_mapping != nullptr) {
+		CloseHandle(static_cast<HANDLE>(_mapping));
+		_mapping = nullptr;
+	}
+
+	if (_file != nullptr) {
+		CloseHandle(static_cast<HANDLE>(_file));
+		_file = nullptr;
+	}
+#else
+	if (_data != nullptr) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+#endif
+
+	_data = nullptr;
+	_size = 0;
+	_opened = false;
+}
+
+bool MappedFile::isOpen() const {
+	return _opened;
+}
+
+const char* MappedFile::data() const {
+	return _data;
+}
+
+size_t MappedFile::size() const {
+	return _size;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// read-only view of a whole file mapped into the address space,
+// the bytes are shared with the page cache and never copied
+class MappedFile {
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::string& filepath);
+
+	MappedFile(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& rhs) noexcept;
+
+	~MappedFile();
+
+	bool open(const std::string& filepath);
+
+	void close();
+
+	bool isOpen() const;
+
+	const char* data() const;
+
+	size_t size() const;
+
+private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+	bool _opened = false;
+
+#ifdef _WIN32
+	void* _file = nullptr;
+	void* _mapping = nullptr;
+#endif
+};
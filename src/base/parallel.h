@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of worker threads to use, 0 means one per hardware thread
+inline unsigned getWorkerCount(unsigned requested = 0) {
+	if (requested != 0) {
+		return requested;
+	}
+
+	const unsigned count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : count;
+}
+
+// run task(i) for every i in [0, count) on up to `threads` threads,
+// indices are handed out one by one so tasks of uneven cost still balance.
+// the first exception thrown by a task is rethrown on the calling thread
+inline void parallelFor(size_t count, const std::function<void(size_t)>& task, unsigned threads = 0) {
+	const size_t workers = std::min<size_t>(getWorkerCount(threads), count);
+	if (workers <= 1) {
+		for (size_t i = 0; i < count; ++i) {
+			task(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next{ 0 };
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	auto run = [&]() {
+		try {
+			for (size_t i = next++; i < count; i = next++) {
+				task(i);
+			}
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error) {
+				error = std::current_exception();
+			}
+			next = count;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(workers - 1);
+	for (size_t i = 1; i < workers; ++i) {
+		pool.emplace_back(run);
+	}
+
+	run();
+
+	for (auto& thread : pool) {
+		thread.join();
+	}
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+// run task(begin, end) over contiguous slices of [0, count) of at least
+// `grain` items each, for loops whose body is too cheap to dispatch per index
+inline void parallelForRange(size_t count, size_t grain,
+	const std::function<void(size_t, size_t)>& task, unsigned threads = 0) {
+	grain = std::max<size_t>(grain, 1);
+	const size_t slices = std::min<size_t>((count + grain - 1) / grain, getWorkerCount(threads) * 4);
+	if (slices <= 1) {
+		if (count != 0) {
+			task(0, count);
+		}
+		return;
+	}
+
+	parallelFor(slices, [&](size_t slice) {
+		task(count * slice / slices, count * (slice + 1) / slices);
+	}, threads);
+}
+
+// std::sort split into one run per worker, then merged pairwise, every merge
+// level runs in parallel. needs a scratch buffer as large as the input
+template <typename T, typename Compare>
+void parallelSort(std::vector<T>& data, Compare less, unsigned threads = 0) {
+	const size_t minRun = 1 << 16;
+	const size_t runs = std::min<size_t>(getWorkerCount(threads), std::max<size_t>(data.size() / minRun, 1));
+	if (runs <= 1) {
+		std::sort(data.begin(), data.end(), less);
+		return;
+	}
+
+	std::vector<size_t> bounds(runs + 1);
+	for (size_t i = 0; i <= runs; ++i) {
+		bounds[i] = data.size() * i / runs;
+	}
+
+	parallelFor(runs, [&](size_t i) {
+		std::sort(data.begin() + bounds[i], data.begin() + bounds[i + 1], less);
+	}, threads);
+
+	std::vector<T> scratch(data.size());
+	std::vector<T>* src = &data;
+	std::vector<T>* dst = &scratch;
+	while (bounds.size() > 2) {
+		// run 2i absorbs run 2i + 1, an odd run out is copied through
+		const size_t last = bounds.size() - 1;
+		parallelFor((last + 1) / 2, [&](size_t i) {
+			const size_t begin = bounds[2 * i];
+			const size_t middle = bounds[2 * i + 1];
+			const size_t end = bounds[std::min(2 * i + 2, last)];
+			std::merge(src->begin() + begin, src->begin() + middle,
+				src->begin() + middle, src->begin() + end, dst->begin() + begin, less);
+		}, threads);
+
+		std::vector<size_t> merged;
+		for (size_t i = 0; i < last; i += 2) {
+			merged.push_back(bounds[i]);
+		}
+		merged.push_back(bounds[last]);
+		bounds.swap(merged);
+		std::swap(src, dst);
+	}
+
+	if (src != &data) {
+		data.swap(scratch);
+	}
+}
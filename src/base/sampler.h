@@ -2,6 +2,8 @@
 
 #include <glad/glad.h>
 
+#include "gl_state.h"
+
 class Sampler {
 public:
     Sampler() {
@@ -9,12 +11,13 @@ public:
     }
     
     Sampler(Sampler&& rhs) noexcept {
-        rhs._handle = _handle;
-        _handle = 0;
+        _handle = rhs._handle;
+        rhs._handle = 0;
     }
 
     ~Sampler() {
         if (_handle != 0) {
+            GLStateCache::get().forgetSampler(_handle);
             glDeleteSamplers(1, &_handle);
         }
     }
@@ -36,11 +39,11 @@ public:
     }
 
     void bind(GLuint texUnit) const {
-        glBindSampler(texUnit, _handle);
+        GLStateCache::get().bindSampler(texUnit, _handle);
     }
 
     void unbind(GLuint texUnit) const {
-        glBindSampler(texUnit, 0);
+        GLStateCache::get().bindSampler(texUnit, 0);
     }
 
 private:
@@ -1,4 +1,5 @@
 #include "skybox.h"
+#include "gl_state.h"
 
 SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
     GLfloat vertices[] = {
@@ -49,14 +50,14 @@ SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
     glGenVertexArrays(1, &_vao);
     glGenBuffers(1, &_vbo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 
     try {
         // init texture
@@ -124,11 +125,11 @@ void SkyBox::draw(const glm::mat4& projection, const glm::mat4& view) {
     _shader->use();
     _shader->setUniformMat4("view", glm::mat4(glm::mat3(view)));
     _shader->setUniformMat4("projection", projection);
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
     _texture->bind();
     _shader->setUniformInt("cubemap", 0);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
     glDepthFunc(GL_LESS); // set depth function back to default
 
     // -----------------------------------------------
@@ -141,6 +142,7 @@ void SkyBox::cleanup() {
     }
 
     if (_vao != 0) {
+        GLStateCache::get().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
@@ -1,5 +1,6 @@
 #include <cassert>
 
+#include "gl_state.h"
 #include "texture.h"
 
 Texture::Texture() {
@@ -14,6 +15,7 @@ Texture::Texture(Texture&& rhs) noexcept: _handle(rhs._handle) {
 Texture::~Texture() {
 	// destroy texture object
 	if (_handle != 0) {
+		GLStateCache::get().forgetTexture(_handle);
 		glDeleteTextures(1, &_handle);
 		_handle = 0;
 	}
@@ -35,6 +37,7 @@ void Texture::check() {
 
 void Texture::cleanup() {
 	if (_handle != 0) {
+		GLStateCache::get().forgetTexture(_handle);
 		glDeleteTextures(1, &_handle);
 		_handle = 0;
 	}
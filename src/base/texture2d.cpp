@@ -2,27 +2,27 @@
 #include <sstream>
 #include <stb_image.h>
 
+#include "gl_state.h"
 #include "texture2d.h"
 
 Texture2D::Texture2D(
 	GLenum internalFormat, int width, int height, GLenum format, GLenum dataType, void* data
 ) {
-	glBindTexture(GL_TEXTURE_2D, _handle);
+	GLStateCache::get().bindTexture(GL_TEXTURE_2D, _handle);
 	setDefaultParameters();
 	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, dataType, data);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D, 0);
 }
 
 Texture2D::Texture2D(Texture2D&& rhs) noexcept
 	: Texture(std::move(rhs)) { }
 
 void Texture2D::bind(int slot) const {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, _handle);
+	GLStateCache::get().bindTexture(slot, GL_TEXTURE_2D, _handle);
 }
 
 void Texture2D::unbind() const {
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLStateCache::get().bindTexture(GL_TEXTURE_2D, 0);
 }
 
 void Texture2D::generateMipmap() const {
@@ -68,7 +68,7 @@ ImageTexture2D::ImageTexture2D(const std::string& path): _uri(path) {
 		throw std::runtime_error("unsupported format");
 	}
 
-    glBindTexture(GL_TEXTURE_2D, _handle);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D, _handle);
 
 	// set texture parameters
 	setDefaultParameters();
@@ -76,7 +76,7 @@ ImageTexture2D::ImageTexture2D(const std::string& path): _uri(path) {
 	// transfer the image data to GPU
 	upload(data, width, height, channels, format, format, GL_UNSIGNED_BYTE);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D, 0);
 
 	// free data
 	stbi_image_free(data);
@@ -95,7 +95,7 @@ ImageTexture2D::ImageTexture2D(
 	GLenum type,
 	const std::string& uri)
     : _uri(uri) {
-	glBindTexture(GL_TEXTURE_2D, _handle);
+	GLStateCache::get().bindTexture(GL_TEXTURE_2D, _handle);
 
 	// set texture parameters
 	setDefaultParameters();
@@ -103,7 +103,7 @@ ImageTexture2D::ImageTexture2D(
 	// transfer the image data to GPU
 	upload(data, width, height, channels, internalformat, format, type);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLStateCache::get().bindTexture(GL_TEXTURE_2D, 0);
 
 	// check error
 	check();
@@ -156,23 +156,22 @@ void ImageTexture2D::upload(
 Texture2DArray::Texture2DArray(
     GLenum internalFormat, int width, int height, int layers, GLenum format, GLenum dataType
 ) {
-    glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D_ARRAY, _handle);
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, 
         width, height, layers, 0, format, dataType, nullptr);
     setDefaultParameters();
-    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
 Texture2DArray::Texture2DArray(Texture2DArray&& rhs) noexcept
     : Texture(std::move(rhs)) { }
 
 void Texture2DArray::bind(int slot) const {
-	glActiveTexture(GL_TEXTURE0 + slot);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	GLStateCache::get().bindTexture(slot, GL_TEXTURE_2D_ARRAY, _handle);
 }
 
 void Texture2DArray::unbind() const {
-    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    GLStateCache::get().bindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
 void Texture2DArray::generateMipmap() const {
@@ -0,0 +1,56 @@
+#include "gl_state.h"
+#include "texture_buffer.h"
+
+TextureBuffer::TextureBuffer(GLenum internalFormat, size_t size, const void* data, GLenum usage)
+	: _size(size) {
+	glGenBuffers(1, &_buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, _buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, data, usage);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GLStateCache::get().bindTexture(GL_TEXTURE_BUFFER, _handle);
+	glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, _buffer);
+	GLStateCache::get().bindTexture(GL_TEXTURE_BUFFER, 0);
+
+	check();
+}
+
+TextureBuffer::TextureBuffer(TextureBuffer&& rhs) noexcept
+	: Texture(std::move(rhs)), _buffer(rhs._buffer), _size(rhs._size) {
+	rhs._buffer = 0;
+	rhs._size = 0;
+}
+
+TextureBuffer::~TextureBuffer() {
+	if (_buffer != 0) {
+		glDeleteBuffers(1, &_buffer);
+		_buffer = 0;
+	}
+}
+
+void TextureBuffer::bind(int slot) const {
+	GLStateCache::get().bindTexture(slot, GL_TEXTURE_BUFFER, _handle);
+}
+
+void TextureBuffer::unbind() const {
+	GLStateCache::get().bindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void TextureBuffer::update(size_t offset, size_t size, const void* data) const {
+	glBindBuffer(GL_TEXTURE_BUFFER, _buffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, offset, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+size_t TextureBuffer::getSize() const {
+	return _size;
+}
+
+void TextureBuffer::cleanup() {
+	if (_buffer != 0) {
+		glDeleteBuffers(1, &_buffer);
+		_buffer = 0;
+	}
+
+	Texture::cleanup();
+}
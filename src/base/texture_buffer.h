@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+
+#include "texture.h"
+
+// a buffer object read by shaders through a samplerBuffer and texelFetch,
+// for tables too large for a uniform block
+class TextureBuffer : public Texture {
+public:
+	TextureBuffer(GLenum internalFormat, size_t size, const void* data = nullptr, GLenum usage = GL_STATIC_DRAW);
+
+	TextureBuffer(TextureBuffer&& rhs) noexcept;
+
+	~TextureBuffer();
+
+	void bind(int slot = 0) const override;
+
+	void unbind() const override;
+
+	// texture buffers have neither mipmaps nor sampling parameters
+	void generateMipmap() const override {}
+
+	void setParamterInt(GLenum, int) const override {}
+
+	// overwrite size bytes of the buffer at offset
+	void update(size_t offset, size_t size, const void* data) const;
+
+	size_t getSize() const;
+
+private:
+	GLuint _buffer = 0;
+	size_t _size = 0;
+
+	void cleanup() override;
+};
@@ -1,12 +1,13 @@
 #include <cassert>
 #include <stb_image.h>
 
+#include "gl_state.h"
 #include "texture_cubemap.h"
 
 TextureCubemap::TextureCubemap(
 	GLenum internalFormat, int width, int height, GLenum format, GLenum dataType
 ) {
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+	GLStateCache::get().bindTexture(GL_TEXTURE_CUBE_MAP, _handle);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -18,19 +19,18 @@ TextureCubemap::TextureCubemap(
 			0, internalFormat, width, height, 0, format, dataType, nullptr);
 	}
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLStateCache::get().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 TextureCubemap::TextureCubemap(TextureCubemap&& rhs) noexcept
 	: Texture(std::move(rhs)) { }
 
 void TextureCubemap::bind(int slot) const {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+	GLStateCache::get().bindTexture(slot, GL_TEXTURE_CUBE_MAP, _handle);
 }
 
 void TextureCubemap::unbind() const {
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLStateCache::get().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 void TextureCubemap::generateMipmap() const { 
@@ -52,7 +52,7 @@ ImageTextureCubemap::ImageTextureCubemap(const std::vector<std::string>& filepat
 	// -----------------------------------------------
 	// ...
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+	GLStateCache::get().bindTexture(GL_TEXTURE_CUBE_MAP, _handle);
 
 	int width, height, nrChannels;
 	for (unsigned int i = 0; i < filepaths.size(); i++)
@@ -77,7 +77,7 @@ ImageTextureCubemap::ImageTextureCubemap(const std::vector<std::string>& filepat
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLStateCache::get().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
 	// -----------------------------------------------
 }
@@ -1,10 +1,113 @@
 #pragma once
 
+#include <algorithm>
+#include <iostream>
 #include <map>
+#include <stdexcept>
 #include <string>
 
 #include <glad/glad.h>
 
+// the std140 offsets of the members of a uniform block, added in the order
+// they are declared in the shader
+class Std140Layout {
+public:
+	enum class Type {
+		Bool, Int, Uint, Float, Vec2, Vec3, Vec4, Mat3, Mat4
+	};
+
+	// append a member, count > 0 makes it an array, returns its offset
+	size_t add(const std::string& name, Type type, size_t count = 0) {
+		size_t alignment = 4, size = 4;
+		switch (type) {
+		case Type::Vec2: alignment = 8;  size = 8;  break;
+		case Type::Vec3: alignment = 16; size = 12; break;
+		case Type::Vec4: alignment = 16; size = 16; break;
+		// matrices are arrays of vec4 aligned columns
+		case Type::Mat3: alignment = 16; size = 48; break;
+		case Type::Mat4: alignment = 16; size = 64; break;
+		default: break;
+		}
+
+		// array elements are padded to a vec4, so are the columns of matrices,
+		// hence whatever follows an array, a matrix or a struct is vec4 aligned
+		if (count > 0) {
+			alignment = 16;
+			size = roundUp(size, 16);
+			return append(name, alignment, size, size * count);
+		}
+
+		return append(name, alignment, size, size);
+	}
+
+	// append a struct laid out by members, count > 0 makes it an array.
+	// the members of a single struct are also added as name.member
+	size_t add(const std::string& name, const Std140Layout& members, size_t count = 0) {
+		const size_t stride = members.getSize();
+		const size_t offset = append(name, 16, stride, count > 0 ? stride * count : stride);
+		if (count == 0) {
+			for (const auto& member : members._members) {
+				_members[name + "." + member.first] = { offset + member.second.offset, member.second.stride };
+			}
+		}
+
+		return offset;
+	}
+
+	size_t getOffset(const std::string& name) const {
+		return find(name).offset;
+	}
+
+	// the distance between the elements of an array member
+	size_t getStride(const std::string& name) const {
+		return find(name).stride;
+	}
+
+	// bytes of the block, padded to a vec4 as it is when used as a struct
+	size_t getSize() const {
+		return roundUp(_size, 16);
+	}
+
+	std::map<std::string, size_t> getOffsets() const {
+		std::map<std::string, size_t> offsets;
+		for (const auto& member : _members) {
+			offsets[member.first] = member.second.offset;
+		}
+
+		return offsets;
+	}
+
+private:
+	struct member_t {
+		size_t offset;
+		size_t stride;
+	};
+
+	std::map<std::string, member_t> _members;
+	size_t _size = 0;
+
+	static size_t roundUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	size_t append(const std::string& name, size_t alignment, size_t stride, size_t size) {
+		const size_t offset = roundUp(_size, alignment);
+		_members[name] = { offset, stride };
+		_size = offset + size;
+
+		return offset;
+	}
+
+	const member_t& find(const std::string& name) const {
+		const auto iter = _members.find(name);
+		if (iter == _members.end()) {
+			throw std::runtime_error("cannot find " + name + " in the std140 layout");
+		}
+
+		return iter->second;
+	}
+};
+
 class UniformBuffer {
 public:
 	UniformBuffer(size_t bufferSize, GLenum usage) {
@@ -14,6 +117,12 @@ public:
 		glBindBuffer(GL_UNIFORM_BUFFER, 0);
 	}
 
+	// a buffer sized to the layout, its members can be updated by name
+	UniformBuffer(const Std140Layout& layout, GLenum usage)
+		: UniformBuffer(layout.getSize(), usage) {
+		_offsetMap = layout.getOffsets();
+	}
+
 	UniformBuffer(UniformBuffer&& rhs) noexcept
 		: _handle(rhs._handle), _offsetMap(std::move(rhs._offsetMap)) {
 		rhs._handle = 0;
@@ -34,6 +143,13 @@ public:
 		_offsetMap[name] = offset;
 	}
 
+	// overwrite size bytes at offset, for filling the whole block at once
+	void setData(const void* data, size_t size, size_t offset = 0) const {
+		glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
 	template <typename T>
 	void update(const std::string& name, const T& value) const {
 		const auto iter = _offsetMap.find(name);
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
 #include <glm/glm.hpp>
 
 struct Vertex {
@@ -16,16 +20,34 @@ struct Vertex {
 	}
 };
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp>
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must stay tightly packed");
+
+// 64-bit hash of the attribute bits, every word goes through a full multiply
+// so vertices that differ in a single component land far apart. -0.0 is
+// folded into +0.0 to agree with operator==
+inline uint64_t hashVertex(const Vertex& vertex) {
+	const float* values = &vertex.position.x;
+	uint64_t h = 0x9e3779b97f4a7c15ull;
+	for (int i = 0; i < 8; ++i) {
+		uint32_t bits = 0;
+		if (values[i] != 0.0f) {
+			memcpy(&bits, &values[i], sizeof(bits));
+		}
+		h = (h ^ bits) * 0xff51afd7ed558ccdull;
+		h ^= h >> 32;
+	}
+
+	h ^= h >> 29;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 32;
+	return h;
+}
 
 namespace std {
 	template<>
 	struct hash<Vertex> {
 		size_t operator()(const Vertex& vertex) const {
-			return ((hash<glm::vec3>()(vertex.position) ^
-				(hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texCoord) << 1);
+			return static_cast<size_t>(hashVertex(vertex));
 		}
 	};
-}
\ No newline at end of file
+}
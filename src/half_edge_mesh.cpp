@@ -0,0 +1,231 @@
+#include "half_edge_mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include "model.h"
+#include "./base/parallel.h"
+
+namespace {
+// an undirected edge as (smaller vertex, larger vertex), and the half-edge it came from
+struct edge_key_t {
+	uint64_t edge;
+	uint32_t halfEdge;
+};
+
+// the position bits of a model vertex, -0.0 folded into +0.0 so that equal
+// positions compare equal
+struct position_key_t {
+	uint32_t bits[3];
+	uint32_t vertex;
+};
+
+bool isSamePosition(const position_key_t& lhs, const position_key_t& rhs) {
+	return lhs.bits[0] == rhs.bits[0] && lhs.bits[1] == rhs.bits[1] && lhs.bits[2] == rhs.bits[2];
+}
+}
+
+constexpr uint32_t HalfEdgeMesh::noHalfEdge;
+
+void HalfEdgeMesh::numberPositions(const Model& model, unsigned threads) {
+	const size_t count = model.getVertexCount();
+	const size_t grain = 1 << 16;
+
+	// equal positions end up in one run that starts with their first vertex
+	std::vector<position_key_t> keys(count);
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			const glm::vec3& position = model.getPosition(v);
+			for (int axis = 0; axis < 3; ++axis) {
+				keys[v].bits[axis] = 0;
+				if (position[axis] != 0.0f) {
+					memcpy(&keys[v].bits[axis], &position[axis], sizeof(uint32_t));
+				}
+			}
+			keys[v].vertex = static_cast<uint32_t>(v);
+		}
+	}, threads);
+
+	parallelSort(keys, [](const position_key_t& lhs, const position_key_t& rhs) {
+		for (int axis = 0; axis < 3; ++axis) {
+			if (lhs.bits[axis] != rhs.bits[axis]) {
+				return lhs.bits[axis] < rhs.bits[axis];
+			}
+		}
+		return lhs.vertex < rhs.vertex;
+	}, threads);
+
+	// leaders[v] is the first vertex at the position of vertex v
+	std::vector<uint32_t> leaders(count);
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		size_t head = begin;
+		while (head > 0 && isSamePosition(keys[head - 1], keys[head])) {
+			--head;
+		}
+
+		for (size_t i = begin; i < end; ++i) {
+			if (i != head && !isSamePosition(keys[i - 1], keys[i])) {
+				head = i;
+			}
+			leaders[keys[i].vertex] = keys[head].vertex;
+		}
+	}, threads);
+
+	keys.clear();
+	keys.shrink_to_fit();
+
+	// number the leaders in vertex order with a two pass prefix sum
+	const size_t slices = std::max<size_t>(std::min<size_t>((count + grain - 1) / grain,
+		getWorkerCount(threads) * 4), 1);
+	std::vector<size_t> sliceStarts(slices + 1, 0);
+	parallelFor(slices, [&](size_t slice) {
+		size_t leaderCount = 0;
+		for (size_t v = count * slice / slices; v < count * (slice + 1) / slices; ++v) {
+			leaderCount += leaders[v] == v;
+		}
+		sliceStarts[slice + 1] = leaderCount;
+	}, threads);
+	for (size_t slice = 0; slice < slices; ++slice) {
+		sliceStarts[slice + 1] += sliceStarts[slice];
+	}
+
+	_positionIds.resize(count);
+	parallelFor(slices, [&](size_t slice) {
+		uint32_t next = static_cast<uint32_t>(sliceStarts[slice]);
+		for (size_t v = count * slice / slices; v < count * (slice + 1) / slices; ++v) {
+			if (leaders[v] == v) {
+				_positionIds[v] = next++;
+			}
+		}
+	}, threads);
+
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			if (leaders[v] != v) {
+				_positionIds[v] = _positionIds[leaders[v]];
+			}
+		}
+	}, threads);
+
+	_vertexHalfEdges.assign(sliceStarts[slices], noHalfEdge);
+}
+
+HalfEdgeMesh::HalfEdgeMesh(const Model& model, unsigned threads) {
+	const auto& submeshes = model.getSubmeshes();
+	const auto& indices = model.getIndices();
+
+	std::vector<size_t> firstHalfEdges(submeshes.size() + 1, 0);
+	for (size_t i = 0; i < submeshes.size(); ++i) {
+		firstHalfEdges[i + 1] = firstHalfEdges[i] + submeshes[i].indexCount / 3 * 3;
+	}
+	const size_t halfEdgeCount = firstHalfEdges.back();
+	if (halfEdgeCount == 0) {
+		return;
+	}
+	if (indices.empty()) {
+		throw std::runtime_error("HalfEdgeMesh: the model was loaded with CpuRetention::None");
+	}
+	if (halfEdgeCount >= noHalfEdge) {
+		throw std::runtime_error("HalfEdgeMesh: too many triangles for 32-bit half-edge ids");
+	}
+
+	numberPositions(model, threads);
+
+	_corners.resize(halfEdgeCount);
+	parallelFor(submeshes.size(), [&](size_t i) {
+		const Model::Submesh& submesh = submeshes[i];
+		const size_t count = firstHalfEdges[i + 1] - firstHalfEdges[i];
+		for (size_t c = 0; c < count; ++c) {
+			_corners[firstHalfEdges[i] + c] = submesh.baseVertex + indices[submesh.firstIndex + c];
+		}
+	}, threads);
+
+	// the two half-edges of a manifold edge end up next to each other once
+	// the keys are sorted, no hash table involved
+	const size_t grain = 1 << 16;
+	std::vector<edge_key_t> keys(halfEdgeCount);
+	parallelForRange(halfEdgeCount, grain, [&](size_t begin, size_t end) {
+		for (size_t h = begin; h < end; ++h) {
+			const uint64_t origin = getOrigin(static_cast<uint32_t>(h));
+			const uint64_t target = getTarget(static_cast<uint32_t>(h));
+			keys[h].edge = origin < target ? (origin << 32 | target) : (target << 32 | origin);
+			keys[h].halfEdge = static_cast<uint32_t>(h);
+		}
+	}, threads);
+
+	parallelSort(keys, [](const edge_key_t& lhs, const edge_key_t& rhs) {
+		return lhs.edge != rhs.edge ? lhs.edge < rhs.edge : lhs.halfEdge < rhs.halfEdge;
+	}, threads);
+
+	// every slice pairs the runs of equal edges that start in it. the two
+	// half-edges of an edge a degenerate face collapsed onto one position
+	// have the same origin and are never paired
+	_twins.assign(halfEdgeCount, noHalfEdge);
+	const size_t slices = std::max<size_t>(std::min<size_t>((halfEdgeCount + grain - 1) / grain,
+		getWorkerCount(threads) * 4), 1);
+	std::vector<size_t> sliceNonManifold(slices, 0);
+	parallelFor(slices, [&](size_t slice) {
+		const size_t end = halfEdgeCount * (slice + 1) / slices;
+		size_t run = halfEdgeCount * slice / slices;
+		while (run > 0 && run < end && keys[run - 1].edge == keys[run].edge) {
+			++run;
+		}
+
+		while (run < end) {
+			size_t runEnd = run + 1;
+			while (runEnd < halfEdgeCount && keys[runEnd].edge == keys[run].edge) {
+				++runEnd;
+			}
+
+			const uint32_t first = keys[run].halfEdge;
+			const uint32_t second = keys[run + 1 < runEnd ? run + 1 : run].halfEdge;
+			if (runEnd - run > 2) {
+				++sliceNonManifold[slice];
+			}
+			else if (runEnd - run == 2 && getOrigin(first) != getOrigin(second)) {
+				_twins[first] = second;
+				_twins[second] = first;
+			}
+			run = runEnd;
+		}
+	}, threads);
+
+	keys.clear();
+	keys.shrink_to_fit();
+
+	for (size_t count : sliceNonManifold) {
+		_nonManifoldEdges += count;
+	}
+	_boundaryHalfEdges = static_cast<size_t>(std::count(_twins.begin(), _twins.end(), noHalfEdge));
+
+	// the faces of a position may lie in any submesh, so every vertex takes
+	// the smallest of its outgoing half-edges through an atomic minimum,
+	// with the boundary ones ranked first
+	std::vector<std::atomic<uint64_t>> best(_vertexHalfEdges.size());
+	parallelForRange(best.size(), grain, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			best[v].store(~uint64_t(0), std::memory_order_relaxed);
+		}
+	}, threads);
+	parallelForRange(halfEdgeCount, grain, [&](size_t begin, size_t end) {
+		for (size_t h = begin; h < end; ++h) {
+			const uint64_t rank = static_cast<uint64_t>(isBoundary(static_cast<uint32_t>(h)) ? 0 : 1) << 32 | h;
+			std::atomic<uint64_t>& vertexBest = best[getOrigin(static_cast<uint32_t>(h))];
+			uint64_t current = vertexBest.load(std::memory_order_relaxed);
+			while (rank < current && !vertexBest.compare_exchange_weak(current, rank, std::memory_order_relaxed)) {
+			}
+		}
+	}, threads);
+	parallelForRange(best.size(), grain, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			const uint64_t rank = best[v].load(std::memory_order_relaxed);
+			_vertexHalfEdges[v] = rank == ~uint64_t(0) ? noHalfEdge : static_cast<uint32_t>(rank);
+		}
+	}, threads);
+}
+
+size_t HalfEdgeMesh::getMemoryUsage() const {
+	return (_corners.size() + _twins.size() + _positionIds.size() + _vertexHalfEdges.size()) * sizeof(uint32_t);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Model;
+
+// index based half-edge adjacency over the base triangles of a Model (lod
+// ranges excluded). face f is the f-th base triangle with the submeshes in
+// order. the vertices are the distinct positions of the model, so faces are
+// connected across normal and texture seams and across submeshes; the model
+// vertex of every corner is kept for its attributes. half-edge h is corner
+// h % 3 of face h / 3 and runs from that corner to the next one, so next,
+// prev and face are arithmetic and only the corners and twins are stored.
+// an edge shared by more than two faces, or by two faces that run along it
+// in the same direction, is left as a boundary on every side.
+//
+// memory per triangle: 12 bytes of corners and 12 of twins, plus 4 bytes per
+// model vertex and 4 per position, about 28 bytes on a closed mesh without
+// seams. the build needs another 96 bytes per triangle for the sorted edge
+// keys and the merge buffer of the sort, 36 per model vertex to number the
+// positions and 8 per position to pick their outgoing half-edges. the model
+// may be destroyed after the build
+class HalfEdgeMesh {
+public:
+	static constexpr uint32_t noHalfEdge = 0xffffffffu;
+
+	explicit HalfEdgeMesh(const Model& model, unsigned threads = 0);
+
+	size_t getFaceCount() const { return _corners.size() / 3; }
+
+	size_t getHalfEdgeCount() const { return _corners.size(); }
+
+	// distinct positions
+	size_t getVertexCount() const { return _vertexHalfEdges.size(); }
+
+	// the vertex at the position of a model vertex, baseVertex included
+	uint32_t getVertex(uint32_t modelVertex) const { return _positionIds[modelVertex]; }
+
+	static uint32_t getFace(uint32_t halfEdge) { return halfEdge / 3; }
+
+	static uint32_t getNext(uint32_t halfEdge) { return halfEdge % 3 == 2 ? halfEdge - 2 : halfEdge + 1; }
+
+	static uint32_t getPrev(uint32_t halfEdge) { return halfEdge % 3 == 0 ? halfEdge + 2 : halfEdge - 1; }
+
+	// the opposite half-edge of the neighbouring face, noHalfEdge on a boundary
+	uint32_t getTwin(uint32_t halfEdge) const { return _twins[halfEdge]; }
+
+	uint32_t getOrigin(uint32_t halfEdge) const { return _positionIds[_corners[halfEdge]]; }
+
+	uint32_t getTarget(uint32_t halfEdge) const { return getOrigin(getNext(halfEdge)); }
+
+	// the model vertex the half-edge starts at, baseVertex included, for the
+	// normal and texture coordinates of its face
+	uint32_t getCorner(uint32_t halfEdge) const { return _corners[halfEdge]; }
+
+	bool isBoundary(uint32_t halfEdge) const { return _twins[halfEdge] == noHalfEdge; }
+
+	// an outgoing half-edge of the vertex, the one without a twin if the
+	// vertex is on a boundary. noHalfEdge for a vertex without faces
+	uint32_t getVertexHalfEdge(uint32_t vertex) const { return _vertexHalfEdges[vertex]; }
+
+	bool isBoundaryVertex(uint32_t vertex) const {
+		const uint32_t halfEdge = _vertexHalfEdges[vertex];
+		return halfEdge != noHalfEdge && isBoundary(halfEdge);
+	}
+
+	// visit(h) for the outgoing half-edges of a vertex in order around it,
+	// each step is O(1). only the fan of getVertexHalfEdge is walked at a
+	// vertex where several fans meet
+	template <typename Visit>
+	void forEachOutgoing(uint32_t vertex, Visit visit) const {
+		const uint32_t first = _vertexHalfEdges[vertex];
+		uint32_t halfEdge = first;
+		while (halfEdge != noHalfEdge) {
+			visit(halfEdge);
+			halfEdge = _twins[getPrev(halfEdge)];
+			if (halfEdge == first) {
+				break;
+			}
+		}
+	}
+
+	// visit(v) for the one-ring neighbours of a vertex, in order around it
+	template <typename Visit>
+	void forEachNeighbour(uint32_t vertex, Visit visit) const {
+		uint32_t last = noHalfEdge;
+		forEachOutgoing(vertex, [&](uint32_t halfEdge) {
+			visit(getTarget(halfEdge));
+			last = halfEdge;
+		});
+		// an open fan ends in an incoming edge whose origin is not a target
+		if (last != noHalfEdge && isBoundary(getPrev(last))) {
+			visit(getOrigin(getPrev(last)));
+		}
+	}
+
+	// half-edges without a twin
+	size_t getBoundaryHalfEdgeCount() const { return _boundaryHalfEdges; }
+
+	// edges shared by more than two faces
+	size_t getNonManifoldEdgeCount() const { return _nonManifoldEdges; }
+
+	size_t getMemoryUsage() const;
+
+private:
+	std::vector<uint32_t> _corners;
+	std::vector<uint32_t> _twins;
+	// per model vertex
+	std::vector<uint32_t> _positionIds;
+	// per position
+	std::vector<uint32_t> _vertexHalfEdges;
+
+	// number the distinct positions of the model vertices in the order they
+	// first appear, by sorting the vertices on their position bits
+	void numberPositions(const Model& model, unsigned threads);
+
+	size_t _boundaryHalfEdges = 0;
+	size_t _nonManifoldEdges = 0;
+};
@@ -1,6 +1,9 @@
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 #include "LOFT.h"
+#include "mesh_octree.h"
 
 Options getOptions(int argc, char* argv[]) {
 	Options options;
@@ -49,11 +52,29 @@ static void printMenu() {
 }
 
 int main(int argc, char* argv[]) {
+	// preprocess: cut an obj into a mesh octree, no window or gl context
+	if (argc > 1 && std::string(argv[1]) == "--build-octree") {
+		if (argc != 4) {
+			std::cerr << "usage: " << argv[0] << " --build-octree <obj> <octree>" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::string err;
+		if (!MeshOctree::build(argv[2], argv[3], MeshOctreeOptions(), &err)) {
+			std::cerr << err << std::endl;
+			return EXIT_FAILURE;
+		}
+		return 0;
+	}
+
+	// --octree pages the loft in from its octree instead of loading it whole
+	const bool pageLoft = argc > 1 && std::string(argv[1]) == "--octree";
+
 	printMenu();
 	Options options = getOptions(argc, argv);
 
 	try {
-		LOFT app(options);
+		LOFT app(options, pageLoft);
 		app.run();
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
@@ -0,0 +1,486 @@
+#include "mesh_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "model.h"
+#include "./base/bounding_box.h"
+#include "./base/parallel.h"
+
+namespace {
+struct codec_header_t {
+	char magic[4];
+	uint32_t version;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t chunkCount;
+	uint32_t reserved;
+};
+
+// a chunk decodes to elements [first, first + count) of its buffer. its
+// payload is at offset past the chunk table, packedSize bytes that inflate
+// to rawSize bytes, or are stored as they are when the two are equal
+struct codec_chunk_t {
+	uint32_t type;
+	uint32_t count;
+	uint64_t first;
+	uint64_t offset;
+	uint64_t rawSize;
+	uint64_t packedSize;
+};
+
+const char codecMagic[4] = { 'L', 'M', 'C', 'Z' };
+
+constexpr uint32_t codecVersion = 1;
+
+enum : uint32_t {
+	vertexChunk = 0,
+	indexChunk = 1
+};
+
+// 2 MB of vertices and 1 MB of indices once decoded
+constexpr size_t verticesPerChunk = 1 << 16;
+constexpr size_t indicesPerChunk = 3 << 16;
+
+// position xyz, octahedral normal xy and texture coordinate uv
+constexpr size_t vertexComponents = 7;
+
+// lz77 with the sequence layout of lz4: a token holding the literal count
+// and the match length, the literals, a 16-bit offset back into the output
+// and the remainders of both lengths as runs of 255. the last sequence has
+// no match
+constexpr size_t minMatch = 4;
+constexpr unsigned hashBits = 14;
+constexpr size_t maxOffset = 0xffff;
+
+// no input byte of the lz77 stage decodes to more output bytes than this,
+// and an index takes 1 to 5 variable length bytes. both bound what the
+// sizes of a corrupt chunk can make the decoder allocate
+constexpr uint64_t maxExpansion = 255;
+constexpr uint64_t maxIndexBytes = 5;
+
+inline uint32_t load32(const uint8_t* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+void writeLength(std::vector<uint8_t>* out, size_t length) {
+	for (; length >= 255; length -= 255) {
+		out->push_back(255);
+	}
+	out->push_back(static_cast<uint8_t>(length));
+}
+
+void writeSequence(std::vector<uint8_t>* out, const uint8_t* literals, size_t literalCount,
+	size_t offset, size_t matchLength) {
+	const size_t matchCode = matchLength == 0 ? 0 : matchLength - minMatch;
+	out->push_back(static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15)));
+	if (literalCount >= 15) {
+		writeLength(out, literalCount - 15);
+	}
+	out->insert(out->end(), literals, literals + literalCount);
+	if (matchLength == 0) {
+		return;
+	}
+
+	out->push_back(static_cast<uint8_t>(offset));
+	out->push_back(static_cast<uint8_t>(offset >> 8));
+	if (matchCode >= 15) {
+		writeLength(out, matchCode - 15);
+	}
+}
+
+// greedy matching against the last position of every 4-byte hash, the
+// step grows over incompressible stretches
+void compressBytes(const uint8_t* data, size_t size, std::vector<uint8_t>* out) {
+	std::vector<uint32_t> table(size_t(1) << hashBits, 0);
+	size_t anchor = 0;
+	size_t i = 0;
+	while (i + minMatch <= size) {
+		const uint32_t sequence = load32(data + i);
+		const uint32_t hash = (sequence * 2654435761u) >> (32 - hashBits);
+		const size_t candidate = table[hash];
+		table[hash] = static_cast<uint32_t>(i + 1);
+
+		if (candidate == 0 || i - (candidate - 1) > maxOffset || load32(data + candidate - 1) != sequence) {
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+
+		const size_t match = candidate - 1;
+		size_t length = minMatch;
+		while (i + length < size && data[match + length] == data[i + length]) {
+			++length;
+		}
+
+		writeSequence(out, data + anchor, i - anchor, i - match, length);
+		i += length;
+		anchor = i;
+	}
+
+	writeSequence(out, data + anchor, size - anchor, 0, 0);
+}
+
+bool readLength(const uint8_t*& p, const uint8_t* end, size_t* length) {
+	uint8_t byte;
+	do {
+		if (p == end) {
+			return false;
+		}
+		byte = *p++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+bool decompressBytes(const uint8_t* data, size_t size, uint8_t* out, size_t outSize) {
+	const uint8_t* p = data;
+	const uint8_t* end = data + size;
+	uint8_t* o = out;
+	uint8_t* const outEnd = out + outSize;
+
+	for (;;) {
+		if (p == end) {
+			return false;
+		}
+		const uint8_t token = *p++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !readLength(p, end, &literalCount)) {
+			return false;
+		}
+		if (literalCount > static_cast<size_t>(end - p) || literalCount > static_cast<size_t>(outEnd - o)) {
+			return false;
+		}
+		memcpy(o, p, literalCount);
+		o += literalCount;
+		p += literalCount;
+
+		if (p == end) {
+			return o == outEnd;
+		}
+
+		if (end - p < 2) {
+			return false;
+		}
+		const size_t offset = static_cast<size_t>(p[0]) | static_cast<size_t>(p[1]) << 8;
+		p += 2;
+
+		size_t length = token & 15;
+		if (length == 15 && !readLength(p, end, &length)) {
+			return false;
+		}
+		length += minMatch;
+		if (offset == 0 || offset > static_cast<size_t>(o - out) || length > static_cast<size_t>(outEnd - o)) {
+			return false;
+		}
+
+		// 8 bytes at a time when the source stays behind the destination,
+		// overshooting into output that later sequences write anyway
+		const uint8_t* match = o - offset;
+		if (offset >= 8 && static_cast<size_t>(outEnd - o) >= length + 8) {
+			for (size_t i = 0; i < length; i += 8) {
+				memcpy(o + i, match + i, 8);
+			}
+		}
+		else {
+			for (size_t i = 0; i < length; ++i) {
+				o[i] = match[i];
+			}
+		}
+		o += length;
+	}
+}
+
+// half to float without a branch on the common path (Giesen), the
+// conversion of glm::unpackHalf1x16 dominated the vertex decode
+inline float halfToFloat(uint16_t half) {
+	constexpr uint32_t shiftedExponent = 0x7c00 << 13;
+	uint32_t bits = static_cast<uint32_t>(half & 0x7fff) << 13;
+	const uint32_t exponent = bits & shiftedExponent;
+	bits += (127 - 15) << 23;
+	if (exponent == shiftedExponent) {
+		// inf and nan
+		bits += (128 - 16) << 23;
+	}
+	else if (exponent == 0) {
+		// denormals, renormalized by the fpu
+		bits += 1 << 23;
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		value -= 6.103515625e-05f;
+		memcpy(&bits, &value, sizeof(bits));
+	}
+	bits |= static_cast<uint32_t>(half & 0x8000) << 16;
+
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+inline uint16_t zigzag16(uint16_t delta) {
+	return static_cast<uint16_t>((delta << 1) ^ (0 - (delta >> 15)));
+}
+
+inline uint16_t unzigzag16(uint16_t code) {
+	return static_cast<uint16_t>((code >> 1) ^ (0 - (code & 1)));
+}
+
+inline uint32_t zigzag32(uint32_t delta) {
+	return (delta << 1) ^ (0 - (delta >> 31));
+}
+
+inline uint32_t unzigzag32(uint32_t code) {
+	return (code >> 1) ^ (0 - (code & 1));
+}
+
+// planes of the low and then the high bytes of every component delta
+void encodeVertices(const Vertex* vertices, size_t count, const BoundingBox& boundingBox,
+	std::vector<uint8_t>* raw) {
+	const std::vector<Model::CompactVertex> compact = Model::quantizeVertices(vertices, count, boundingBox);
+
+	raw->resize(count * vertexComponents * 2);
+	uint16_t previous[vertexComponents] = {};
+	for (size_t i = 0; i < count; ++i) {
+		const Model::CompactVertex& vertex = compact[i];
+		const uint16_t components[vertexComponents] = {
+			vertex.position[0], vertex.position[1], vertex.position[2],
+			static_cast<uint16_t>(vertex.normal[0]), static_cast<uint16_t>(vertex.normal[1]),
+			vertex.texCoord[0], vertex.texCoord[1]
+		};
+		for (size_t c = 0; c < vertexComponents; ++c) {
+			const uint16_t code = zigzag16(static_cast<uint16_t>(components[c] - previous[c]));
+			(*raw)[(2 * c + 0) * count + i] = static_cast<uint8_t>(code);
+			(*raw)[(2 * c + 1) * count + i] = static_cast<uint8_t>(code >> 8);
+			previous[c] = components[c];
+		}
+	}
+}
+
+void decodeVertices(const uint8_t* raw, size_t count, const BoundingBox& boundingBox, Vertex* vertices) {
+	const glm::vec3 step = (boundingBox.max - boundingBox.min) / 65535.0f;
+
+	uint16_t components[vertexComponents] = {};
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t c = 0; c < vertexComponents; ++c) {
+			const uint16_t code = static_cast<uint16_t>(raw[(2 * c + 0) * count + i] | raw[(2 * c + 1) * count + i] << 8);
+			components[c] = static_cast<uint16_t>(components[c] + unzigzag16(code));
+		}
+
+		Vertex& vertex = vertices[i];
+		vertex.position = boundingBox.min +
+			glm::vec3(components[0], components[1], components[2]) * step;
+
+		// the unfolding of decodeNormal in the compact vertex shaders
+		glm::vec3 normal(
+			static_cast<int16_t>(components[3]) / 32767.0f,
+			static_cast<int16_t>(components[4]) / 32767.0f, 0.0f);
+		normal.z = 1.0f - std::abs(normal.x) - std::abs(normal.y);
+		const float t = std::max(-normal.z, 0.0f);
+		normal.x += normal.x >= 0.0f ? -t : t;
+		normal.y += normal.y >= 0.0f ? -t : t;
+		vertex.normal = glm::normalize(normal);
+
+		vertex.texCoord = glm::vec2(halfToFloat(components[5]), halfToFloat(components[6]));
+	}
+}
+
+// every index as the zigzag of its distance below the next unused vertex,
+// in 7-bit groups
+void encodeIndices(const uint32_t* indices, size_t count, std::vector<uint8_t>* raw) {
+	raw->clear();
+	uint32_t next = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t code = zigzag32(next - indices[i]);
+		while (code >= 0x80) {
+			raw->push_back(static_cast<uint8_t>(code | 0x80));
+			code >>= 7;
+		}
+		raw->push_back(static_cast<uint8_t>(code));
+		next = std::max(next, indices[i] + 1);
+	}
+}
+
+bool decodeIndices(const uint8_t* raw, size_t size, size_t count, uint32_t* indices) {
+	const uint8_t* p = raw;
+	const uint8_t* end = raw + size;
+	uint32_t next = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t code = 0;
+		for (unsigned shift = 0;; shift += 7) {
+			if (p == end || shift > 28) {
+				return false;
+			}
+			const uint8_t byte = *p++;
+			code |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if (byte < 0x80) {
+				break;
+			}
+		}
+		const uint32_t index = next - unzigzag32(code);
+		indices[i] = index;
+		next = std::max(next, index + 1);
+	}
+	return p == end;
+}
+}
+
+void encodeMesh(const Vertex* vertices, size_t vertexCount,
+	const uint32_t* indices, size_t indexCount, const std::vector<size_t>& rangeStarts,
+	std::string* out, unsigned threads) {
+	BoundingBox boundingBox;
+	for (size_t i = 0; i < vertexCount; ++i) {
+		boundingBox.min = glm::min(boundingBox.min, vertices[i].position);
+		boundingBox.max = glm::max(boundingBox.max, vertices[i].position);
+	}
+	if (vertexCount == 0) {
+		boundingBox.min = boundingBox.max = glm::vec3(0.0f);
+	}
+
+	std::vector<codec_chunk_t> chunks;
+	for (size_t first = 0; first < vertexCount; first += verticesPerChunk) {
+		codec_chunk_t chunk = {};
+		chunk.type = vertexChunk;
+		chunk.first = first;
+		chunk.count = static_cast<uint32_t>(std::min(verticesPerChunk, vertexCount - first));
+		chunks.push_back(chunk);
+	}
+
+	// index chunks end at every range start, and after indicesPerChunk
+	std::vector<size_t> starts(rangeStarts);
+	starts.push_back(indexCount);
+	std::sort(starts.begin(), starts.end());
+	size_t first = 0;
+	for (size_t start : starts) {
+		start = std::min(start, indexCount);
+		while (first < start) {
+			codec_chunk_t chunk = {};
+			chunk.type = indexChunk;
+			chunk.first = first;
+			chunk.count = static_cast<uint32_t>(std::min(indicesPerChunk, start - first));
+			chunks.push_back(chunk);
+			first += chunk.count;
+		}
+	}
+
+	std::vector<std::vector<uint8_t>> payloads(chunks.size());
+	parallelFor(chunks.size(), [&](size_t i) {
+		codec_chunk_t& chunk = chunks[i];
+		std::vector<uint8_t> raw;
+		if (chunk.type == vertexChunk) {
+			encodeVertices(vertices + chunk.first, chunk.count, boundingBox, &raw);
+		}
+		else {
+			encodeIndices(indices + chunk.first, chunk.count, &raw);
+		}
+
+		compressBytes(raw.data(), raw.size(), &payloads[i]);
+		chunk.rawSize = raw.size();
+		if (payloads[i].size() >= raw.size()) {
+			payloads[i].swap(raw);
+		}
+		chunk.packedSize = payloads[i].size();
+	}, threads);
+
+	codec_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, codecMagic, sizeof(codecMagic));
+	header.version = codecVersion;
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+	header.chunkCount = static_cast<uint32_t>(chunks.size());
+	for (int axis = 0; axis < 3; ++axis) {
+		header.boundsMin[axis] = boundingBox.min[axis];
+		header.boundsMax[axis] = boundingBox.max[axis];
+	}
+
+	uint64_t offset = 0;
+	for (auto& chunk : chunks) {
+		chunk.offset = offset;
+		offset += chunk.packedSize;
+	}
+
+	out->reserve(out->size() + sizeof(header) + chunks.size() * sizeof(codec_chunk_t) + offset);
+	out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+	out->append(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(codec_chunk_t));
+	for (const auto& payload : payloads) {
+		out->append(reinterpret_cast<const char*>(payload.data()), payload.size());
+	}
+}
+
+bool decodeMesh(const char* data, size_t size,
+	std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, unsigned threads) {
+	codec_header_t header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, codecMagic, sizeof(codecMagic)) != 0 || header.version != codecVersion ||
+		(size - sizeof(header)) / sizeof(codec_chunk_t) < header.chunkCount) {
+		return false;
+	}
+
+	std::vector<codec_chunk_t> chunks(header.chunkCount);
+	memcpy(chunks.data(), data + sizeof(header), chunks.size() * sizeof(codec_chunk_t));
+	const uint8_t* payloads = reinterpret_cast<const uint8_t*>(data) + sizeof(header) + chunks.size() * sizeof(codec_chunk_t);
+	const uint64_t payloadSize = size - sizeof(header) - chunks.size() * sizeof(codec_chunk_t);
+
+	uint64_t decodedVertices = 0;
+	uint64_t decodedIndices = 0;
+	for (const auto& chunk : chunks) {
+		const uint64_t total = chunk.type == vertexChunk ? header.vertexCount : header.indexCount;
+		if (chunk.type > indexChunk || chunk.first > total || chunk.count > total - chunk.first ||
+			chunk.offset > payloadSize || chunk.packedSize > payloadSize - chunk.offset ||
+			chunk.packedSize > chunk.rawSize || chunk.rawSize > chunk.packedSize * maxExpansion ||
+			(chunk.type == vertexChunk && chunk.rawSize != uint64_t(chunk.count) * vertexComponents * 2) ||
+			(chunk.type == indexChunk && (chunk.rawSize < chunk.count || chunk.rawSize > chunk.count * maxIndexBytes))) {
+			return false;
+		}
+		(chunk.type == vertexChunk ? decodedVertices : decodedIndices) += chunk.count;
+	}
+	if (decodedVertices != header.vertexCount || decodedIndices != header.indexCount) {
+		return false;
+	}
+
+	BoundingBox boundingBox;
+	boundingBox.min = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	boundingBox.max = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+	vertices->resize(static_cast<size_t>(header.vertexCount));
+	indices->resize(static_cast<size_t>(header.indexCount));
+
+	// the chunks write disjoint parts of the outputs
+	std::vector<char> valid(chunks.size(), 0);
+	parallelFor(chunks.size(), [&](size_t i) {
+		const codec_chunk_t& chunk = chunks[i];
+		const uint8_t* payload = payloads + chunk.offset;
+		std::vector<uint8_t> inflated;
+		if (chunk.packedSize != chunk.rawSize) {
+			inflated.resize(static_cast<size_t>(chunk.rawSize));
+			if (!decompressBytes(payload, static_cast<size_t>(chunk.packedSize), inflated.data(), inflated.size())) {
+				return;
+			}
+			payload = inflated.data();
+		}
+
+		if (chunk.type == vertexChunk) {
+			decodeVertices(payload, chunk.count, boundingBox, vertices->data() + chunk.first);
+			valid[i] = 1;
+		}
+		else {
+			valid[i] = decodeIndices(payload, static_cast<size_t>(chunk.rawSize), chunk.count,
+				indices->data() + chunk.first) ? 1 : 0;
+		}
+	}, threads);
+
+	if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+		vertices->clear();
+		indices->clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./base/vertex.h"
+
+// compressed image of a vertex and an index buffer, several times smaller
+// than the raw arrays. vertices are quantized like Model::CompactVertex
+// within their bounding box, then every component is delta coded against
+// the previous vertex and split into low and high byte planes. indices are
+// coded against the next vertex their range has not used yet, which is 0
+// or a small number once the triangles are in vertex cache order and the
+// vertices in fetch order, as variable length bytes. both streams then go
+// through an lz77 byte stage
+//
+// the buffers are cut into chunks that are coded on their own, so encoding
+// and decoding run on all cores
+
+// append the encoded buffers to out. rangeStarts lists the indices where
+// the vertex numbering restarts, the firstIndex of every submesh and lod
+void encodeMesh(const Vertex* vertices, size_t vertexCount,
+	const uint32_t* indices, size_t indexCount, const std::vector<size_t>& rangeStarts,
+	std::string* out, unsigned threads = 0);
+
+// decode the output of encodeMesh, false if data is not a valid one.
+// positions come back within half a quantization step of the originals,
+// normals and texture coordinates as the compact vertex format draws them
+bool decodeMesh(const char* data, size_t size,
+	std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, unsigned threads = 0);
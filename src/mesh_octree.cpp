@@ -0,0 +1,683 @@
+#include "mesh_octree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "mesh_codec.h"
+#include "model_cache.h"
+#include "vertex_welder.h"
+#include "./base/parallel.h"
+
+namespace {
+struct octree_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t nodeCount;
+	uint32_t runCount;
+	uint32_t reserved;
+	uint64_t nodeOffset;
+	uint64_t runOffset;
+	uint64_t materialOffset;
+	uint64_t materialSize;
+	// the obj and the mtl files it read, as ModelCache::writeSources lays them out
+	uint64_t sourceOffset;
+	uint64_t sourceSize;
+};
+
+struct octree_node_t {
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t firstChild;
+	uint32_t childCount;
+	uint32_t firstRun;
+	uint32_t runCount;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint64_t chunkOffset;
+	uint64_t chunkSize;
+};
+
+struct octree_run_t {
+	int32_t material;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+const char octreeMagic[8] = { 'L', 'O', 'F', 'T', 'O', 'C', 'T', '\0' };
+
+// a triangle of the obj as it is binned into the node files
+struct octree_triangle_t {
+	Model::index_t corners[3];
+	int32_t material;
+};
+
+// a node whose triangles are in a temporary file
+struct octree_pending_t {
+	uint32_t node;
+	BoundingBox cell;
+	size_t triangleCount;
+	std::string path;
+};
+
+struct octree_chunk_t {
+	std::string data;
+	std::vector<MeshOctree::Run> runs;
+	BoundingBox boundingBox;
+	uint32_t vertexCount = 0;
+	uint32_t indexCount = 0;
+};
+
+// the streams of the standard library buffer a few kilobytes, too little
+// for the many small records of a build
+const size_t writerBufferSize = 1 << 18;
+
+// appends to a temporary file through a buffer of its own
+struct temp_writer_t {
+	std::ofstream stream;
+	std::vector<char> buffer;
+
+	bool open(const std::string& path) {
+		stream.open(path, std::ios::binary | std::ios::trunc);
+		buffer.reserve(writerBufferSize);
+		return static_cast<bool>(stream);
+	}
+
+	void write(const void* data, size_t size) {
+		if (buffer.size() + size > writerBufferSize) {
+			flush();
+		}
+		const char* bytes = static_cast<const char*>(data);
+		buffer.insert(buffer.end(), bytes, bytes + size);
+	}
+
+	void flush() {
+		stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		buffer.clear();
+	}
+
+	// false if any write failed
+	bool close() {
+		flush();
+		stream.close();
+		return !stream.fail();
+	}
+};
+
+// the temporary files of a build, removed however it ends
+struct temp_files_t {
+	std::vector<std::string> paths;
+
+	~temp_files_t() {
+		for (const auto& path : paths) {
+			std::remove(path.c_str());
+		}
+	}
+};
+
+// the v, vn and vt records of the obj, mapped back from their temporary files
+struct octree_attributes_t {
+	MappedFile positions;
+	MappedFile normals;
+	MappedFile texCoords;
+
+	size_t getPositionCount() const { return positions.size() / (3 * sizeof(float)); }
+
+	glm::vec3 getPosition(int i) const {
+		const float* xyz = reinterpret_cast<const float*>(positions.data()) + 3 * static_cast<size_t>(i);
+		return glm::vec3(xyz[0], xyz[1], xyz[2]);
+	}
+
+	// attributes the obj does not have are left zero
+	Vertex getVertex(const Model::index_t& corner) const {
+		Vertex vertex(getPosition(corner.vertex_index), glm::vec3(0.0f), glm::vec2(0.0f));
+		if (hasNormal(corner)) {
+			const float* xyz = reinterpret_cast<const float*>(normals.data()) + 3 * static_cast<size_t>(corner.normal_index);
+			vertex.normal = glm::vec3(xyz[0], xyz[1], xyz[2]);
+		}
+		if (corner.texcoord_index >= 0 && static_cast<size_t>(corner.texcoord_index) < texCoords.size() / (2 * sizeof(float))) {
+			const float* uv = reinterpret_cast<const float*>(texCoords.data()) + 2 * static_cast<size_t>(corner.texcoord_index);
+			vertex.texCoord = glm::vec2(uv[0], uv[1]);
+		}
+		return vertex;
+	}
+
+	bool hasNormal(const Model::index_t& corner) const {
+		return corner.normal_index >= 0 && static_cast<size_t>(corner.normal_index) < normals.size() / (3 * sizeof(float));
+	}
+
+	// triangles with a corner outside the positions are left out
+	bool isValid(const octree_triangle_t& triangle) const {
+		for (const auto& corner : triangle.corners) {
+			if (corner.vertex_index < 0 || static_cast<size_t>(corner.vertex_index) >= getPositionCount()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	glm::vec3 getCentroid(const octree_triangle_t& triangle) const {
+		return (getPosition(triangle.corners[0].vertex_index) + getPosition(triangle.corners[1].vertex_index) +
+			getPosition(triangle.corners[2].vertex_index)) / 3.0f;
+	}
+};
+
+std::string getOctantPath(const std::string& nodePath, int octant) {
+	return nodePath.substr(0, nodePath.size() - 4) + "." + std::to_string(octant) + ".tmp";
+}
+
+// x is the low bit of an octant
+BoundingBox getOctantCell(const BoundingBox& cell, int octant) {
+	const glm::vec3 center = (cell.min + cell.max) * 0.5f;
+	BoundingBox octantCell;
+	for (int axis = 0; axis < 3; ++axis) {
+		const bool upper = (octant >> axis & 1) != 0;
+		octantCell.min[axis] = upper ? center[axis] : cell.min[axis];
+		octantCell.max[axis] = upper ? cell.max[axis] : center[axis];
+	}
+	return octantCell;
+}
+
+// stream the triangles of a node file into a file per octant, counts[o]
+// receives the triangles of octant o
+bool splitNode(const octree_pending_t& node, const octree_attributes_t& attributes, size_t counts[8]) {
+	std::ifstream inStream(node.path, std::ios::binary);
+	temp_writer_t octants[8];
+	bool opened = static_cast<bool>(inStream);
+	for (int octant = 0; octant < 8; ++octant) {
+		opened = octants[octant].open(getOctantPath(node.path, octant)) && opened;
+		counts[octant] = 0;
+	}
+	if (!opened) {
+		return false;
+	}
+
+	const glm::vec3 center = (node.cell.min + node.cell.max) * 0.5f;
+	std::vector<octree_triangle_t> block(writerBufferSize / sizeof(octree_triangle_t));
+	while (inStream) {
+		inStream.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(octree_triangle_t)));
+		const size_t count = static_cast<size_t>(inStream.gcount()) / sizeof(octree_triangle_t);
+		for (size_t t = 0; t < count; ++t) {
+			if (!attributes.isValid(block[t])) {
+				continue;
+			}
+			const glm::vec3 centroid = attributes.getCentroid(block[t]);
+			const int octant = (centroid.x < center.x ? 0 : 1) | (centroid.y < center.y ? 0 : 2) | (centroid.z < center.z ? 0 : 4);
+			octants[octant].write(&block[t], sizeof(octree_triangle_t));
+			++counts[octant];
+		}
+	}
+
+	bool written = inStream.eof();
+	for (auto& octant : octants) {
+		written = octant.close() && written;
+	}
+	return written;
+}
+
+// load the triangles of a leaf sorted by material and weld their corners,
+// the vertices are numbered in the order the triangles first use them
+bool buildChunk(const octree_pending_t& leaf, const octree_attributes_t& attributes,
+	const MeshOctreeOptions& options, octree_chunk_t* chunk) {
+	std::vector<octree_triangle_t> triangles(leaf.triangleCount);
+	std::ifstream inStream(leaf.path, std::ios::binary);
+	inStream.read(reinterpret_cast<char*>(triangles.data()),
+		static_cast<std::streamsize>(triangles.size() * sizeof(octree_triangle_t)));
+	if (!inStream) {
+		return false;
+	}
+
+	triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+		[&](const octree_triangle_t& triangle) { return !attributes.isValid(triangle); }), triangles.end());
+	std::stable_sort(triangles.begin(), triangles.end(),
+		[](const octree_triangle_t& lhs, const octree_triangle_t& rhs) { return lhs.material < rhs.material; });
+
+	// the corners without a normal are smoothed over the positions of the chunk
+	bool missingNormals = false;
+	for (const auto& triangle : triangles) {
+		for (const auto& corner : triangle.corners) {
+			missingNormals = missingNormals || !attributes.hasNormal(corner);
+		}
+	}
+
+	std::vector<glm::vec3> normals;
+	std::vector<uint32_t> cornerNormals;
+	if (missingNormals && options.generateNormals) {
+		std::unordered_map<int, uint32_t> localPositions;
+		localPositions.reserve(2 * triangles.size());
+		std::vector<float> positions;
+		std::vector<uint32_t> corners;
+		corners.reserve(3 * triangles.size());
+		for (const auto& triangle : triangles) {
+			for (const auto& corner : triangle.corners) {
+				auto inserted = localPositions.insert(std::make_pair(corner.vertex_index,
+					static_cast<uint32_t>(positions.size() / 3)));
+				if (inserted.second) {
+					const glm::vec3 position = attributes.getPosition(corner.vertex_index);
+					positions.insert(positions.end(), { position.x, position.y, position.z });
+				}
+				corners.push_back(inserted.first->second);
+			}
+		}
+		generateNormals(positions.data(), positions.size() / 3, corners.data(), corners.size(),
+			glm::radians(options.normalCreaseAngle), options.normalWeighting, &normals, &cornerNormals, 1);
+	}
+
+	VertexWelder welder(3 * triangles.size());
+	std::vector<uint32_t> indices;
+	indices.reserve(3 * triangles.size());
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		if (chunk->runs.empty() || chunk->runs.back().material != triangles[t].material) {
+			MeshOctree::Run run;
+			run.material = triangles[t].material;
+			run.firstIndex = static_cast<uint32_t>(indices.size());
+			chunk->runs.push_back(run);
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			const Model::index_t& corner = triangles[t].corners[k];
+			Vertex vertex = attributes.getVertex(corner);
+			if (!cornerNormals.empty() && !attributes.hasNormal(corner)) {
+				vertex.normal = normals[cornerNormals[3 * t + k]];
+			}
+			chunk->boundingBox.min = glm::min(chunk->boundingBox.min, vertex.position);
+			chunk->boundingBox.max = glm::max(chunk->boundingBox.max, vertex.position);
+			indices.push_back(welder.weld(vertex));
+		}
+		chunk->runs.back().indexCount += 3;
+	}
+
+	const std::vector<Vertex> vertices = welder.releaseVertices();
+	chunk->vertexCount = static_cast<uint32_t>(vertices.size());
+	chunk->indexCount = static_cast<uint32_t>(indices.size());
+	encodeMesh(vertices.data(), vertices.size(), indices.data(), indices.size(),
+		std::vector<size_t>(1, 0), &chunk->data, 1);
+	return true;
+}
+}
+
+bool MeshOctree::build(const std::string& objPath, const std::string& path,
+	const MeshOctreeOptions& options, std::string* err) {
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	const auto fail = [err](const std::string& message) {
+		if (err) {
+			(*err) = message;
+		}
+		return false;
+	};
+
+	// declared first, so the mappings below are closed before the files go
+	temp_files_t tempFiles;
+	const std::string positionPath = path + ".v.tmp";
+	const std::string normalPath = path + ".vn.tmp";
+	const std::string texCoordPath = path + ".vt.tmp";
+	const std::string rootPath = path + ".node.tmp";
+	const std::string chunkPath = path + ".chunks.tmp";
+	tempFiles.paths = { positionPath, normalPath, texCoordPath, rootPath, chunkPath };
+
+	// pass 1: the attributes and the triangles go to their files as they are read
+	temp_writer_t positionWriter, normalWriter, texCoordWriter, rootWriter;
+	if (!positionWriter.open(positionPath) || !normalWriter.open(normalPath) ||
+		!texCoordWriter.open(texCoordPath) || !rootWriter.open(rootPath)) {
+		return fail("Cannot open the temporary files next to [" + path + "]\n");
+	}
+
+	BoundingBox bounds;
+	size_t triangleCount = 0;
+	Model::ObjStreamHandler handler;
+	handler.position = [&](const float* xyz) {
+		positionWriter.write(xyz, 3 * sizeof(float));
+		bounds.min = glm::min(bounds.min, glm::vec3(xyz[0], xyz[1], xyz[2]));
+		bounds.max = glm::max(bounds.max, glm::vec3(xyz[0], xyz[1], xyz[2]));
+	};
+	handler.normal = [&](const float* xyz) {
+		normalWriter.write(xyz, 3 * sizeof(float));
+	};
+	handler.texCoord = [&](const float* uv) {
+		texCoordWriter.write(uv, 2 * sizeof(float));
+	};
+	handler.triangle = [&](const Model::index_t* corners, int material) {
+		octree_triangle_t triangle;
+		memcpy(triangle.corners, corners, sizeof(triangle.corners));
+		triangle.material = material;
+		rootWriter.write(&triangle, sizeof(triangle));
+		++triangleCount;
+	};
+
+	std::vector<Model::material_t> materials;
+	std::vector<std::string> sources(1, objPath);
+	std::string objErr;
+	std::cout << "Streaming obj: " << objPath << std::endl;
+	if (!Model::StreamObj(objPath, handler, &materials, &sources, &objErr)) {
+		return fail(objErr);
+	}
+	if (!objErr.empty()) {
+		std::cerr << objErr << std::endl;
+	}
+
+	const bool written = positionWriter.close() && normalWriter.close() &&
+		texCoordWriter.close() && rootWriter.close();
+	octree_attributes_t attributes;
+	if (!written || !attributes.positions.open(positionPath) ||
+		!attributes.normals.open(normalPath) || !attributes.texCoords.open(texCoordPath)) {
+		return fail("Write the temporary files next to [" + path + "] failure\n");
+	}
+
+	// octants of a cube around the model stay cubes
+	BoundingBox root;
+	if (triangleCount > 0) {
+		const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+		const glm::vec3 extent = bounds.max - bounds.min;
+		const float halfSize = std::max(std::max(extent.x, extent.y), extent.z) * 0.5f;
+		root.min = center - glm::vec3(halfSize);
+		root.max = center + glm::vec3(halfSize);
+	}
+
+	// pass 2: split the node files level by level, the nodes of a level in
+	// parallel. the children of a node are appended together, after it
+	std::vector<Node> nodes(1);
+	std::vector<octree_pending_t> level(1, octree_pending_t{ 0, root, triangleCount, rootPath });
+	std::vector<octree_pending_t> leaves;
+	for (unsigned depth = 0; !level.empty(); ++depth) {
+		std::vector<char> split(level.size(), 0);
+		std::vector<char> failed(level.size(), 0);
+		std::vector<size_t> counts(8 * level.size(), 0);
+		parallelFor(level.size(), [&](size_t i) {
+			if (level[i].triangleCount > options.maxChunkTriangles && depth < options.maxDepth) {
+				split[i] = 1;
+				failed[i] = !splitNode(level[i], attributes, &counts[8 * i]);
+			}
+		}, options.threads);
+
+		std::vector<octree_pending_t> next;
+		for (size_t i = 0; i < level.size(); ++i) {
+			if (!split[i]) {
+				leaves.push_back(level[i]);
+				continue;
+			}
+
+			for (int octant = 0; octant < 8; ++octant) {
+				tempFiles.paths.push_back(getOctantPath(level[i].path, octant));
+			}
+			if (failed[i]) {
+				return fail("Split the node file [" + level[i].path + "] failure\n");
+			}
+			std::remove(level[i].path.c_str());
+
+			const uint32_t parent = level[i].node;
+			nodes[parent].firstChild = static_cast<uint32_t>(nodes.size());
+			for (int octant = 0; octant < 8; ++octant) {
+				if (counts[8 * i + octant] > 0) {
+					next.push_back({ static_cast<uint32_t>(nodes.size()), getOctantCell(level[i].cell, octant),
+						counts[8 * i + octant], getOctantPath(level[i].path, octant) });
+					nodes.emplace_back();
+					++nodes[parent].childCount;
+				}
+			}
+		}
+		level.swap(next);
+	}
+
+	// pass 3: a few leaves per worker at a time are loaded and encoded, then
+	// appended to the chunk file
+	temp_writer_t chunkWriter;
+	if (!chunkWriter.open(chunkPath)) {
+		return fail("Cannot open file [" + chunkPath + "]\n");
+	}
+
+	std::vector<octree_run_t> runs;
+	uint64_t chunkBytes = 0;
+	const size_t batchSize = 2 * getWorkerCount(options.threads);
+	for (size_t first = 0; first < leaves.size(); first += batchSize) {
+		const size_t count = std::min(batchSize, leaves.size() - first);
+		std::vector<octree_chunk_t> chunks(count);
+		std::vector<char> built(count, 0);
+		parallelFor(count, [&](size_t i) {
+			built[i] = buildChunk(leaves[first + i], attributes, options, &chunks[i]);
+		}, options.threads);
+
+		for (size_t i = 0; i < count; ++i) {
+			const octree_pending_t& leaf = leaves[first + i];
+			if (!built[i]) {
+				return fail("Read the node file [" + leaf.path + "] failure\n");
+			}
+			std::remove(leaf.path.c_str());
+
+			Node& node = nodes[leaf.node];
+			node.boundingBox = chunks[i].boundingBox;
+			node.firstRun = static_cast<uint32_t>(runs.size());
+			node.runCount = static_cast<uint32_t>(chunks[i].runs.size());
+			node.vertexCount = chunks[i].vertexCount;
+			node.indexCount = chunks[i].indexCount;
+			// relative to the chunk file until the header is laid out
+			node.chunkOffset = chunkBytes;
+			node.chunkSize = chunks[i].data.size();
+			for (const auto& run : chunks[i].runs) {
+				runs.push_back({ run.material, run.firstIndex, run.indexCount });
+			}
+
+			chunkWriter.write(chunks[i].data.data(), chunks[i].data.size());
+			chunkBytes += chunks[i].data.size();
+		}
+	}
+	if (!chunkWriter.close()) {
+		return fail("Write file [" + chunkPath + "] failure\n");
+	}
+
+	// children come after their parent, so one backward pass sums the boxes
+	for (size_t i = nodes.size(); i-- > 0;) {
+		for (uint32_t child = nodes[i].firstChild; child < nodes[i].firstChild + nodes[i].childCount; ++child) {
+			nodes[i].boundingBox += nodes[child].boundingBox;
+		}
+	}
+
+	std::string materialData;
+	ModelCache::writeMaterials(materials, &materialData);
+
+	std::string sourceData;
+	std::string sourceErr;
+	if (!ModelCache::writeSources(sources, &sourceData, &sourceErr)) {
+		return fail(sourceErr);
+	}
+
+	octree_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, octreeMagic, sizeof(octreeMagic));
+	header.version = version;
+	header.nodeCount = static_cast<uint32_t>(nodes.size());
+	header.runCount = static_cast<uint32_t>(runs.size());
+	header.nodeOffset = sizeof(header);
+	header.runOffset = header.nodeOffset + nodes.size() * sizeof(octree_node_t);
+	header.materialOffset = header.runOffset + runs.size() * sizeof(octree_run_t);
+	header.materialSize = materialData.size();
+	header.sourceOffset = header.materialOffset + header.materialSize;
+	header.sourceSize = sourceData.size();
+
+	const uint64_t chunkBase = header.sourceOffset + header.sourceSize;
+	std::vector<octree_node_t> nodeRecords(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node& node = nodes[i];
+		octree_node_t& record = nodeRecords[i];
+		memset(&record, 0, sizeof(record));
+		for (int axis = 0; axis < 3; ++axis) {
+			record.boundsMin[axis] = node.boundingBox.min[axis];
+			record.boundsMax[axis] = node.boundingBox.max[axis];
+		}
+		record.firstChild = node.firstChild;
+		record.childCount = node.childCount;
+		record.firstRun = node.firstRun;
+		record.runCount = node.runCount;
+		record.vertexCount = node.vertexCount;
+		record.indexCount = node.indexCount;
+		if (node.isLeaf()) {
+			record.chunkOffset = chunkBase + node.chunkOffset;
+			record.chunkSize = node.chunkSize;
+		}
+	}
+
+	// write next to the target and rename, as the mesh cache does
+	const std::string tempPath = path + ".tmp";
+	tempFiles.paths.push_back(tempPath);
+	{
+		MappedFile chunkFile;
+		std::ofstream outStream(tempPath, std::ios::binary | std::ios::trunc);
+		if (!outStream || !chunkFile.open(chunkPath)) {
+			return fail("Cannot open file [" + tempPath + "]\n");
+		}
+
+		outStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		outStream.write(reinterpret_cast<const char*>(nodeRecords.data()),
+			static_cast<std::streamsize>(nodeRecords.size() * sizeof(octree_node_t)));
+		outStream.write(reinterpret_cast<const char*>(runs.data()),
+			static_cast<std::streamsize>(runs.size() * sizeof(octree_run_t)));
+		outStream.write(materialData.data(), static_cast<std::streamsize>(materialData.size()));
+		outStream.write(sourceData.data(), static_cast<std::streamsize>(sourceData.size()));
+		// the chunks are copied through the page cache a slice at a time
+		const size_t sliceSize = size_t(64) << 20;
+		for (size_t offset = 0; offset < chunkFile.size() && outStream; offset += sliceSize) {
+			outStream.write(chunkFile.data() + offset,
+				static_cast<std::streamsize>(std::min(sliceSize, chunkFile.size() - offset)));
+		}
+
+		outStream.close();
+		if (!outStream) {
+			return fail("Write file [" + tempPath + "] failure\n");
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+		return fail("Cannot rename [" + tempPath + "] to [" + path + "]\n");
+	}
+
+	auto buildEnd = std::chrono::high_resolution_clock::now();
+	std::cout << "Built mesh octree " << path << " in "
+		<< std::chrono::duration<float, std::milli>(buildEnd - buildStart).count() << " ms, "
+		<< triangleCount << " triangles in " << leaves.size() << " chunks over " << nodes.size() << " nodes, "
+		<< (chunkBase + chunkBytes) / (1024 * 1024) << " MB" << std::endl;
+
+	return true;
+}
+
+bool MeshOctree::open(const std::string& path, std::string* err) {
+	std::stringstream errss;
+
+	if (!_file.open(path)) {
+		errss << "Cannot open file [" << path << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		return false;
+	}
+
+	octree_header_t header;
+	const uint64_t fileSize = _file.size();
+	bool valid = fileSize >= sizeof(header);
+	if (valid) {
+		memcpy(&header, _file.data(), sizeof(header));
+		valid = memcmp(header.magic, octreeMagic, sizeof(octreeMagic)) == 0 &&
+			header.version == version &&
+			header.nodeCount != 0 &&
+			header.nodeOffset + uint64_t(header.nodeCount) * sizeof(octree_node_t) <= fileSize &&
+			header.runOffset + uint64_t(header.runCount) * sizeof(octree_run_t) <= fileSize &&
+			header.materialOffset + header.materialSize <= fileSize &&
+			header.sourceOffset + header.sourceSize <= fileSize;
+	}
+	if (!valid) {
+		errss << "Invalid mesh octree [" << path << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		_file.close();
+		return false;
+	}
+
+	_nodes.resize(header.nodeCount);
+	for (size_t i = 0; i < _nodes.size() && valid; ++i) {
+		octree_node_t record;
+		memcpy(&record, _file.data() + header.nodeOffset + i * sizeof(record), sizeof(record));
+		Node& node = _nodes[i];
+		node.boundingBox.min = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+		node.boundingBox.max = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+		node.firstChild = record.firstChild;
+		node.childCount = record.childCount;
+		node.firstRun = record.firstRun;
+		node.runCount = record.runCount;
+		node.vertexCount = record.vertexCount;
+		node.indexCount = record.indexCount;
+		node.chunkOffset = record.chunkOffset;
+		node.chunkSize = record.chunkSize;
+
+		valid = (node.childCount == 0 || (node.firstChild > i && node.firstChild + uint64_t(node.childCount) <= header.nodeCount)) &&
+			node.firstRun + uint64_t(node.runCount) <= header.runCount &&
+			node.chunkOffset + node.chunkSize <= fileSize;
+	}
+
+	_runs.resize(header.runCount);
+	for (size_t i = 0; i < _runs.size(); ++i) {
+		octree_run_t record;
+		memcpy(&record, _file.data() + header.runOffset + i * sizeof(record), sizeof(record));
+		_runs[i].material = record.material;
+		_runs[i].firstIndex = record.firstIndex;
+		_runs[i].indexCount = record.indexCount;
+	}
+	_materials = ModelCache::readMaterials(_file.data() + header.materialOffset, static_cast<size_t>(header.materialSize));
+
+	// the runs stay within the indices of their chunk and name a material
+	// of the table, which the draws index the material block with
+	for (size_t i = 0; i < _nodes.size() && valid; ++i) {
+		for (uint32_t run = _nodes[i].firstRun; valid && run < _nodes[i].firstRun + _nodes[i].runCount; ++run) {
+			valid = _runs[run].firstIndex + uint64_t(_runs[run].indexCount) <= _nodes[i].indexCount &&
+				_runs[run].material >= -1 && _runs[run].material < static_cast<int64_t>(_materials.size());
+		}
+	}
+
+	if (!valid) {
+		errss << "Invalid mesh octree node table [" << path << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		_nodes.clear();
+		_runs.clear();
+		_materials.clear();
+		_file.close();
+		return false;
+	}
+
+	_sourceOffset = header.sourceOffset;
+	_sourceSize = header.sourceSize;
+
+	return true;
+}
+
+bool MeshOctree::isCurrent(bool verifyHash) const {
+	return _file.isOpen() && ModelCache::checkSources(_file.data() + _sourceOffset,
+		static_cast<size_t>(_sourceSize), verifyHash);
+}
+
+BoundingBox MeshOctree::getBoundingBox() const {
+	return _nodes.empty() ? BoundingBox() : _nodes[0].boundingBox;
+}
+
+size_t MeshOctree::getLeafCount() const {
+	return static_cast<size_t>(std::count_if(_nodes.begin(), _nodes.end(),
+		[](const Node& node) { return node.isLeaf(); }));
+}
+
+bool MeshOctree::readChunk(uint32_t node, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices) const {
+	const Node& leaf = _nodes[node];
+	if (!decodeMesh(_file.data() + leaf.chunkOffset, static_cast<size_t>(leaf.chunkSize), vertices, indices, 1) ||
+		vertices->size() != leaf.vertexCount || indices->size() != leaf.indexCount) {
+		return false;
+	}
+
+	// a corrupt chunk may still decode, but none of its indices may reach
+	// past its vertices before they are drawn
+	return std::all_of(indices->begin(), indices->end(),
+		[&leaf](uint32_t index) { return index < leaf.vertexCount; });
+}
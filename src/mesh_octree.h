@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./base/bounding_box.h"
+#include "./base/mapped_file.h"
+#include "model.h"
+
+struct MeshOctreeOptions {
+	// a node with more triangles is split into its octants
+	unsigned maxChunkTriangles = 1 << 16;
+
+	// nodes this deep stay leaves whatever their size
+	unsigned maxDepth = 10;
+
+	// the corners of the obj without a vn get smooth normals, computed per
+	// chunk: faces of another chunk do not contribute to them
+	bool generateNormals = true;
+	NormalWeighting normalWeighting = NormalWeighting::Angle;
+	// faces meeting at a larger angle, in degrees, keep their own normals
+	float normalCreaseAngle = 60.0f;
+
+	// worker threads for splitting the nodes and encoding the chunks,
+	// 0 = one per hardware thread
+	unsigned threads = 0;
+};
+
+// a mesh cut into spatial chunks on disk, for meshes too large to hold in
+// memory. triangles go to the octant of their centroid until a node has at
+// most maxChunkTriangles, every leaf is a chunk holding its own vertices
+// and its triangles sorted by material as a mesh_codec image, so a pager
+// reads and decodes any chunk on its own. the bounding box of a node is
+// that of the triangles under it and may reach over its octant.
+// the build streams the obj once: the attributes go to temporary files that
+// are mapped afterwards, the triangles to a file per node that is split
+// into one per octant level by level, and only a leaf is loaded whole.
+// reading back only touches the node table and the chunks asked for. the
+// size, mtime and hash of the obj and its mtl files are recorded, so a
+// stale octree can be told apart and built again
+class MeshOctree {
+public:
+	// bump whenever the file layout changes
+	static constexpr uint32_t version = 2;
+
+	// the triangles of a chunk under one material, indices
+	// [firstIndex, firstIndex + indexCount) of the chunk
+	struct Run {
+		int material = -1;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
+	struct Node {
+		BoundingBox boundingBox;
+		// [firstChild, firstChild + childCount) of the node table, the
+		// children of a node are contiguous and come after it
+		uint32_t firstChild = 0;
+		uint32_t childCount = 0;
+		// the chunk of a leaf, runs [firstRun, firstRun + runCount)
+		uint32_t firstRun = 0;
+		uint32_t runCount = 0;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		uint64_t chunkOffset = 0;
+		uint64_t chunkSize = 0;
+
+		bool isLeaf() const { return childCount == 0; }
+
+		// bytes of the decoded vertices and indices of the chunk
+		size_t getChunkMemory() const {
+			return vertexCount * sizeof(Vertex) + indexCount * sizeof(uint32_t);
+		}
+	};
+
+	// partition the triangles of an obj and write them to path, the
+	// temporary files go next to it. false with err set on failure
+	static bool build(const std::string& objPath, const std::string& path,
+		const MeshOctreeOptions& options, std::string* err);
+
+	// map the file and read the node table, false if it is missing, was
+	// written by another version, or its ranges or materials are out of bounds
+	bool open(const std::string& path, std::string* err);
+
+	// false if the obj or an mtl file it read was changed since the build.
+	// a hash is only compared when the mtime differs, or always with
+	// verifyHash
+	bool isCurrent(bool verifyHash = false) const;
+
+	// the root is node 0
+	const std::vector<Node>& getNodes() const { return _nodes; }
+
+	const std::vector<Run>& getRuns() const { return _runs; }
+
+	const std::vector<Model::material_t>& getMaterials() const { return _materials; }
+
+	BoundingBox getBoundingBox() const;
+
+	size_t getLeafCount() const;
+
+	// decode the chunk of a leaf, false if it is corrupt or an index is out
+	// of its vertices. may be called from several threads at once
+	bool readChunk(uint32_t node, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices) const;
+
+private:
+	MappedFile _file;
+
+	std::vector<Node> _nodes;
+	std::vector<Run> _runs;
+	std::vector<Model::material_t> _materials;
+	uint64_t _sourceOffset = 0;
+	uint64_t _sourceSize = 0;
+};
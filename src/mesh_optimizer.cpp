@@ -0,0 +1,290 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+const uint32_t noVertex = 0xffffffffu;
+
+// fifo cache emulation: a vertex is resident while fewer than cacheSize
+// misses happened since it was loaded
+struct fifo_cache_t {
+	std::vector<uint32_t> loadTime;
+	uint32_t timestamp;
+	unsigned size;
+
+	fifo_cache_t(size_t vertexCount, unsigned cacheSize)
+		: loadTime(vertexCount, 0), timestamp(cacheSize + 1), size(cacheSize) {}
+
+	uint32_t getAge(uint32_t vertex) const {
+		return timestamp - loadTime[vertex];
+	}
+
+	// true on a miss
+	bool touch(uint32_t vertex) {
+		if (getAge(vertex) > size) {
+			loadTime[vertex] = timestamp++;
+			return true;
+		}
+		return false;
+	}
+
+	void flush() {
+		timestamp += size + 1;
+	}
+};
+
+// misses of triangles [first, last) starting from an empty cache
+size_t countMisses(const uint32_t* indices, size_t first, size_t last, fifo_cache_t* cache) {
+	cache->flush();
+	size_t misses = 0;
+	for (size_t i = first * 3; i < last * 3; ++i) {
+		misses += cache->touch(indices[i]);
+	}
+	return misses;
+}
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount,
+	size_t vertexCount, unsigned cacheSize) {
+	VertexCacheStats stats;
+	if (indexCount < 3) {
+		return stats;
+	}
+
+	fifo_cache_t cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		misses += cache.touch(indices[i]);
+	}
+
+	stats.misses = misses;
+	stats.triangles = indexCount / 3;
+	for (uint32_t time : cache.loadTime) {
+		stats.vertices += time != 0;
+	}
+	return stats;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+	unsigned cacheSize, std::vector<size_t>* clusters) {
+	const size_t triangleCount = indexCount / 3;
+	if (clusters) {
+		clusters->assign(1, 0);
+	}
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// triangles around each vertex, vertex v owns adjacency[offsets[v], offsets[v + 1])
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		++offsets[indices[i] + 1];
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	// triangles not emitted yet around each vertex
+	std::vector<uint32_t> live(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		live[v] = offsets[v + 1] - offsets[v];
+	}
+
+	std::vector<uint32_t> output(triangleCount * 3);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	fifo_cache_t cache(vertexCount, cacheSize);
+
+	size_t emittedCount = 0;
+	uint32_t scan = 0;
+	uint32_t fan = indices[0];
+	while (fan != noVertex) {
+		candidates.clear();
+		for (uint32_t i = offsets[fan]; i < offsets[fan + 1]; ++i) {
+			const uint32_t triangle = adjacency[i];
+			if (emitted[triangle]) {
+				continue;
+			}
+
+			emitted[triangle] = 1;
+			for (int corner = 0; corner < 3; ++corner) {
+				const uint32_t v = indices[triangle * 3 + corner];
+				output[emittedCount * 3 + corner] = v;
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				cache.touch(v);
+			}
+			++emittedCount;
+		}
+
+		// the candidate that will still be in the cache after emitting all of
+		// its remaining triangles, and has been there the longest
+		fan = noVertex;
+		int bestPriority = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) {
+				continue;
+			}
+
+			int priority = 0;
+			const uint32_t age = cache.getAge(v);
+			if (age + 2 * live[v] <= cacheSize) {
+				priority = static_cast<int>(age);
+			}
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fan = v;
+			}
+		}
+
+		if (fan != noVertex) {
+			continue;
+		}
+
+		// dead end, fall back to a recently used vertex, then to the input order
+		if (clusters && emittedCount < triangleCount) {
+			clusters->push_back(emittedCount);
+		}
+
+		while (!deadEnd.empty() && fan == noVertex) {
+			const uint32_t v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) {
+				fan = v;
+			}
+		}
+
+		while (fan == noVertex && scan < triangleCount * 3) {
+			if (live[indices[scan]] > 0) {
+				fan = indices[scan];
+			}
+			++scan;
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices,
+	size_t vertexCount, const std::vector<size_t>& clusters, unsigned cacheSize, float threshold) {
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// cut every cluster where the acmr of the part so far is already close to
+	// that of the whole cluster, smaller clusters sort better
+	std::vector<size_t> starts;
+	fifo_cache_t cache(vertexCount, cacheSize);
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		const size_t first = clusters[c];
+		const size_t last = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		if (first >= last) {
+			continue;
+		}
+
+		const float clusterAcmr = static_cast<float>(countMisses(indices, first, last, &cache)) /
+			static_cast<float>(last - first);
+
+		starts.push_back(first);
+		cache.flush();
+		size_t start = first;
+		size_t misses = 0;
+		for (size_t t = first; t < last; ++t) {
+			for (int corner = 0; corner < 3; ++corner) {
+				misses += cache.touch(indices[t * 3 + corner]);
+			}
+
+			const float acmr = static_cast<float>(misses) / static_cast<float>(t + 1 - start);
+			if (t + 1 < last && acmr <= clusterAcmr * threshold) {
+				start = t + 1;
+				misses = 0;
+				starts.push_back(start);
+				cache.flush();
+			}
+		}
+	}
+	starts.push_back(triangleCount);
+
+	// area weighted centroid and normal of every cluster
+	const size_t clusterCount = starts.size() - 1;
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; ++c) {
+		for (size_t t = starts[c]; t < starts[c + 1]; ++t) {
+			const glm::vec3& a = vertices[indices[t * 3 + 0]].position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+			const glm::vec3 normal = glm::cross(b - a, d - a);
+			const float area = glm::length(normal);
+			centroids[c] += (a + b + d) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+		if (areas[c] > 0.0f) {
+			centroids[c] /= areas[c];
+		}
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+
+	// clusters facing away from the center of the mesh are more likely to
+	// occlude than to be occluded, so they go first
+	std::vector<float> sortKeys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		const float length = glm::length(normals[c]);
+		if (length > 0.0f) {
+			sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normals[c] / length);
+		}
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+		return sortKeys[lhs] > sortKeys[rhs];
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	for (uint32_t c : order) {
+		output.insert(output.end(), indices + starts[c] * 3, indices + starts[c + 1] * 3);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, noVertex);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		uint32_t& target = remap[indices[i]];
+		if (target == noVertex) {
+			target = next++;
+		}
+		indices[i] = target;
+	}
+
+	for (uint32_t& target : remap) {
+		if (target == noVertex) {
+			target = next++;
+		}
+	}
+
+	return remap;
+}
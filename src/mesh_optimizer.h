@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./base/vertex.h"
+
+// post-transform vertex cache efficiency of an index buffer, measured with a
+// fifo cache. acmr is misses per triangle (0.5 is the limit for a regular
+// grid, 3 is no reuse at all), atvr is misses per vertex (1 is perfect).
+// stats of separate draws add up
+struct VertexCacheStats {
+	size_t misses = 0;
+	size_t triangles = 0;
+	// distinct vertices referenced
+	size_t vertices = 0;
+
+	float getAcmr() const {
+		return triangles == 0 ? 0.0f : static_cast<float>(misses) / static_cast<float>(triangles);
+	}
+
+	float getAtvr() const {
+		return vertices == 0 ? 0.0f : static_cast<float>(misses) / static_cast<float>(vertices);
+	}
+
+	VertexCacheStats& operator+=(const VertexCacheStats& rhs) {
+		misses += rhs.misses;
+		triangles += rhs.triangles;
+		vertices += rhs.vertices;
+		return *this;
+	}
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount,
+	size_t vertexCount, unsigned cacheSize);
+
+// reorder the triangles for a fifo vertex cache of cacheSize entries with
+// tipsify (Sander et al. 2007), in linear time. if clusters is given it
+// receives the first triangle of every run that starts after a dead end,
+// which is where optimizeOverdraw may cut the order
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+	unsigned cacheSize, std::vector<size_t>* clusters = nullptr);
+
+// reorder the clusters of a vertex cache optimized index buffer so that the
+// outward facing ones are drawn first and occlude the rest. clusters are cut
+// further as long as their acmr stays within threshold times the original
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices,
+	size_t vertexCount, const std::vector<size_t>& clusters, unsigned cacheSize, float threshold);
+
+// renumber the vertices in the order the index buffer first references them,
+// unreferenced vertices go last. returns the old to new index table
+std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount);
@@ -0,0 +1,476 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+const uint32_t noVertex = 0xffffffffu;
+// more than one open edge leaves or enters the vertex
+const uint32_t manyVertices = 0xfffffffeu;
+
+enum vertex_kind_t : uint8_t {
+	// interior vertex, the only one at its position
+	Manifold,
+	// on an open border of the mesh
+	Border,
+	// one of the two vertices on either side of an attribute seam
+	Seam,
+	// everything else: corners, seam ends, non-manifold fans
+	Locked
+};
+
+// symmetric 4x4 error quadric, the weighted sum of (n.p + d)^2 over its planes
+struct quadric_t {
+	double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+	double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+	double w = 0.0;
+
+	void addPlane(const glm::dvec3& n, double d, double weight) {
+		a00 += weight * n.x * n.x;
+		a11 += weight * n.y * n.y;
+		a22 += weight * n.z * n.z;
+		a01 += weight * n.x * n.y;
+		a02 += weight * n.x * n.z;
+		a12 += weight * n.y * n.z;
+		b0 += weight * n.x * d;
+		b1 += weight * n.y * d;
+		b2 += weight * n.z * d;
+		c += weight * d * d;
+		w += weight;
+	}
+
+	void add(const quadric_t& q) {
+		a00 += q.a00; a11 += q.a11; a22 += q.a22;
+		a01 += q.a01; a02 += q.a02; a12 += q.a12;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		w += q.w;
+	}
+
+	// mean squared distance from p to the planes
+	double evaluate(const glm::dvec3& p) const {
+		const double value =
+			a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+			2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+			2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+		return w > 0.0 ? std::max(value, 0.0) / w : 0.0;
+	}
+};
+
+struct collapse_t {
+	uint32_t from;
+	uint32_t to;
+	// the other side of a seam collapses along with it
+	uint32_t twinFrom;
+	uint32_t twinTo;
+	double error;
+};
+
+inline uint64_t makeEdge(uint32_t a, uint32_t b) {
+	return (static_cast<uint64_t>(a) << 32) | b;
+}
+
+inline bool hasEdge(const std::vector<uint64_t>& edges, uint32_t a, uint32_t b) {
+	return std::binary_search(edges.begin(), edges.end(), makeEdge(a, b));
+}
+
+// connectivity of the current index buffer, rebuilt before every pass
+struct topology_t {
+	// directed edges of all triangles, by vertex and by position
+	std::vector<uint64_t> edges;
+	std::vector<uint64_t> positionEdges;
+	// the other end of the open edge leaving / entering each vertex
+	std::vector<uint32_t> openOut;
+	std::vector<uint32_t> openIn;
+	// the next live vertex at the same position
+	std::vector<uint32_t> wedge;
+	std::vector<vertex_kind_t> kind;
+	// triangles around each vertex, vertex v owns triangles[offsets[v], offsets[v + 1])
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+
+	void build(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& positionIds,
+		size_t vertexCount) {
+		const size_t triangleCount = indices.size() / 3;
+
+		edges.clear();
+		positionEdges.clear();
+		for (size_t t = 0; t < triangleCount; ++t) {
+			for (int corner = 0; corner < 3; ++corner) {
+				const uint32_t a = indices[t * 3 + corner];
+				const uint32_t b = indices[t * 3 + (corner + 1) % 3];
+				edges.push_back(makeEdge(a, b));
+				positionEdges.push_back(makeEdge(positionIds[a], positionIds[b]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::sort(positionEdges.begin(), positionEdges.end());
+
+		kind.assign(vertexCount, Manifold);
+		// the same directed edge twice means a non-manifold fan
+		for (size_t i = 1; i < edges.size(); ++i) {
+			if (edges[i] == edges[i - 1]) {
+				kind[static_cast<uint32_t>(edges[i] >> 32)] = Locked;
+				kind[static_cast<uint32_t>(edges[i])] = Locked;
+			}
+		}
+
+		openOut.assign(vertexCount, noVertex);
+		openIn.assign(vertexCount, noVertex);
+		for (uint64_t edge : edges) {
+			const uint32_t a = static_cast<uint32_t>(edge >> 32);
+			const uint32_t b = static_cast<uint32_t>(edge);
+			if (!hasEdge(edges, b, a)) {
+				openOut[a] = openOut[a] == noVertex ? b : manyVertices;
+				openIn[b] = openIn[b] == noVertex ? a : manyVertices;
+			}
+		}
+
+		offsets.assign(vertexCount + 1, 0);
+		for (uint32_t v : indices) {
+			++offsets[v + 1];
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indices.size());
+		{
+			std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				triangles[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		// rings of the live vertices that share a position
+		std::vector<uint32_t> live;
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			if (offsets[v + 1] != offsets[v]) {
+				live.push_back(v);
+			}
+		}
+		std::sort(live.begin(), live.end(), [&](uint32_t lhs, uint32_t rhs) {
+			return positionIds[lhs] != positionIds[rhs] ? positionIds[lhs] < positionIds[rhs] : lhs < rhs;
+		});
+		wedge.assign(vertexCount, noVertex);
+		for (size_t i = 0; i < live.size();) {
+			size_t end = i + 1;
+			while (end < live.size() && positionIds[live[end]] == positionIds[live[i]]) {
+				++end;
+			}
+			for (size_t j = i; j < end; ++j) {
+				wedge[live[j]] = live[j + 1 < end ? j + 1 : i];
+			}
+			i = end;
+		}
+
+		auto isSingle = [](uint32_t v) {
+			return v != noVertex && v != manyVertices;
+		};
+		// an open edge whose reverse does not exist between the positions either
+		auto isBorderEdge = [&](uint32_t a, uint32_t b) {
+			return !hasEdge(positionEdges, positionIds[b], positionIds[a]);
+		};
+
+		for (uint32_t v : live) {
+			if (kind[v] == Locked) {
+				continue;
+			}
+
+			const uint32_t w = wedge[v];
+			if (w == v) {
+				if (openOut[v] == noVertex && openIn[v] == noVertex) {
+					kind[v] = Manifold;
+				}
+				else if (isSingle(openOut[v]) && isSingle(openIn[v]) &&
+					isBorderEdge(v, openOut[v]) && isBorderEdge(openIn[v], v)) {
+					kind[v] = Border;
+				}
+				else {
+					kind[v] = Locked;
+				}
+			}
+			else if (wedge[w] == v && kind[w] != Locked &&
+				isSingle(openOut[v]) && isSingle(openIn[v]) && isSingle(openOut[w]) && isSingle(openIn[w]) &&
+				positionIds[openOut[v]] == positionIds[openIn[w]] &&
+				positionIds[openIn[v]] == positionIds[openOut[w]]) {
+				kind[v] = Seam;
+			}
+			else {
+				kind[v] = Locked;
+			}
+		}
+
+		// a seam needs both of its sides
+		for (uint32_t v : live) {
+			if (kind[v] == Seam && kind[wedge[v]] != Seam) {
+				kind[v] = Locked;
+			}
+		}
+	}
+};
+
+// would moving `from` onto the position of `to` turn any of its remaining triangles over
+bool hasTriangleFlips(const topology_t& topology, const std::vector<uint32_t>& indices,
+	const std::vector<uint32_t>& positionIds, const std::vector<glm::dvec3>& positions,
+	uint32_t from, uint32_t to) {
+	const glm::dvec3& target = positions[to];
+	for (uint32_t i = topology.offsets[from]; i < topology.offsets[from + 1]; ++i) {
+		const uint32_t* triangle = &indices[topology.triangles[i] * 3];
+		glm::dvec3 before[3], after[3];
+		bool collapses = false;
+		for (int corner = 0; corner < 3; ++corner) {
+			before[corner] = positions[triangle[corner]];
+			after[corner] = triangle[corner] == from ? target : before[corner];
+			collapses |= positionIds[triangle[corner]] == positionIds[to];
+		}
+
+		// the triangles along the edge itself disappear
+		if (collapses) {
+			continue;
+		}
+
+		const glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		const glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= 0.0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+}
+
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float targetError,
+	float* resultError) {
+	if (resultError) {
+		*resultError = 0.0f;
+	}
+
+	// positions scaled into the unit cube, so errors are relative to the extent
+	glm::vec3 minimum(std::numeric_limits<float>::max());
+	glm::vec3 maximum(-std::numeric_limits<float>::max());
+	for (size_t i = 0; i < indexCount; ++i) {
+		minimum = glm::min(minimum, vertices[indices[i]].position);
+		maximum = glm::max(maximum, vertices[indices[i]].position);
+	}
+	const glm::vec3 extent = maximum - minimum;
+	const double scale = std::max(std::max(extent.x, extent.y), extent.z) > 0.0f ?
+		1.0 / std::max(std::max(extent.x, extent.y), extent.z) : 1.0;
+
+	std::vector<glm::dvec3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		positions[v] = (glm::dvec3(vertices[v].position) - glm::dvec3(minimum)) * scale;
+	}
+
+	// vertices at the same position share an id, the lowest vertex index among them
+	std::vector<uint32_t> positionIds(vertexCount);
+	{
+		std::vector<uint32_t> order(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			order[v] = v;
+		}
+		auto less = [&](uint32_t lhs, uint32_t rhs) {
+			const glm::vec3& a = vertices[lhs].position;
+			const glm::vec3& b = vertices[rhs].position;
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			if (a.z != b.z) return a.z < b.z;
+			return lhs < rhs;
+		};
+		std::sort(order.begin(), order.end(), less);
+		for (size_t i = 0; i < order.size(); ++i) {
+			const bool same = i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position;
+			positionIds[order[i]] = same ? positionIds[order[i - 1]] : order[i];
+		}
+	}
+
+	// drop triangles that are already degenerate
+	std::vector<uint32_t> current;
+	current.reserve(indexCount);
+	for (size_t t = 0; t < indexCount / 3; ++t) {
+		const uint32_t a = indices[t * 3 + 0], b = indices[t * 3 + 1], c = indices[t * 3 + 2];
+		if (positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c] && positionIds[c] != positionIds[a]) {
+			current.push_back(a);
+			current.push_back(b);
+			current.push_back(c);
+		}
+	}
+
+	topology_t topology;
+	topology.build(current, positionIds, vertexCount);
+
+	// plane quadrics per position, weighted by triangle area, plus planes
+	// standing on the open borders so that they do not erode
+	const double borderWeight = 10.0;
+	std::vector<quadric_t> quadrics(vertexCount);
+	for (size_t t = 0; t < current.size() / 3; ++t) {
+		const uint32_t* triangle = &current[t * 3];
+		const glm::dvec3& p0 = positions[triangle[0]];
+		glm::dvec3 normal = glm::cross(positions[triangle[1]] - p0, positions[triangle[2]] - p0);
+		const double length = glm::length(normal);
+		if (length == 0.0) {
+			continue;
+		}
+		normal /= length;
+
+		for (int corner = 0; corner < 3; ++corner) {
+			quadrics[positionIds[triangle[corner]]].addPlane(normal, -glm::dot(normal, p0), length * 0.5);
+		}
+
+		for (int corner = 0; corner < 3; ++corner) {
+			const uint32_t a = triangle[corner];
+			const uint32_t b = triangle[(corner + 1) % 3];
+			if (hasEdge(topology.positionEdges, positionIds[b], positionIds[a])) {
+				continue;
+			}
+
+			const glm::dvec3 edge = positions[b] - positions[a];
+			const glm::dvec3 edgeNormal = glm::cross(edge, normal);
+			const double edgeLength = glm::length(edgeNormal);
+			if (edgeLength == 0.0) {
+				continue;
+			}
+
+			const glm::dvec3 n = edgeNormal / edgeLength;
+			const double weight = glm::dot(edge, edge) * borderWeight;
+			quadrics[positionIds[a]].addPlane(n, -glm::dot(n, positions[a]), weight);
+			quadrics[positionIds[b]].addPlane(n, -glm::dot(n, positions[a]), weight);
+		}
+	}
+
+	const double maxError = static_cast<double>(targetError) * targetError;
+	double worstError = 0.0;
+
+	std::vector<collapse_t> collapses;
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<char> locked(vertexCount);
+	for (bool first = true; current.size() > targetIndexCount; first = false) {
+		if (!first) {
+			topology.build(current, positionIds, vertexCount);
+		}
+
+		// every direction of every edge that is allowed to collapse
+		collapses.clear();
+		for (size_t i = 0; i < current.size(); ++i) {
+			const uint32_t from = current[i];
+			const uint32_t to = current[i - i % 3 + (i + 1) % 3];
+			for (int direction = 0; direction < 2; ++direction) {
+				const uint32_t u = direction == 0 ? from : to;
+				const uint32_t v = direction == 0 ? to : from;
+
+				collapse_t collapse = { u, v, noVertex, noVertex, 0.0 };
+				switch (topology.kind[u]) {
+				case Manifold:
+					break;
+				case Border:
+					if (topology.openOut[u] != v && topology.openIn[u] != v) {
+						continue;
+					}
+					break;
+				case Seam:
+				{
+					const uint32_t twin = topology.wedge[u];
+					uint32_t twinTo = noVertex;
+					if (topology.openOut[u] == v) {
+						twinTo = topology.openIn[twin];
+					}
+					else if (topology.openIn[u] == v) {
+						twinTo = topology.openOut[twin];
+					}
+					if (twinTo == noVertex || positionIds[twinTo] != positionIds[v]) {
+						continue;
+					}
+					collapse.twinFrom = twin;
+					collapse.twinTo = twinTo;
+					break;
+				}
+				default:
+					continue;
+				}
+
+				collapse.error = quadrics[positionIds[u]].evaluate(positions[v]);
+				collapses.push_back(collapse);
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const collapse_t& lhs, const collapse_t& rhs) {
+			return lhs.error < rhs.error;
+		});
+
+		// apply the cheapest collapses whose neighbourhoods do not overlap
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			collapseRemap[v] = v;
+		}
+		std::fill(locked.begin(), locked.end(), 0);
+
+		const size_t triangleGoal = (current.size() - targetIndexCount) / 3;
+		size_t removedTriangles = 0;
+		size_t applied = 0;
+		for (const collapse_t& collapse : collapses) {
+			if (collapse.error > maxError || removedTriangles >= triangleGoal) {
+				break;
+			}
+
+			if (locked[positionIds[collapse.from]] || locked[positionIds[collapse.to]]) {
+				continue;
+			}
+
+			if (hasTriangleFlips(topology, current, positionIds, positions, collapse.from, collapse.to) ||
+				(collapse.twinFrom != noVertex &&
+					hasTriangleFlips(topology, current, positionIds, positions, collapse.twinFrom, collapse.twinTo))) {
+				continue;
+			}
+
+			collapseRemap[collapse.from] = collapse.to;
+			if (collapse.twinFrom != noVertex) {
+				collapseRemap[collapse.twinFrom] = collapse.twinTo;
+			}
+			quadrics[positionIds[collapse.to]].add(quadrics[positionIds[collapse.from]]);
+			worstError = std::max(worstError, collapse.error);
+
+			// nothing around the moved vertex may change again in this pass
+			const uint32_t moved[2] = { collapse.from, collapse.twinFrom };
+			for (uint32_t vertex : moved) {
+				if (vertex == noVertex) {
+					continue;
+				}
+				for (uint32_t i = topology.offsets[vertex]; i < topology.offsets[vertex + 1]; ++i) {
+					const uint32_t* triangle = &current[topology.triangles[i] * 3];
+					for (int corner = 0; corner < 3; ++corner) {
+						locked[positionIds[triangle[corner]]] = 1;
+					}
+				}
+			}
+			locked[positionIds[collapse.to]] = 1;
+
+			removedTriangles += topology.kind[collapse.from] == Border ? 1 : 2;
+			++applied;
+		}
+
+		if (applied == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < current.size() / 3; ++t) {
+			const uint32_t a = collapseRemap[current[t * 3 + 0]];
+			const uint32_t b = collapseRemap[current[t * 3 + 1]];
+			const uint32_t c = collapseRemap[current[t * 3 + 2]];
+			if (positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c] && positionIds[c] != positionIds[a]) {
+				current[write++] = a;
+				current[write++] = b;
+				current[write++] = c;
+			}
+		}
+		current.resize(write);
+	}
+
+	std::copy(current.begin(), current.end(), destination);
+	if (resultError) {
+		*resultError = static_cast<float>(std::sqrt(worstError));
+	}
+	return current.size();
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+#include "./base/vertex.h"
+
+// quadric error metric edge collapse (Garland & Heckbert 1997) restricted to
+// the existing vertices, so the result indexes the same vertex buffer.
+// vertices that share a position but differ in normal or texture coordinate
+// form seams, which like open borders only collapse along themselves, so
+// both keep their shape and attributes. collapses stop once the index count
+// reaches targetIndexCount, or when the next one would move the surface by
+// more than targetError, relative to the largest extent of the mesh.
+// writes at most indexCount indices to destination and returns how many,
+// resultError receives the largest error actually introduced
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount, size_t targetIndexCount, float targetError,
+	float* resultError = nullptr);
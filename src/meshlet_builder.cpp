@@ -0,0 +1,184 @@
+#include "meshlet_builder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const uint32_t noMeshlet = 0xffffffffu;
+
+// sphere around the vertices of a meshlet, centered on their bounding box
+void computeBoundingSphere(Meshlet* meshlet, const uint32_t* indices, const Vertex* vertices) {
+	glm::vec3 minimum = vertices[indices[0]].position;
+	glm::vec3 maximum = minimum;
+	for (uint32_t i = 1; i < meshlet->indexCount; ++i) {
+		minimum = glm::min(minimum, vertices[indices[i]].position);
+		maximum = glm::max(maximum, vertices[indices[i]].position);
+	}
+
+	meshlet->center = (minimum + maximum) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < meshlet->indexCount; ++i) {
+		radius = std::max(radius, glm::length(vertices[indices[i]].position - meshlet->center));
+	}
+	meshlet->radius = radius;
+}
+
+// the axis is the mean of the face normals, the cutoff follows from the
+// normal furthest from it, and the apex is moved back along the axis until
+// every triangle plane passes behind it
+void computeNormalCone(Meshlet* meshlet, const uint32_t* indices, const Vertex* vertices) {
+	const size_t triangleCount = meshlet->indexCount / 3;
+	std::vector<glm::vec3> normals(triangleCount);
+	glm::vec3 axis(0.0f);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+		const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+		const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+		const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(normal);
+		normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		axis += normals[t];
+	}
+
+	meshlet->coneCutoff = 1.0f;
+	const float axisLength = glm::length(axis);
+	if (axisLength == 0.0f) {
+		return;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const auto& normal : normals) {
+		if (normal != glm::vec3(0.0f)) {
+			minDot = std::min(minDot, glm::dot(normal, axis));
+		}
+	}
+
+	// a cone wider than about 84 degrees on each side culls almost never
+	if (minDot <= 0.1f) {
+		return;
+	}
+
+	float maxT = 0.0f;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		if (normals[t] == glm::vec3(0.0f)) {
+			continue;
+		}
+		const glm::vec3& p0 = vertices[indices[t * 3]].position;
+		maxT = std::max(maxT, glm::dot(meshlet->center - p0, normals[t]) / glm::dot(axis, normals[t]));
+	}
+
+	meshlet->coneApex = meshlet->center - axis * maxT;
+	meshlet->coneAxis = axis;
+	meshlet->coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+}
+
+std::vector<Meshlet> buildMeshlets(uint32_t* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount, size_t maxVertices, size_t maxTriangles) {
+	maxVertices = std::max<size_t>(maxVertices, 3);
+	maxTriangles = std::max<size_t>(maxTriangles, 1);
+	const size_t triangleCount = indexCount / 3;
+
+	// triangles around each vertex, vertex v owns adjacency[offsets[v], offsets[v + 1])
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		++offsets[indices[i] + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<char> emitted(triangleCount, 0);
+	// the meshlet a vertex was last added to
+	std::vector<uint32_t> owner(vertexCount, noMeshlet);
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> order;
+	order.reserve(triangleCount * 3);
+
+	std::vector<Meshlet> meshlets;
+	size_t next = 0;
+	while (true) {
+		while (next < triangleCount && emitted[next]) {
+			++next;
+		}
+		if (next == triangleCount) {
+			break;
+		}
+
+		const uint32_t id = static_cast<uint32_t>(meshlets.size());
+		Meshlet meshlet;
+		meshlet.firstIndex = static_cast<uint32_t>(order.size());
+		candidates.clear();
+
+		uint32_t triangle = static_cast<uint32_t>(next);
+		while (true) {
+			emitted[triangle] = 1;
+			for (int corner = 0; corner < 3; ++corner) {
+				const uint32_t v = indices[triangle * 3 + corner];
+				order.push_back(v);
+				if (owner[v] != id) {
+					owner[v] = id;
+					++meshlet.vertexCount;
+					candidates.insert(candidates.end(), adjacency.begin() + offsets[v], adjacency.begin() + offsets[v + 1]);
+				}
+			}
+			meshlet.indexCount += 3;
+			if (meshlet.indexCount / 3 == maxTriangles) {
+				break;
+			}
+
+			// the adjacent triangle adding the fewest vertices, oldest first
+			uint32_t best = noMeshlet;
+			size_t bestExtra = 4;
+			size_t write = 0;
+			for (size_t i = 0; i < candidates.size(); ++i) {
+				const uint32_t candidate = candidates[i];
+				if (emitted[candidate]) {
+					continue;
+				}
+				candidates[write++] = candidate;
+
+				size_t extra = 0;
+				for (int corner = 0; corner < 3; ++corner) {
+					extra += owner[indices[candidate * 3 + corner]] != id;
+				}
+				if (extra < bestExtra && meshlet.vertexCount + extra <= maxVertices) {
+					best = candidate;
+					bestExtra = extra;
+				}
+			}
+			candidates.resize(write);
+
+			if (best == noMeshlet) {
+				// islands are joined in input order while there is room
+				while (next < triangleCount && emitted[next]) {
+					++next;
+				}
+				if (!candidates.empty() || next == triangleCount || meshlet.vertexCount + 3 > maxVertices) {
+					break;
+				}
+				best = static_cast<uint32_t>(next);
+			}
+			triangle = best;
+		}
+
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(order.begin(), order.end(), indices);
+
+	for (auto& meshlet : meshlets) {
+		computeBoundingSphere(&meshlet, indices + meshlet.firstIndex, vertices);
+		computeNormalCone(&meshlet, indices + meshlet.firstIndex, vertices);
+	}
+
+	return meshlets;
+}
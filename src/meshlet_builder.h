@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./base/vertex.h"
+
+// a cluster of neighbouring triangles, small enough to be culled on its own.
+// its triangles are [firstIndex, firstIndex + indexCount) of the index buffer
+// it was built from, vertexCount is the number of distinct vertices they use
+struct Meshlet {
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	uint32_t vertexCount = 0;
+
+	// bounding sphere
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	// every triangle faces away from a viewer at p once
+	// dot(normalize(coneApex - p), coneAxis) >= coneCutoff. a cutoff of 1
+	// means the normals spread too far for the test to ever pass
+	glm::vec3 coneApex = glm::vec3(0.0f);
+	glm::vec3 coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	float coneCutoff = 1.0f;
+};
+
+// reorder the triangles into meshlets of at most maxVertices vertices and
+// maxTriangles triangles. a meshlet grows over the triangles adding the
+// fewest new vertices to it, and continues with the next triangle in the
+// input order when none is adjacent, so a vertex cache optimized input
+// gives compact meshlets. the returned ranges cover the whole buffer in order
+std::vector<Meshlet> buildMeshlets(uint32_t* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount, size_t maxVertices, size_t maxTriangles);
+
+// whether all the triangles of the meshlet face away from the viewer, both
+// given in the space of the vertices
+inline bool isMeshletBackfacing(const Meshlet& meshlet, const glm::vec3& viewer) {
+	if (meshlet.coneCutoff >= 1.0f) {
+		return false;
+	}
+
+	const glm::vec3 direction = meshlet.coneApex - viewer;
+	const float distance = glm::length(direction);
+	return distance > 0.0f && glm::dot(direction, meshlet.coneAxis) >= meshlet.coneCutoff * distance;
+}
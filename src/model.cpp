@@ -1,88 +1,695 @@
 #include <iostream>
 #include <limits>
-#include <unordered_map>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <unordered_map>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <glm/gtc/packing.hpp>
 
 #include "model.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "model_cache.h"
+#include "vertex_welder.h"
+#include "./base/gl_state.h"
+#include "./base/mapped_file.h"
+#include "./base/parallel.h"
 
 #define SSCANF_BUFFER_SIZE (4096)
 
-Model::Model(const std::string& filepath) {
+namespace {
+// tokenizer helpers for the mapped obj reader, every one of them is bounded
+// by the end of the current line instead of relying on a terminating '\0'
+
+// whitespace as understood by std::istream and sscanf("%s")
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// strspn(p, " \t")
+inline const char* skipBlank(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+// strspn(p, " \t\r")
+inline const char* skipBlankCr(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+// strcspn(p, "/ \t\r")
+inline const char* skipIndex(const char* p, const char* end) {
+    while (p < end && *p != '/' && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+    return p;
+}
+
+inline const char* skipSpace(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) ++p;
+    return p;
+}
+
+inline const char* skipNonSpace(const char* p, const char* end) {
+    while (p < end && !isSpace(*p)) ++p;
+    return p;
+}
+
+// split the next line on '\n', '\r\n' or a lone '\r' like safeGetline does,
+// returns where the following line starts
+inline const char* nextLine(const char* cursor, const char* end, const char** lineEnd) {
+    const char* newline = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+    const char* next = newline ? newline + 1 : end;
+    *lineEnd = newline ? newline : end;
+
+    const char* cr = static_cast<const char*>(memchr(cursor, '\r', *lineEnd - cursor));
+    if (cr) {
+        if (cr + 1 != *lineEnd) {
+            next = cr + 1;
+        }
+        *lineEnd = cr;
+    }
+
+    return next;
+}
+
+inline bool startsWithKeyword(const char* p, const char* end, const char* keyword, size_t len) {
+    return static_cast<size_t>(end - p) > len && 0 == strncmp(p, keyword, len) &&
+        (p[len] == ' ' || p[len] == '\t');
+}
+
+// atoi over [p, end)
+inline int parseInt(const char* p, const char* end) {
+    p = skipSpace(p, end);
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    int value = 0;
+    while (p < end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+
+    return negative ? -value : value;
+}
+
+// the exact std::istream extraction, only taken for inputs the fast path cannot
+// round correctly, so both readers always produce bit-identical floats
+bool parseFloatSlow(const char*& p, const char* end, float* value) {
+    std::istringstream in(std::string(p, end));
+    in.imbue(std::locale::classic());
+    in >> *value;
+    if (in.fail()) {
+        return false;
+    }
+
+    if (in.eof()) {
+        p = end;
+    }
+    else {
+        p += static_cast<std::streamoff>(in.tellg());
+    }
+
+    return true;
+}
+
+// locale-free equivalent of `std::istream >> float`; decimal mantissas of up to
+// 19 digits with a small exponent are exact in double, and rounding that double
+// to float is only ambiguous when it lands exactly on a float midpoint
+bool parseFloat(const char*& p, const char* end, float* value) {
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    p = skipSpace(p, end);
+    const char* s = p;
+
+    bool negative = false;
+    if (s < end && (*s == '+' || *s == '-')) {
+        negative = *s == '-';
+        ++s;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+
+    while (s < end && isDigit(*s)) {
+        mantissa = mantissa * 10 + (*s - '0');
+        if (mantissa != 0 && ++digits > 19) {
+            return parseFloatSlow(p, end, value);
+        }
+        anyDigit = true;
+        ++s;
+    }
+
+    if (s < end && *s == '.') {
+        ++s;
+        while (s < end && isDigit(*s)) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa != 0 && ++digits > 19) {
+                return parseFloatSlow(p, end, value);
+            }
+            --exponent;
+            anyDigit = true;
+            ++s;
+        }
+    }
+
+    if (!anyDigit) {
+        return parseFloatSlow(p, end, value);
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '+' || *e == '-')) {
+            negativeExponent = *e == '-';
+            ++e;
+        }
+
+        if (e == end || !isDigit(*e)) {
+            return parseFloatSlow(p, end, value);
+        }
+
+        int exp = 0;
+        while (e < end && isDigit(*e)) {
+            if (exp < 10000) exp = exp * 10 + (*e - '0');
+            ++e;
+        }
+
+        exponent += negativeExponent ? -exp : exp;
+        s = e;
+    }
+
+    if (mantissa == 0) {
+        *value = negative ? -0.0f : 0.0f;
+        p = s;
+        return true;
+    }
+
+    if (exponent < -22 || exponent > 22 || mantissa > (uint64_t(1) << 53)) {
+        return parseFloatSlow(p, end, value);
+    }
+
+    double d = static_cast<double>(mantissa);
+    d = exponent < 0 ? d / powersOf10[-exponent] : d * powersOf10[exponent];
+    if (d > std::numeric_limits<float>::max() || d < std::numeric_limits<float>::min()) {
+        return parseFloatSlow(p, end, value);
+    }
+
+    float f = static_cast<float>(d);
+    if (static_cast<double>(f) != d) {
+        float neighbor = std::nextafter(f, d > f ? std::numeric_limits<float>::max() : 0.0f);
+        if ((static_cast<double>(f) + static_cast<double>(neighbor)) * 0.5 == d) {
+            return parseFloatSlow(p, end, value);
+        }
+    }
+
+    *value = negative ? -f : f;
+    p = s;
+    return true;
+}
+
+// `in >> value` of the material reader, which leaves 0 when nothing parses
+inline void parseFloatOrZero(const char*& p, const char* end, float* value) {
+    if (!parseFloat(p, end, value)) {
+        *value = 0.0f;
+    }
+}
+
+inline void parseColor(const char* p, const char* end, float color[3]) {
+    for (int i = 0; i < 3; ++i) {
+        parseFloatOrZero(p, end, &color[i]);
+    }
+}
+
+Model::material_t makeDefaultMaterial() {
+    Model::material_t material;
+    material.name = "";
+    for (int i = 0; i < 3; i++) {
+        material.ka[i] = 0.f;
+        material.kd[i] = 0.f;
+        material.ks[i] = 0.f;
+        material.ke[i] = 0.f;
+    }
+    material.illum = 0;
+    material.ni = 1.f;
+    material.ns = 1.f;
+    material.d = 1.f;
+    return material;
+}
+
+// everything of a material but its name, equal keys look the same
+std::string materialContentKey(const Model::material_t& material) {
+    std::string key;
+    const auto append = [&key](const void* data, size_t size) {
+        key.append(static_cast<const char*>(data), size);
+    };
+
+    append(material.ka, sizeof(material.ka));
+    append(material.kd, sizeof(material.kd));
+    append(material.ks, sizeof(material.ks));
+    append(material.ke, sizeof(material.ke));
+    append(&material.ns, sizeof(material.ns));
+    append(&material.ni, sizeof(material.ni));
+    append(&material.d, sizeof(material.d));
+    append(&material.illum, sizeof(material.illum));
+    for (const auto& parameter : material.unknown_parameter) {
+        key += parameter.first;
+        key += '\0';
+        key += parameter.second;
+        key += '\0';
+    }
+
+    return key;
+}
+}
+
+// the background load of a Model. the worker fills the fields below the
+// mutex, updateLoad() takes the batches on the gl thread
+struct Model::async_load_t {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable uploadedCondition;
+
+    // set once the obj is parsed
+    bool parsed = false;
+    size_t cornerCount = 0;
+    size_t indexCapacity = 0;
+    BoundingBox boundingBox;
+    std::vector<material_t> materials;
+
+    // staging models of the shapes processed since the last updateLoad()
+    std::deque<std::unique_ptr<Model>> batches;
+    size_t processedCorners = 0;
+    // the last batch has been queued
+    bool finished = false;
+    std::string error;
+
+    // the gl thread holds every batch, the worker may write the cache
+    bool uploaded = false;
+    // the buffers the gl thread does not retain, handed over for the cache
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    bool cancelled = false;
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+};
+
+Model::Model() {}
+
+Model::Model(const std::string& filepath, const ModelLoadOptions& options)
+    : _cpuRetention(options.cpuRetention), _vertexFormat(options.vertexFormat) {
+    const std::string cachePath = ModelCache::getCachePath(filepath);
+    if (options.useCache && loadCache(cachePath, filepath, options)) {
+        return;
+    }
+
+    if (options.loadInBackground) {
+        _asyncLoad.reset(new async_load_t);
+        _asyncLoad->worker = std::thread(&Model::loadInBackground, this, filepath, options);
+        return;
+    }
+
     attrib_t attrib;
     std::vector<shape_t> shapes;
+    parseObj(filepath, options, &attrib, &shapes, &_materials);
+
+    processShapes(attrib, shapes, options);
+
+    if (options.useCache) {
+        std::string cacheErr;
+        if (!ModelCache::write(cachePath, filepath, _materialLibraries, getCacheVariant(options),
+            _vertices, _indices, _submeshes, _boundingBox, _materials, options.compressCache, &cacheErr, options.threads)) {
+            std::cerr << "WARN: mesh cache not written: " << cacheErr << std::endl;
+        }
+    }
+
+    initGLResources();
+
+    initBoxGLResources();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        cleanup();
+        throw std::runtime_error("OpenGL Error: " + std::to_string(error));
+    }
 
+    releaseCpuCopies();
+}
+
+void Model::parseObj(const std::string& filepath, const ModelLoadOptions& options,
+    attrib_t* attrib, std::vector<shape_t>* shapes, std::vector<material_t>* materials) {
     std::string err;
+    _materialLibraries.clear();
 
     std::string::size_type index = filepath.find_last_of("/");
     std::string mtlBaseDir = filepath.substr(0, index + 1);
 
     std::cout << "Loading obj: " << filepath << std::endl;
-    if (!LoadObj(&attrib, &shapes, &_materials, &err, filepath.c_str(), mtlBaseDir.c_str())) {
+    auto parseStart = std::chrono::high_resolution_clock::now();
+    bool loaded = false;
+    switch (options.objReader) {
+    case ModelLoadOptions::ObjReader::Stream:
+        loaded = LoadObj(attrib, shapes, materials, &err, filepath.c_str(), mtlBaseDir.c_str());
+        break;
+    case ModelLoadOptions::ObjReader::MemoryMapped:
+        loaded = LoadObjMapped(attrib, shapes, materials, &err, filepath.c_str(), mtlBaseDir.c_str());
+        break;
+    case ModelLoadOptions::ObjReader::ParallelMapped:
+        loaded = LoadObjParallel(attrib, shapes, materials, &err,
+            filepath.c_str(), mtlBaseDir.c_str(), options.threads);
+        break;
+    }
+    if (!loaded) {
         throw std::runtime_error("load " + filepath + " failure: " + err);
     }
+    auto parseEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Parsed obj in "
+        << std::chrono::duration<float, std::milli>(parseEnd - parseStart).count() << " ms" << std::endl;
 
     if (!err.empty()) {
         std::cerr << err << std::endl;
     }
 
-    std::vector<Vertex> vertices;
-    std::vector<VertexMaterial> vertex_material;
-    std::vector<uint32_t> indices;
-    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    if (options.generateNormals) {
+        generateMissingNormals(attrib, shapes, options);
+    }
+}
+
+void Model::generateMissingNormals(attrib_t* attrib, std::vector<shape_t>* shapes,
+    const ModelLoadOptions& options) {
+    // the triangles of all shapes back to back
+    std::vector<size_t> firstCorners(shapes->size() + 1, 0);
+    for (size_t i = 0; i < shapes->size(); ++i) {
+        firstCorners[i + 1] = firstCorners[i] + (*shapes)[i].mesh.indices.size();
+    }
+
+    std::vector<uint32_t> corners(firstCorners.back());
+    std::vector<char> missing(shapes->size(), 0);
+    parallelFor(shapes->size(), [&](size_t i) {
+        const auto& indices = (*shapes)[i].mesh.indices;
+        for (size_t c = 0; c < indices.size(); ++c) {
+            corners[firstCorners[i] + c] = static_cast<uint32_t>(indices[c].vertex_index);
+            missing[i] |= indices[c].normal_index < 0;
+        }
+    }, options.threads);
+
+    if (std::find(missing.begin(), missing.end(), 1) == missing.end()) {
+        return;
+    }
+
+    // every face takes part in the smoothing, only the corners without a
+    // normal get the generated ones
+    auto normalStart = std::chrono::high_resolution_clock::now();
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> cornerNormals;
+    generateNormals(attrib->vertices.data(), attrib->vertices.size() / 3, corners.data(), corners.size(),
+        glm::radians(options.normalCreaseAngle), options.normalWeighting, &normals, &cornerNormals, options.threads);
+
+    const int firstNormal = static_cast<int>(attrib->normals.size() / 3);
+    attrib->normals.resize(attrib->normals.size() + 3 * normals.size());
+    memcpy(attrib->normals.data() + 3 * firstNormal, normals.data(), normals.size() * sizeof(glm::vec3));
+
+    parallelFor(shapes->size(), [&](size_t i) {
+        if (!missing[i]) {
+            return;
+        }
+        auto& indices = (*shapes)[i].mesh.indices;
+        for (size_t c = 0; c < indices.size(); ++c) {
+            if (indices[c].normal_index < 0) {
+                indices[c].normal_index = firstNormal + static_cast<int>(cornerNormals[firstCorners[i] + c]);
+            }
+        }
+    }, options.threads);
+
+    auto normalEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Generated " << normals.size() << " normals for " << corners.size() / 3 << " triangles in "
+        << std::chrono::duration<float, std::milli>(normalEnd - normalStart).count() << " ms" << std::endl;
+}
+
+void Model::processShapes(const attrib_t& attrib, const std::vector<shape_t>& shapes,
+    const ModelLoadOptions& options) {
+    auto weldStart = std::chrono::high_resolution_clock::now();
+    weldVertices(attrib, shapes, options);
+    auto weldEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Welded " << _indices.size() << " corners into " << _vertices.size() << " vertices in "
+        << std::chrono::duration<float, std::milli>(weldEnd - weldStart).count() << " ms" << std::endl;
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            Vertex vertex{};
+    optimizeMesh(options);
 
-            vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
-            vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
-            vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
+    clusterMeshlets(options);
 
-            if (index.normal_index >= 0) {
-                vertex.normal.x = attrib.normals[3 * index.normal_index + 0];
-                vertex.normal.y = attrib.normals[3 * index.normal_index + 1];
-                vertex.normal.z = attrib.normals[3 * index.normal_index + 2];
+    buildLods(options);
+
+    computeBoundingBox();
+}
+
+void Model::loadInBackground(const std::string& filepath, const ModelLoadOptions& options) {
+    async_load_t& load = *_asyncLoad;
+    try {
+        attrib_t attrib;
+        std::vector<shape_t> shapes;
+        std::vector<material_t> materials;
+        parseObj(filepath, options, &attrib, &shapes, &materials);
+
+        // the box of the referenced positions is the box of the final
+        // vertices, the compact format quantizes every batch against it
+        BoundingBox boundingBox;
+        size_t cornerCount = 0;
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                const glm::vec3 position = getCornerVertex(attrib, index).position;
+                boundingBox.min = glm::min(boundingBox.min, position);
+                boundingBox.max = glm::max(boundingBox.max, position);
             }
+            cornerCount += shape.mesh.indices.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(load.mutex);
+            load.parsed = true;
+            load.cornerCount = cornerCount;
+            // welding only removes vertices, the index buffer grows when the lods need more
+            load.indexCapacity = options.lodLevels != 0 ? 2 * cornerCount : cornerCount;
+            load.boundingBox = boundingBox;
+            load.materials = std::move(materials);
+        }
 
-            if (index.texcoord_index >= 0) {
-                vertex.texCoord.x = attrib.texcoords[2 * index.texcoord_index + 0];
-                vertex.texCoord.y = attrib.texcoords[2 * index.texcoord_index + 1];
+        // whole shapes of at least batchCorners corners go through the
+        // same steps as a synchronous load, each into a staging model
+        const size_t batchCorners = 1 << 20;
+        std::vector<shape_t> batchShapes;
+        size_t batchSize = 0;
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            batchSize += shapes[i].mesh.indices.size();
+            batchShapes.push_back(std::move(shapes[i]));
+            if (batchSize < batchCorners && i + 1 < shapes.size()) {
+                continue;
             }
 
-            // check if the vertex appeared before to reduce redundant data
-            if (uniqueVertices.count(vertex) == 0) {
-                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                vertices.push_back(vertex);
-                // assume that materials for a certain object is uniform
-                vertex_material.push_back(VertexMaterial(vertex, shape.mesh.material_ids[0]));
+            std::unique_ptr<Model> batch(new Model());
+            batch->processShapes(attrib, batchShapes, options);
+
+            std::lock_guard<std::mutex> lock(load.mutex);
+            if (load.cancelled) {
+                return;
             }
+            load.batches.push_back(std::move(batch));
+            load.processedCorners += batchSize;
+            batchShapes.clear();
+            batchSize = 0;
+        }
 
-            indices.push_back(uniqueVertices[vertex]);
+        std::unique_lock<std::mutex> lock(load.mutex);
+        load.finished = true;
+        load.uploadedCondition.wait(lock, [&]() { return load.uploaded || load.cancelled; });
+        if (load.cancelled) {
+            return;
         }
     }
+    catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(load.mutex);
+        load.error = e.what();
+        return;
+    }
 
-    _vertices = vertices;
-    _vertex_material = vertex_material;
-    _indices = indices;
+    // the gl thread no longer modifies the buffers it retains
+    if (options.useCache) {
+        const bool retainsVertices = options.cpuRetention == ModelLoadOptions::CpuRetention::All;
+        const bool retainsIndices = options.cpuRetention != ModelLoadOptions::CpuRetention::None;
+        std::string cacheErr;
+        if (!ModelCache::write(ModelCache::getCachePath(filepath), filepath, _materialLibraries, getCacheVariant(options),
+            retainsVertices ? _vertices : load.vertices, retainsIndices ? _indices : load.indices,
+            _submeshes, _boundingBox, _materials, options.compressCache, &cacheErr, options.threads)) {
+            std::cerr << "WARN: mesh cache not written: " << cacheErr << std::endl;
+        }
+    }
+    std::vector<Vertex>().swap(load.vertices);
+    std::vector<uint32_t>().swap(load.indices);
+}
 
-    computeBoundingBox();
+bool Model::updateLoad() {
+    if (!_asyncLoad || _asyncLoad->uploaded) {
+        return true;
+    }
 
-    initGLResources();
+    async_load_t& load = *_asyncLoad;
+    std::deque<std::unique_ptr<Model>> batches;
+    bool finished = false;
+    {
+        std::lock_guard<std::mutex> lock(load.mutex);
+        if (!load.error.empty()) {
+            throw std::runtime_error(load.error);
+        }
+
+        if (load.parsed && _vao == 0) {
+            _boundingBox = load.boundingBox;
+            _materials = std::move(load.materials);
+            allocateGLResources(load.cornerCount, load.indexCapacity);
+        }
+
+        batches.swap(load.batches);
+        finished = load.finished;
+    }
+
+    for (auto& batch : batches) {
+        appendBatch(batch.get());
+        batch.reset();
+    }
+
+    if (!finished) {
+        return false;
+    }
+
+    // each batch is sorted by material on its own, sort the whole table so
+    // the submeshes of a material follow each other and are drawn in one run
+    std::stable_sort(_submeshes.begin(), _submeshes.end(), [](const Submesh& lhs, const Submesh& rhs) {
+        return lhs.material < rhs.material;
+    });
 
     initBoxGLResources();
 
     GLenum error = glGetError();
     if (error != GL_NO_ERROR) {
-        cleanup();
         throw std::runtime_error("OpenGL Error: " + std::to_string(error));
     }
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Streamed " << _submeshes.size() << " submeshes in "
+        << std::chrono::duration<float, std::milli>(loadEnd - load.start).count() << " ms" << std::endl;
+
+    {
+        // the worker writes the cache from what is not retained
+        std::lock_guard<std::mutex> lock(load.mutex);
+        releaseCpuCopies(&load.vertices, &load.indices);
+        load.uploaded = true;
+    }
+    load.uploadedCondition.notify_one();
+    return true;
+}
+
+bool Model::isLoading() const {
+    return _asyncLoad && !_asyncLoad->uploaded;
+}
+
+float Model::getLoadProgress() const {
+    if (!isLoading()) {
+        return 1.0f;
+    }
+
+    std::lock_guard<std::mutex> lock(_asyncLoad->mutex);
+    if (_asyncLoad->cornerCount == 0) {
+        return 0.0f;
+    }
+    return static_cast<float>(_asyncLoad->processedCorners) / static_cast<float>(_asyncLoad->cornerCount);
+}
+
+void Model::appendBatch(Model* batch) {
+    const uint32_t baseVertex = static_cast<uint32_t>(_vertices.size());
+    const uint32_t firstIndex = static_cast<uint32_t>(_indices.size());
+
+    // grow the index buffer by copying it into a larger one
+    const size_t indexCount = _indices.size() + batch->_indices.size();
+    if (indexCount > _indexCapacity) {
+        const size_t capacity = std::max(indexCount, _indexCapacity * 2);
+        GLuint ebo = 0;
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, _ebo);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _indices.size() * sizeof(uint32_t));
+        glDeleteBuffers(1, &_ebo);
+        _ebo = ebo;
+        _indexCapacity = capacity;
+
+        GLStateCache::get().bindVertexArray(_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+        GLStateCache::get().bindVertexArray(_depthVao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+        GLStateCache::get().bindVertexArray(0);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _vbo);
+    if (_vertexFormat == ModelLoadOptions::VertexFormat::Compact) {
+        const std::vector<CompactVertex> compact = quantizeVertices(
+            batch->_vertices.data(), batch->_vertices.size(), _boundingBox);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, baseVertex * sizeof(CompactVertex),
+            compact.size() * sizeof(CompactVertex), compact.data());
+        uploadPositions(baseVertex, compact.data(), compact.size());
+    }
+    else {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, baseVertex * sizeof(Vertex),
+            batch->_vertices.size() * sizeof(Vertex), batch->_vertices.data());
+        uploadPositions(baseVertex, batch->_vertices.data(), batch->_vertices.size());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(uint32_t),
+        batch->_indices.size() * sizeof(uint32_t), batch->_indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    _vertices.insert(_vertices.end(), batch->_vertices.begin(), batch->_vertices.end());
+    _indices.insert(_indices.end(), batch->_indices.begin(), batch->_indices.end());
+    for (auto& submesh : batch->_submeshes) {
+        submesh.baseVertex += baseVertex;
+        submesh.firstIndex += firstIndex;
+        for (auto& lod : submesh.lods) {
+            lod.firstIndex += firstIndex;
+        }
+        for (auto& meshlet : submesh.meshlets) {
+            meshlet.firstIndex += firstIndex;
+        }
+        _submeshes.push_back(std::move(submesh));
+    }
 }
 
-Model::Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
-    : _vertices(vertices), _indices(indices) {
+Model::Model(std::vector<Vertex> vertices, std::vector<uint32_t> indices)
+    : _vertices(std::move(vertices)), _indices(std::move(indices)) {
+
+    Submesh submesh;
+    submesh.indexCount = static_cast<uint32_t>(_indices.size());
+    submesh.vertexCount = static_cast<uint32_t>(_vertices.size());
+    _submeshes.push_back(submesh);
 
     computeBoundingBox();
 
@@ -97,22 +704,17 @@ Model::Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& i
     }
 }
 
-Model::Model(Model&& rhs) noexcept
-    : _vertices(std::move(rhs._vertices)),
-    _indices(std::move(rhs._indices)),
-    _boundingBox(std::move(rhs._boundingBox)),
-    _vao(rhs._vao), _vbo(rhs._vbo), _ebo(rhs._ebo),
-    _boxVao(rhs._boxVao), _boxVbo(rhs._boxVbo), _boxEbo(rhs._boxEbo) {
-    std::cerr << "Warning: Model::Model(Model&& rhs) is unsafe!" << std::endl;
-    rhs._vao = 0;
-    rhs._vbo = 0;
-    rhs._ebo = 0;
-    rhs._boxVao = 0;
-    rhs._boxVbo = 0;
-    rhs._boxEbo = 0;
-}
-
 Model::~Model() {
+    if (_asyncLoad) {
+        {
+            std::lock_guard<std::mutex> lock(_asyncLoad->mutex);
+            _asyncLoad->cancelled = !_asyncLoad->uploaded;
+        }
+        _asyncLoad->uploadedCondition.notify_one();
+        // a finished load may still be writing the cache
+        _asyncLoad->worker.join();
+    }
+
     cleanup();
 }
 
@@ -120,17 +722,181 @@ BoundingBox Model::getBoundingBox() const {
     return _boundingBox;
 }
 
-void Model::draw() const {
-    glBindVertexArray(_vao);
-    glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+ModelLoadOptions::VertexFormat Model::getVertexFormat() const {
+    return _vertexFormat;
+}
+
+void Model::draw(const MaterialBinder& bindMaterial) const {
+    for (const auto& submesh : _submeshes) {
+        appendDraw(submesh);
+    }
+    flushDraws(bindMaterial, _vao);
+}
+
+void Model::drawDepth() const {
+    for (const auto& submesh : _submeshes) {
+        appendDraw(submesh);
+    }
+    flushDraws(MaterialBinder(), _depthVao);
+}
+
+void Model::drawSubmeshes(const std::vector<uint32_t>& submeshes, const MaterialBinder& bindMaterial) const {
+    for (uint32_t id : submeshes) {
+        appendDraw(_submeshes[id]);
+    }
+    flushDraws(bindMaterial, _vao);
+}
+
+void Model::drawSubmeshes(const std::vector<uint32_t>& submeshes, const std::vector<uint32_t>& lods,
+    const MaterialBinder& bindMaterial) const {
+    for (size_t i = 0; i < submeshes.size(); ++i) {
+        appendDraw(_submeshes[submeshes[i]], lods[i]);
+    }
+    flushDraws(bindMaterial, _vao);
+}
+
+uint32_t Model::selectLod(uint32_t submesh, const PerspectiveCamera& camera,
+    float viewportHeight, float pixelError) const {
+    const Submesh& target = _submeshes[submesh];
+    if (target.lods.empty()) {
+        return 0;
+    }
+
+    // project the bounding sphere of the box from its nearest point
+    const glm::mat4 model = transform.getLocalMatrix();
+    const glm::vec3 center = glm::vec3(model * glm::vec4((target.boundingBox.min + target.boundingBox.max) * 0.5f, 1.0f));
+    const float scale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+        glm::length(glm::vec3(model[2])));
+    const glm::vec3 extent = (target.boundingBox.max - target.boundingBox.min) * scale;
+    const float distance = glm::length(center - camera.transform.position) - glm::length(extent) * 0.5f;
+    if (distance <= camera.znear) {
+        return 0;
+    }
+
+    const float projectedExtent = std::max(std::max(extent.x, extent.y), extent.z) /
+        (2.0f * distance * std::tan(camera.fovy * 0.5f)) * viewportHeight;
+
+    uint32_t lod = 0;
+    while (lod < target.lods.size() && target.lods[lod].error * projectedExtent <= pixelError) {
+        ++lod;
+    }
+    return lod;
+}
+
+void Model::drawMeshlets(const std::vector<uint32_t>& submeshes, const PerspectiveCamera& camera,
+    bool coneCulling, MeshletCullStats* stats, const MaterialBinder& bindMaterial) const {
+    // spheres are tested in world space, cones in model space where the
+    // meshlets were built
+    const Frustum frustum = camera.getFrustum();
+    const glm::mat4 model = transform.getLocalMatrix();
+    const float scale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+        glm::length(glm::vec3(model[2])));
+    const glm::vec3 viewer = glm::vec3(glm::inverse(model) * glm::vec4(camera.transform.position, 1.0f));
+
+    MeshletCullStats culled;
+    for (uint32_t id : submeshes) {
+        const Submesh& submesh = _submeshes[id];
+        if (submesh.meshlets.empty()) {
+            appendDraw(submesh);
+            continue;
+        }
+
+        // end of the range of this submesh queued last, to extend it with
+        // the next visible meshlet
+        bool rangeOpen = false;
+        uint32_t rangeEnd = 0;
+        for (const auto& meshlet : submesh.meshlets) {
+            const uint32_t triangles = meshlet.indexCount / 3;
+            ++culled.meshlets;
+            culled.triangles += triangles;
+
+            const glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center, 1.0f));
+            bool inside = true;
+            for (int i = 0; i < 6 && inside; ++i) {
+                inside = frustum.planes[i].getSignedDistanceToPoint(center) >= -meshlet.radius * scale;
+            }
+            if (!inside) {
+                ++culled.frustumCulledMeshlets;
+                culled.frustumCulledTriangles += triangles;
+                continue;
+            }
+
+            if (coneCulling && isMeshletBackfacing(meshlet, viewer)) {
+                ++culled.backfaceCulledMeshlets;
+                culled.backfaceCulledTriangles += triangles;
+                continue;
+            }
+
+            if (rangeOpen && rangeEnd == meshlet.firstIndex) {
+                _drawCounts.back() += static_cast<GLsizei>(meshlet.indexCount);
+            }
+            else {
+                _drawCounts.push_back(static_cast<GLsizei>(meshlet.indexCount));
+                _drawOffsets.push_back(reinterpret_cast<const void*>(meshlet.firstIndex * sizeof(uint32_t)));
+                _drawBaseVertices.push_back(static_cast<GLint>(submesh.baseVertex));
+                _drawMaterials.push_back(submesh.material);
+            }
+            rangeOpen = true;
+            rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+        }
+    }
+    flushDraws(bindMaterial, _vao);
+
+    if (stats) {
+        stats->meshlets += culled.meshlets;
+        stats->triangles += culled.triangles;
+        stats->frustumCulledMeshlets += culled.frustumCulledMeshlets;
+        stats->frustumCulledTriangles += culled.frustumCulledTriangles;
+        stats->backfaceCulledMeshlets += culled.backfaceCulledMeshlets;
+        stats->backfaceCulledTriangles += culled.backfaceCulledTriangles;
+    }
+}
+
+void Model::appendDraw(const Submesh& submesh, uint32_t lod) const {
+    const uint32_t firstIndex = lod == 0 ? submesh.firstIndex : submesh.lods[lod - 1].firstIndex;
+    const uint32_t indexCount = lod == 0 ? submesh.indexCount : submesh.lods[lod - 1].indexCount;
+    _drawCounts.push_back(static_cast<GLsizei>(indexCount));
+    _drawOffsets.push_back(reinterpret_cast<const void*>(firstIndex * sizeof(uint32_t)));
+    _drawBaseVertices.push_back(static_cast<GLint>(submesh.baseVertex));
+    _drawMaterials.push_back(submesh.material);
+}
+
+void Model::flushDraws(const MaterialBinder& bindMaterial, GLuint vao) const {
+    if (!_drawCounts.empty()) {
+        GLStateCache::get().bindVertexArray(vao);
+        // without a binder the material does not matter, all goes in one call
+        size_t first = 0;
+        while (first < _drawCounts.size()) {
+            size_t last = _drawCounts.size();
+            if (bindMaterial) {
+                last = first + 1;
+                while (last < _drawCounts.size() && _drawMaterials[last] == _drawMaterials[first]) {
+                    ++last;
+                }
+                bindMaterial(_drawMaterials[first]);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, _drawCounts.data() + first, GL_UNSIGNED_INT,
+                _drawOffsets.data() + first, static_cast<GLsizei>(last - first), _drawBaseVertices.data() + first);
+            first = last;
+        }
+        GLStateCache::get().bindVertexArray(0);
+    }
+
+    _drawCounts.clear();
+    _drawOffsets.clear();
+    _drawBaseVertices.clear();
+    _drawMaterials.clear();
 }
 
 void Model::drawBoundingBox() const {
+    if (_boxVao == 0) {
+        return;
+    }
+
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glBindVertexArray(_boxVao);
+    GLStateCache::get().bindVertexArray(_boxVao);
     glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
@@ -138,19 +904,38 @@ GLuint Model::getVao() const {
     return _vao;
 }
 
+GLuint Model::getDepthVao() const {
+    return _depthVao;
+}
+
 GLuint Model::getBoundingBoxVao() const {
     return _boxVao;
 }
 
 size_t Model::getVertexCount() const {
-    return _vertices.size();
+    // the submeshes cover the vertex buffer back to back
+    size_t vertexCount = 0;
+    for (const auto& submesh : _submeshes) {
+        vertexCount += submesh.vertexCount;
+    }
+    return vertexCount;
 }
 
 size_t Model::getFaceCount() const {
-    return _indices.size() / 3;
+    // the lod ranges repeat the same surface
+    size_t indexCount = 0;
+    for (const auto& submesh : _submeshes) {
+        indexCount += submesh.indexCount;
+    }
+    return indexCount / 3;
 }
 
 void Model::initGLResources() {
+    initGLResources(_vertices.data(), _vertices.size(), _indices.data(), _indices.size());
+}
+
+void Model::initGLResources(const Vertex* vertices, size_t vertexCount,
+    const uint32_t* indices, size_t indexCount) {
     // create a vertex array object
     glGenVertexArrays(1, &_vao);
     // create a vertex buffer object
@@ -158,46 +943,538 @@ void Model::initGLResources() {
     // create an element array buffer
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-        sizeof(VertexMaterial) * _vertex_material.size(), _vertex_material.data(), GL_STATIC_DRAW);
+    std::vector<CompactVertex> compact;
+    if (_vertexFormat == ModelLoadOptions::VertexFormat::Compact) {
+        compact = quantizeVertices(vertices, vertexCount, _boundingBox);
+        glBufferData(GL_ARRAY_BUFFER,
+            sizeof(CompactVertex) * vertexCount, compact.data(), GL_STATIC_DRAW);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER,
+            sizeof(Vertex) * vertexCount, vertices, GL_STATIC_DRAW);
+    }
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-        _indices.size() * sizeof(uint32_t), _indices.data(), GL_STATIC_DRAW);
+        indexCount * sizeof(uint32_t), indices, GL_STATIC_DRAW);
 
-    // specify layout, size of a vertex, data type, normalize, sizeof vertex array, offset of the attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexMaterial), (void*)offsetof(VertexMaterial, position));
+    setupVertexAttributes();
+    GLStateCache::get().bindVertexArray(0);
+
+    initDepthGLResources(vertexCount);
+    if (_vertexFormat == ModelLoadOptions::VertexFormat::Compact) {
+        uploadPositions(0, compact.data(), vertexCount);
+    }
+    else {
+        uploadPositions(0, vertices, vertexCount);
+    }
+}
+
+void Model::allocateGLResources(size_t vertexCapacity, size_t indexCapacity) {
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    glGenBuffers(1, &_ebo);
+
+    GLStateCache::get().bindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    const size_t stride = _vertexFormat == ModelLoadOptions::VertexFormat::Compact ?
+        sizeof(CompactVertex) : sizeof(Vertex);
+    glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(vertexCapacity, 1) * stride, nullptr, GL_STATIC_DRAW);
+
+    _indexCapacity = std::max<size_t>(indexCapacity, 1);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indexCapacity * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+
+    setupVertexAttributes();
+    GLStateCache::get().bindVertexArray(0);
+
+    initDepthGLResources(vertexCapacity);
+}
+
+void Model::initDepthGLResources(size_t vertexCapacity) {
+    glGenVertexArrays(1, &_depthVao);
+    glGenBuffers(1, &_positionVbo);
+
+    GLStateCache::get().bindVertexArray(_depthVao);
+    glBindBuffer(GL_ARRAY_BUFFER, _positionVbo);
+    if (_vertexFormat == ModelLoadOptions::VertexFormat::Compact) {
+        glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(vertexCapacity, 1) * sizeof(CompactPosition), nullptr, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactPosition), (void*)0);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER, std::max<size_t>(vertexCapacity, 1) * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    }
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexMaterial), (void*)offsetof(VertexMaterial, normal));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexMaterial), (void*)offsetof(VertexMaterial, texCoord));
-    glEnableVertexAttribArray(2);
-    glVertexAttribIPointer(3, 1, GL_INT, sizeof(VertexMaterial), (void*)offsetof(VertexMaterial, material_id));
-    glEnableVertexAttribArray(3);
-    glBindVertexArray(0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    GLStateCache::get().bindVertexArray(0);
 }
 
-void Model::computeBoundingBox() {
-    float minX = std::numeric_limits<float>::max();
-    float minY = std::numeric_limits<float>::max();
-    float minZ = std::numeric_limits<float>::max();
-    float maxX = -std::numeric_limits<float>::max();
-    float maxY = -std::numeric_limits<float>::max();
-    float maxZ = -std::numeric_limits<float>::max();
+void Model::uploadPositions(size_t firstVertex, const Vertex* vertices, size_t count) {
+    std::vector<glm::vec3> positions(count);
+    for (size_t i = 0; i < count; ++i) {
+        positions[i] = vertices[i].position;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _positionVbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * sizeof(glm::vec3),
+        count * sizeof(glm::vec3), positions.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Model::uploadPositions(size_t firstVertex, const CompactVertex* vertices, size_t count) {
+    static_assert(offsetof(CompactVertex, padding) == 3 * sizeof(uint16_t), "CompactVertex must start with the position and padding");
+
+    std::vector<CompactPosition> positions(count);
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(&positions[i], &vertices[i], sizeof(CompactPosition));
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _positionVbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * sizeof(CompactPosition),
+        count * sizeof(CompactPosition), positions.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Model::setupVertexAttributes() {
+    // specify layout, size of a vertex, data type, normalize, sizeof vertex array, offset of the attribute
+    if (_vertexFormat == ModelLoadOptions::VertexFormat::Compact) {
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoord));
+        glEnableVertexAttribArray(2);
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+    }
+}
+
+bool Model::loadCache(const std::string& cachePath, const std::string& filepath,
+    const ModelLoadOptions& options) {
+    auto loadStart = std::chrono::high_resolution_clock::now();
+
+    ModelCache cache;
+    std::string err;
+    if (!cache.open(cachePath, filepath, getCacheVariant(options), options.verifyCacheHash, &err, options.threads)) {
+        if (!err.empty()) {
+            std::cerr << err << std::endl;
+        }
+        return false;
+    }
+
+    std::cout << "Loading mesh cache: " << cachePath << std::endl;
+
+    _materials = cache.getMaterials();
+    _submeshes = cache.getSubmeshes();
+    _boundingBox = cache.getBoundingBox();
+
+    // the cpu side copies handed out by getVertices() and getIndices(),
+    // only what cpuRetention keeps is read out of the mapping
+    const Vertex* vertices = cache.getVertices();
+    if (_cpuRetention == ModelLoadOptions::CpuRetention::All) {
+        _vertices.assign(vertices, vertices + cache.getVertexCount());
+    }
+    else if (_cpuRetention == ModelLoadOptions::CpuRetention::Positions) {
+        _positions.resize(cache.getVertexCount());
+        for (size_t i = 0; i < _positions.size(); ++i) {
+            _positions[i] = vertices[i].position;
+        }
+    }
+    if (_cpuRetention != ModelLoadOptions::CpuRetention::None) {
+        _indices.assign(cache.getIndices(), cache.getIndices() + cache.getIndexCount());
+    }
+
+    // the gpu buffers are filled straight from the mapping, or from the
+    // buffers a compressed cache was decoded to
+    initGLResources(vertices, cache.getVertexCount(), cache.getIndices(), cache.getIndexCount());
+
+    initBoxGLResources();
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        cleanup();
+        throw std::runtime_error("OpenGL Error: " + std::to_string(error));
+    }
+
+    auto loadEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Loaded mesh cache in "
+        << std::chrono::duration<float, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+
+    releaseCpuCopies();
+
+    return true;
+}
+
+uint64_t Model::getCacheVariant(const ModelLoadOptions& options) {
+    // only the options that change the final buffers, the obj reader, the
+    // exact weld method and the thread count do not
+    std::vector<float> fields;
+    if (options.vertexWeld == ModelLoadOptions::VertexWeld::Tolerance) {
+        fields.push_back(options.weldPositionEpsilon);
+        fields.push_back(options.weldNormalAngle);
+        fields.push_back(options.weldTexCoordEpsilon);
+    }
+    else {
+        fields.push_back(0.0f);
+    }
+
+    fields.push_back(options.generateNormals ? 1.0f : 0.0f);
+    if (options.generateNormals) {
+        fields.push_back(static_cast<float>(options.normalWeighting));
+        fields.push_back(options.normalCreaseAngle);
+    }
+
+    fields.push_back(static_cast<float>(options.meshOptimization));
+    if (options.meshOptimization != ModelLoadOptions::MeshOptimization::None) {
+        fields.push_back(static_cast<float>(options.vertexCacheSize));
+    }
+    if (options.meshOptimization == ModelLoadOptions::MeshOptimization::VertexCacheOverdraw) {
+        fields.push_back(options.overdrawThreshold);
+    }
+
+    fields.push_back(static_cast<float>(options.lodLevels));
+    if (options.lodLevels != 0) {
+        fields.push_back(options.lodMaxError);
+    }
+
+    fields.push_back(options.buildMeshlets ? 1.0f : 0.0f);
+    if (options.buildMeshlets) {
+        fields.push_back(static_cast<float>(options.meshletMaxVertices));
+        fields.push_back(static_cast<float>(options.meshletMaxTriangles));
+    }
+
+    // a compressed cache reads back quantized vertices
+    fields.push_back(options.compressCache ? 1.0f : 0.0f);
+
+    uint64_t variant = 0xcbf29ce484222325ull;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(fields.data());
+    for (size_t i = 0; i < fields.size() * sizeof(float); ++i) {
+        variant = (variant ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return variant;
+}
+
+Vertex Model::getCornerVertex(const attrib_t& attrib, const index_t& index) {
+    Vertex vertex{};
+
+    vertex.position.x = attrib.vertices[3 * index.vertex_index + 0];
+    vertex.position.y = attrib.vertices[3 * index.vertex_index + 1];
+    vertex.position.z = attrib.vertices[3 * index.vertex_index + 2];
+
+    if (index.normal_index >= 0) {
+        vertex.normal.x = attrib.normals[3 * index.normal_index + 0];
+        vertex.normal.y = attrib.normals[3 * index.normal_index + 1];
+        vertex.normal.z = attrib.normals[3 * index.normal_index + 2];
+    }
+
+    if (index.texcoord_index >= 0) {
+        vertex.texCoord.x = attrib.texcoords[2 * index.texcoord_index + 0];
+        vertex.texCoord.y = attrib.texcoords[2 * index.texcoord_index + 1];
+    }
+
+    return vertex;
+}
+
+template <typename Welder>
+void Model::weldCorners(const attrib_t& attrib, const index_t* corners, size_t count, Welder* welder) {
+    for (size_t i = 0; i < count; ++i) {
+        _indices.push_back(welder->weld(getCornerVertex(attrib, corners[i])));
+    }
+
+    std::vector<Vertex> vertices = welder->releaseVertices();
+    if (_vertices.empty()) {
+        _vertices = std::move(vertices);
+    }
+    else {
+        _vertices.insert(_vertices.end(), vertices.begin(), vertices.end());
+    }
+}
+
+void Model::weldVertices(const attrib_t& attrib, const std::vector<shape_t>& shapes,
+    const ModelLoadOptions& options) {
+    // the runs of faces with the same material, split out of their shapes
+    // and stably sorted by material
+    struct run_t {
+        size_t shape;
+        size_t firstCorner;
+        size_t cornerCount;
+        int material;
+    };
+
+    std::vector<run_t> runs;
+    size_t cornerCount = 0;
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        const mesh_t& mesh = shapes[i].mesh;
+        const size_t faceCount = mesh.indices.size() / 3;
+        for (size_t face = 0; face < faceCount;) {
+            size_t end = face + 1;
+            while (end < faceCount && mesh.material_ids[end] == mesh.material_ids[face]) {
+                ++end;
+            }
+            runs.push_back({ i, 3 * face, 3 * (end - face), mesh.material_ids[face] });
+            face = end;
+        }
+        cornerCount += mesh.indices.size();
+    }
+    std::stable_sort(runs.begin(), runs.end(), [](const run_t& a, const run_t& b) {
+        return a.material < b.material;
+    });
+
+    _vertices.clear();
+    _indices.clear();
+    _submeshes.clear();
+    _indices.reserve(cornerCount);
+
+    std::vector<Vertex> corners;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> firstCorners;
+    for (const auto& run : runs) {
+        const index_t* runCorners = shapes[run.shape].mesh.indices.data() + run.firstCorner;
+
+        Submesh submesh;
+        submesh.name = shapes[run.shape].name;
+        submesh.firstIndex = static_cast<uint32_t>(_indices.size());
+        submesh.indexCount = static_cast<uint32_t>(run.cornerCount);
+        submesh.baseVertex = static_cast<uint32_t>(_vertices.size());
+        submesh.material = run.material;
+
+        switch (options.vertexWeld) {
+        case ModelLoadOptions::VertexWeld::Hash:
+        {
+            VertexWelder welder(run.cornerCount);
+            weldCorners(attrib, runCorners, run.cornerCount, &welder);
+            break;
+        }
+        case ModelLoadOptions::VertexWeld::Tolerance:
+        {
+            VertexToleranceWelder welder(run.cornerCount, options.weldPositionEpsilon,
+                glm::radians(options.weldNormalAngle), options.weldTexCoordEpsilon);
+            weldCorners(attrib, runCorners, run.cornerCount, &welder);
+            break;
+        }
+        case ModelLoadOptions::VertexWeld::ParallelSort:
+        {
+            corners.resize(run.cornerCount);
+            parallelForRange(run.cornerCount, 1 << 16, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    corners[i] = getCornerVertex(attrib, runCorners[i]);
+                }
+            }, options.threads);
+
+            VertexWelder::weldSorted(corners, &indices, &firstCorners, options.threads);
+            _indices.insert(_indices.end(), indices.begin(), indices.end());
+            for (uint32_t corner : firstCorners) {
+                _vertices.push_back(corners[corner]);
+            }
+            break;
+        }
+        }
+
+        submesh.vertexCount = static_cast<uint32_t>(_vertices.size() - submesh.baseVertex);
+        _submeshes.push_back(submesh);
+    }
+}
+
+void Model::optimizeMesh(const ModelLoadOptions& options) {
+    if (options.meshOptimization == ModelLoadOptions::MeshOptimization::None) {
+        return;
+    }
+
+    auto optimizeStart = std::chrono::high_resolution_clock::now();
+    const unsigned cacheSize = options.vertexCacheSize;
+    VertexCacheStats before, after;
+    std::vector<size_t> clusters;
+    std::vector<Vertex> vertices;
+    for (const auto& submesh : _submeshes) {
+        uint32_t* indices = _indices.data() + submesh.firstIndex;
+        Vertex* submeshVertices = _vertices.data() + submesh.baseVertex;
+
+        before += analyzeVertexCache(indices, submesh.indexCount, submesh.vertexCount, cacheSize);
+
+        optimizeVertexCache(indices, submesh.indexCount, submesh.vertexCount, cacheSize, &clusters);
+        if (options.meshOptimization == ModelLoadOptions::MeshOptimization::VertexCacheOverdraw) {
+            optimizeOverdraw(indices, submesh.indexCount, submeshVertices, submesh.vertexCount,
+                clusters, cacheSize, options.overdrawThreshold);
+        }
+
+        const std::vector<uint32_t> remap = optimizeVertexFetch(indices, submesh.indexCount, submesh.vertexCount);
+        vertices.resize(submesh.vertexCount);
+        for (size_t i = 0; i < remap.size(); ++i) {
+            vertices[remap[i]] = submeshVertices[i];
+        }
+        std::copy(vertices.begin(), vertices.end(), submeshVertices);
+
+        after += analyzeVertexCache(indices, submesh.indexCount, submesh.vertexCount, cacheSize);
+    }
+
+    auto optimizeEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Optimized mesh in "
+        << std::chrono::duration<float, std::milli>(optimizeEnd - optimizeStart).count() << " ms, "
+        << "ACMR " << before.getAcmr() << " -> " << after.getAcmr() << ", "
+        << "ATVR " << before.getAtvr() << " -> " << after.getAtvr() << std::endl;
+}
+
+void Model::clusterMeshlets(const ModelLoadOptions& options) {
+    if (!options.buildMeshlets) {
+        return;
+    }
+
+    auto clusterStart = std::chrono::high_resolution_clock::now();
+    std::vector<size_t> counts(_submeshes.size());
+    parallelFor(_submeshes.size(), [&](size_t i) {
+        Submesh& submesh = _submeshes[i];
+        submesh.meshlets = buildMeshlets(_indices.data() + submesh.firstIndex, submesh.indexCount,
+            _vertices.data() + submesh.baseVertex, submesh.vertexCount,
+            options.meshletMaxVertices, options.meshletMaxTriangles);
+        for (auto& meshlet : submesh.meshlets) {
+            meshlet.firstIndex += submesh.firstIndex;
+        }
+    }, options.threads);
+
+    size_t meshletCount = 0;
+    size_t triangleCount = 0;
+    size_t vertexCount = 0;
+    size_t coneCount = 0;
+    for (const auto& submesh : _submeshes) {
+        for (const auto& meshlet : submesh.meshlets) {
+            ++meshletCount;
+            triangleCount += meshlet.indexCount / 3;
+            vertexCount += meshlet.vertexCount;
+            coneCount += meshlet.coneCutoff < 1.0f;
+        }
+    }
+
+    auto clusterEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Built " << meshletCount << " meshlets in "
+        << std::chrono::duration<float, std::milli>(clusterEnd - clusterStart).count() << " ms, "
+        << static_cast<float>(triangleCount) / std::max<size_t>(meshletCount, 1) << " triangles and "
+        << static_cast<float>(vertexCount) / std::max<size_t>(meshletCount, 1) << " vertices on average, "
+        << coneCount << " with a normal cone" << std::endl;
+}
+
+void Model::buildLods(const ModelLoadOptions& options) {
+    if (options.lodLevels == 0) {
+        return;
+    }
+
+    auto lodStart = std::chrono::high_resolution_clock::now();
+
+    // every level is simplified from the previous one, so the error bound of
+    // a level is the sum of the errors of the steps leading to it
+    std::vector<std::vector<uint32_t>> lodIndices(_submeshes.size());
+    parallelFor(_submeshes.size(), [&](size_t i) {
+        Submesh& submesh = _submeshes[i];
+        const Vertex* vertices = _vertices.data() + submesh.baseVertex;
+        std::vector<uint32_t> source(_indices.begin() + submesh.firstIndex,
+            _indices.begin() + submesh.firstIndex + submesh.indexCount);
+        std::vector<uint32_t> simplified(source.size());
+        float error = 0.0f;
+        for (unsigned level = 0; level < options.lodLevels; ++level) {
+            const size_t target = source.size() / 6 * 3;
+            float stepError = 0.0f;
+            const size_t count = simplifyMesh(simplified.data(), source.data(), source.size(),
+                vertices, submesh.vertexCount, target, options.lodMaxError - error, &stepError);
+
+            // not worth another draw range below a 10% reduction
+            if (count == 0 || count > source.size() - source.size() / 10) {
+                break;
+            }
+
+            optimizeVertexCache(simplified.data(), count, submesh.vertexCount, options.vertexCacheSize);
+            error += stepError;
+
+            SubmeshLod lod;
+            lod.firstIndex = static_cast<uint32_t>(lodIndices[i].size());
+            lod.indexCount = static_cast<uint32_t>(count);
+            lod.error = error;
+            submesh.lods.push_back(lod);
+            lodIndices[i].insert(lodIndices[i].end(), simplified.begin(), simplified.begin() + count);
+
+            source.assign(simplified.begin(), simplified.begin() + count);
+        }
+    }, options.threads);
+
+    const size_t baseIndexCount = _indices.size();
+    for (size_t i = 0; i < _submeshes.size(); ++i) {
+        for (auto& lod : _submeshes[i].lods) {
+            lod.firstIndex += static_cast<uint32_t>(_indices.size());
+        }
+        _indices.insert(_indices.end(), lodIndices[i].begin(), lodIndices[i].end());
+    }
 
-    for (const auto& v : _vertices) {
-        minX = std::min(v.position.x, minX);
-        minY = std::min(v.position.y, minY);
-        minZ = std::min(v.position.z, minZ);
-        maxX = std::max(v.position.x, maxX);
-        maxY = std::max(v.position.y, maxY);
-        maxZ = std::max(v.position.z, maxZ);
+    auto lodEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Built lods in "
+        << std::chrono::duration<float, std::milli>(lodEnd - lodStart).count() << " ms, "
+        << (_indices.size() - baseIndexCount) / 3 << " triangles over "
+        << baseIndexCount / 3 << " base triangles" << std::endl;
+}
+
+std::vector<Model::CompactVertex> Model::quantizeVertices(const Vertex* vertices, size_t vertexCount,
+    const BoundingBox& boundingBox) {
+    static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes");
+
+    const glm::vec3 extent = boundingBox.max - boundingBox.min;
+    glm::vec3 scale(0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] > 0.0f) {
+            scale[axis] = 65535.0f / extent[axis];
+        }
+    }
+
+    std::vector<CompactVertex> compact(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const Vertex& vertex = vertices[i];
+        CompactVertex& out = compact[i];
+
+        const glm::vec3 position = glm::clamp((vertex.position - boundingBox.min) * scale, 0.0f, 65535.0f);
+        for (int axis = 0; axis < 3; ++axis) {
+            out.position[axis] = static_cast<uint16_t>(position[axis] + 0.5f);
+        }
+
+        out.padding = 0;
+
+        // fold the L1-normalized normal onto the z >= 0 half of the octahedron
+        glm::vec2 octahedral(0.0f);
+        const float l1 = std::abs(vertex.normal.x) + std::abs(vertex.normal.y) + std::abs(vertex.normal.z);
+        if (l1 > 0.0f) {
+            octahedral = glm::vec2(vertex.normal.x, vertex.normal.y) / l1;
+            if (vertex.normal.z < 0.0f) {
+                const glm::vec2 sign(octahedral.x >= 0.0f ? 1.0f : -1.0f, octahedral.y >= 0.0f ? 1.0f : -1.0f);
+                octahedral = (1.0f - glm::abs(glm::vec2(octahedral.y, octahedral.x))) * sign;
+            }
+        }
+        for (int axis = 0; axis < 2; ++axis) {
+            out.normal[axis] = static_cast<int16_t>(std::round(glm::clamp(octahedral[axis], -1.0f, 1.0f) * 32767.0f));
+        }
+
+        out.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+        out.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
     }
 
-    _boundingBox.min = glm::vec3(minX, minY, minZ);
-    _boundingBox.max = glm::vec3(maxX, maxY, maxZ);
+    return compact;
+}
+
+void Model::computeBoundingBox() {
+    _boundingBox = BoundingBox();
+    for (auto& submesh : _submeshes) {
+        submesh.boundingBox = BoundingBox();
+        for (uint32_t i = 0; i < submesh.vertexCount; ++i) {
+            const glm::vec3& position = _vertices[submesh.baseVertex + i].position;
+            submesh.boundingBox.min = glm::min(submesh.boundingBox.min, position);
+            submesh.boundingBox.max = glm::max(submesh.boundingBox.max, position);
+        }
+        _boundingBox += submesh.boundingBox;
+    }
 }
 
 void Model::initBoxGLResources() {
@@ -231,7 +1508,7 @@ void Model::initBoxGLResources() {
     glGenBuffers(1, &_boxVbo);
     glGenBuffers(1, &_boxEbo);
 
-    glBindVertexArray(_boxVao);
+    GLStateCache::get().bindVertexArray(_boxVao);
     glBindBuffer(GL_ARRAY_BUFFER, _boxVbo);
     glBufferData(GL_ARRAY_BUFFER, boxVertices.size() * sizeof(glm::vec3), boxVertices.data(), GL_STATIC_DRAW);
 
@@ -241,7 +1518,45 @@ void Model::initBoxGLResources() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
+}
+
+void Model::releaseCpuCopies(std::vector<Vertex>* releasedVertices, std::vector<uint32_t>* releasedIndices) {
+    if (_cpuRetention == ModelLoadOptions::CpuRetention::Positions && !_vertices.empty()) {
+        _positions.resize(_vertices.size());
+        for (size_t i = 0; i < _vertices.size(); ++i) {
+            _positions[i] = _vertices[i].position;
+        }
+    }
+
+    // swap with empty vectors, clear() keeps the capacity
+    if (_cpuRetention != ModelLoadOptions::CpuRetention::All) {
+        std::vector<Vertex> vertices;
+        vertices.swap(_vertices);
+        if (releasedVertices) {
+            *releasedVertices = std::move(vertices);
+        }
+    }
+    if (_cpuRetention == ModelLoadOptions::CpuRetention::None) {
+        std::vector<uint32_t> indices;
+        indices.swap(_indices);
+        if (releasedIndices) {
+            *releasedIndices = std::move(indices);
+        }
+    }
+
+    std::cout << "Keeping " << getMemoryUsage() / 1024 << " KB of mesh data on the cpu" << std::endl;
+}
+
+size_t Model::getMemoryUsage() const {
+    size_t bytes = _vertices.capacity() * sizeof(Vertex)
+        + _indices.capacity() * sizeof(uint32_t)
+        + _positions.capacity() * sizeof(glm::vec3)
+        + _submeshes.capacity() * sizeof(Submesh);
+    for (const auto& submesh : _submeshes) {
+        bytes += submesh.lods.capacity() * sizeof(SubmeshLod) + submesh.meshlets.capacity() * sizeof(Meshlet);
+    }
+    return bytes;
 }
 
 void Model::cleanup() {
@@ -256,10 +1571,22 @@ void Model::cleanup() {
     }
 
     if (_boxVao) {
+        GLStateCache::get().forgetVertexArray(_boxVao);
         glDeleteVertexArrays(1, &_boxVao);
         _boxVao = 0;
     }
 
+    if (_positionVbo != 0) {
+        glDeleteBuffers(1, &_positionVbo);
+        _positionVbo = 0;
+    }
+
+    if (_depthVao != 0) {
+        GLStateCache::get().forgetVertexArray(_depthVao);
+        glDeleteVertexArrays(1, &_depthVao);
+        _depthVao = 0;
+    }
+
     if (_ebo != 0) {
         glDeleteBuffers(1, &_ebo);
         _ebo = 0;
@@ -271,6 +1598,7 @@ void Model::cleanup() {
     }
 
     if (_vao != 0) {
+        GLStateCache::get().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
@@ -304,7 +1632,7 @@ bool Model::LoadObj(attrib_t* attrib, std::vector<shape_t>* shapes,
     std::vector<float> v;
     std::vector<float> vn;
     std::vector<float> vt;
-    std::vector<std::vector<vertex_index> > faceGroup;
+    face_group_t faceGroup;
     std::string name;
 
     std::map<std::string, int> material_map;
@@ -338,396 +1666,967 @@ bool Model::LoadObj(attrib_t* attrib, std::vector<shape_t>* shapes,
         assert(token);
         if (token[0] == '\0') continue;  // empty line
 
-        if (token[0] == '#') continue;  // comment line
+        if (token[0] == '#') continue;  // comment line
+
+        // vertex
+        if (token[0] == 'v' && (token[1] == ' ' || token[1] == '\t')) {
+            token += 2;
+            float x, y, z;
+            std::istringstream in(token);
+            in >> x >> y >> z;
+            v.push_back(x);
+            v.push_back(y);
+            v.push_back(z);
+            continue;
+        }
+
+        // normal
+        if (token[0] == 'v' && token[1] == 'n' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float x, y, z;
+            std::istringstream in(token);
+            in >> x >> y >> z;
+            vn.push_back(x);
+            vn.push_back(y);
+            vn.push_back(z);
+            continue;
+        }
+
+        // texcoord
+        if (token[0] == 'v' && token[1] == 't' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float x, y;
+            std::istringstream in(token);
+            in >> x >> y;
+            vt.push_back(x);
+            vt.push_back(y);
+            continue;
+        }
+
+        // face
+        if (token[0] == 'f' && (token[1] == ' ' || token[1] == '\t')) {
+            token += 2;
+            token += strspn(token, " \t");
+
+            while (!((token[0] == '\r') || (token[0] == '\n') || (token[0] == '\0'))) {
+                vertex_index vi(-1);
+                int vsize = static_cast<int>(v.size() / 3);
+                int vnsize = static_cast<int>(vn.size() / 3);
+                int vtsize = static_cast<int>(vt.size() / 2);
+                vi.v_idx = fixIndex(atoi((token)), vsize);
+                token += strcspn((token), "/ \t\r");
+                if ((token)[0] != '/') {
+                    faceGroup.corners.push_back(vi);
+                    size_t n = strspn(token, " \t\r");
+                    token += n;
+                    continue;
+                }
+                token++;
+
+                // i//k
+                if (token[0] == '/') {
+                    token++;
+                    vi.vn_idx = fixIndex(atoi(token), vnsize);
+                    token += strcspn(token, "/ \t\r");
+                    faceGroup.corners.push_back(vi);
+                    size_t n = strspn(token, " \t\r");
+                    token += n;
+                    continue;
+                }
+
+                // i/j/k or i/j
+                vi.vt_idx = fixIndex(atoi(token), vtsize);
+                token += strcspn(token, "/ \t\r");
+                if (token[0] != '/') {
+                    faceGroup.corners.push_back(vi);
+                    size_t n = strspn(token, " \t\r");
+                    token += n;
+                    continue;
+                }
+
+                // i/j/k
+                token++;  // skip '/'
+                vi.vn_idx = fixIndex(atoi(token), vnsize);
+                token += strcspn(token, "/ \t\r");
+                faceGroup.corners.push_back(vi);
+                size_t n = strspn(token, " \t\r");
+                token += n;
+            }
+
+            faceGroup.endFace();
+
+            continue;
+        }
+
+        // use mtl
+        if ((0 == strncmp(token, "usemtl", 6)) && (token[6] == ' ' || token[6] == '\t')) {
+            char namebuf[SSCANF_BUFFER_SIZE];
+            token += 7;
+            std::sscanf(token, "%s", namebuf);
+            int newMaterialId = -1;
+            if (material_map.find(namebuf) != material_map.end()) {
+                newMaterialId = material_map[namebuf];
+            }
+            else {
+                // { error!! material not found }
+            }
+
+            if (newMaterialId != material) {
+                if (!faceGroup.empty())
+                {
+                    flushFaceGroup(faceGroup, material, &shape);
+                    shape.name = name;
+                    shapes->push_back(std::move(shape));
+                }
+                shape = shape_t();
+
+                faceGroup.clear();
+                material = newMaterialId;
+            }
+
+            continue;
+        }
+
+        // load mtl
+        if ((0 == strncmp(token, "mtllib", 6)) && (token[6] == ' ' || token[6] == '\t')) {
+            loadMaterialLibraries(token + 7, baseDir, materials, &material_map, &_materialLibraries, err);
+
+            continue;
+        }
+
+        // group name
+        if (token[0] == 'g' && (token[1] == ' ' || token[1] == '\t')) {
+            // flush previous face group.
+            if (!faceGroup.empty())
+            {
+                flushFaceGroup(faceGroup, material, &shape);
+                shape.name = name;
+
+                shapes->push_back(std::move(shape));
+            }
+
+            shape = shape_t();
+
+            // material = -1;
+            faceGroup.clear();
+
+            std::vector<std::string> names;
+            names.reserve(2);
+
+            while (!((token[0] == '\r') || (token[0] == '\n') || (token[0] == '\0'))) {
+                std::string s;
+                token += strspn(token, " \t");
+                size_t e = strcspn(token, " \t\r");
+                s = std::string(token, &token[e]);
+                token += e;
+                names.push_back(s);
+                token += strspn(token, " \t\r");  // skip tag
+            }
+
+            assert(names.size() > 0);
+
+            // names[0] must be 'g', so skip the 0th element.
+            if (names.size() > 1) {
+                name = names[1];
+            }
+            else {
+                name = "";
+            }
+
+            continue;
+        }
+
+        // object name
+        if (token[0] == 'o' && (token[1] == ' ' || token[1] == '\t')) {
+            // flush previous face group.
+            if (!faceGroup.empty())
+            {
+                flushFaceGroup(faceGroup, material, &shape);
+                shape.name = name;
+
+                shapes->push_back(std::move(shape));
+            }
+
+            // material = -1;
+            faceGroup.clear();
+            shape = shape_t();
+
+            // @todo { multiple object name? }
+            char namebuf[SSCANF_BUFFER_SIZE];
+            token += 2;
+            std::sscanf(token, "%s", namebuf);
+            name = std::string(namebuf);
+
+            continue;
+        }
+    }
+
+    if (!faceGroup.empty())
+    {
+        flushFaceGroup(faceGroup, material, &shape);
+        shape.name = name;
+    }
+    if (faceGroup.empty() || shape.mesh.indices.size()) {
+        shapes->push_back(std::move(shape));
+    }
+    faceGroup.clear();  // for safety
+
+    if (err) {
+        (*err) += errss.str();
+    }
+
+    attrib->vertices.swap(v);
+    attrib->normals.swap(vn);
+    attrib->texcoords.swap(vt);
+
+    return true;
+}
+
+bool Model::LoadObjMapped(attrib_t* attrib, std::vector<shape_t>* shapes,
+    std::vector<material_t>* materials, std::string* err,
+    const char* filename, const char* mtl_basedir)
+{
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    shapes->clear();
+
+    std::stringstream errss;
+
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        errss << "Cannot open file [" << filename << "]" << std::endl;
+        if (err) {
+            (*err) = errss.str();
+        }
+        return false;
+    }
+
+    std::string baseDir;
+    if (mtl_basedir) {
+        baseDir = mtl_basedir;
+    }
+
+    std::vector<float> v;
+    std::vector<float> vn;
+    std::vector<float> vt;
+    face_group_t faceGroup;
+    std::string name;
+
+    std::map<std::string, int> material_map;
+    int material = -1;
+
+    shape_t shape;
+
+    const char* cursor = file.data();
+    const char* const fileEnd = cursor + file.size();
+    while (cursor < fileEnd) {
+        const char* lineEnd;
+        const char* next = nextLine(cursor, fileEnd, &lineEnd);
+
+        // Skip leading space.
+        const char* token = skipBlank(cursor, lineEnd);
+        cursor = next;
+
+        if (token == lineEnd) continue;  // empty line
+
+        if (token[0] == '#') continue;  // comment line
+
+        const ptrdiff_t length = lineEnd - token;
+
+        // vertex
+        if (length > 1 && token[0] == 'v' && (token[1] == ' ' || token[1] == '\t')) {
+            token += 2;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            parseFloat(token, lineEnd, &x) && parseFloat(token, lineEnd, &y) && parseFloat(token, lineEnd, &z);
+            v.push_back(x);
+            v.push_back(y);
+            v.push_back(z);
+            continue;
+        }
+
+        // normal
+        if (length > 2 && token[0] == 'v' && token[1] == 'n' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            parseFloat(token, lineEnd, &x) && parseFloat(token, lineEnd, &y) && parseFloat(token, lineEnd, &z);
+            vn.push_back(x);
+            vn.push_back(y);
+            vn.push_back(z);
+            continue;
+        }
+
+        // texcoord
+        if (length > 2 && token[0] == 'v' && token[1] == 't' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float x = 0.0f, y = 0.0f;
+            parseFloat(token, lineEnd, &x) && parseFloat(token, lineEnd, &y);
+            vt.push_back(x);
+            vt.push_back(y);
+            continue;
+        }
+
+        // face
+        if (length > 1 && token[0] == 'f' && (token[1] == ' ' || token[1] == '\t')) {
+            token += 2;
+
+            parseFace(token, lineEnd, static_cast<int>(v.size() / 3),
+                static_cast<int>(vn.size() / 3), static_cast<int>(vt.size() / 2), &faceGroup.corners);
+            faceGroup.endFace();
+
+            continue;
+        }
+
+        // use mtl
+        if (startsWithKeyword(token, lineEnd, "usemtl", 6)) {
+            token = skipSpace(token + 7, lineEnd);
+            std::string materialName(token, skipNonSpace(token, lineEnd));
+            int newMaterialId = -1;
+            auto iter = material_map.find(materialName);
+            if (iter != material_map.end()) {
+                newMaterialId = iter->second;
+            }
+            else {
+                // { error!! material not found }
+            }
+
+            if (newMaterialId != material) {
+                if (!faceGroup.empty()) {
+                    flushFaceGroup(faceGroup, material, &shape);
+                    shape.name = name;
+                    shapes->push_back(std::move(shape));
+                }
+                shape = shape_t();
+
+                faceGroup.clear();
+                material = newMaterialId;
+            }
+
+            continue;
+        }
+
+        // load mtl
+        if (startsWithKeyword(token, lineEnd, "mtllib", 6)) {
+            loadMaterialLibraries(std::string(token + 7, lineEnd), baseDir, materials, &material_map, &_materialLibraries, err);
+            continue;
+        }
+
+        // group name
+        if (length > 1 && token[0] == 'g' && (token[1] == ' ' || token[1] == '\t')) {
+            // flush previous face group.
+            if (!faceGroup.empty()) {
+                flushFaceGroup(faceGroup, material, &shape);
+                shape.name = name;
+                shapes->push_back(std::move(shape));
+            }
+
+            shape = shape_t();
+            faceGroup.clear();
+
+            // the first name after the 'g' tag is the group name
+            token = skipBlankCr(skipIndex(token, lineEnd), lineEnd);
+            const char* nameEnd = token;
+            while (nameEnd < lineEnd && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r') ++nameEnd;
+            name.assign(token, nameEnd);
+
+            continue;
+        }
+
+        // object name
+        if (length > 1 && token[0] == 'o' && (token[1] == ' ' || token[1] == '\t')) {
+            // flush previous face group.
+            if (!faceGroup.empty()) {
+                flushFaceGroup(faceGroup, material, &shape);
+                shape.name = name;
+                shapes->push_back(std::move(shape));
+            }
+
+            faceGroup.clear();
+            shape = shape_t();
+
+            // @todo { multiple object name? }
+            token = skipSpace(token + 2, lineEnd);
+            name.assign(token, skipNonSpace(token, lineEnd));
+
+            continue;
+        }
+    }
+
+    if (!faceGroup.empty()) {
+        flushFaceGroup(faceGroup, material, &shape);
+        shape.name = name;
+    }
+    if (faceGroup.empty() || shape.mesh.indices.size()) {
+        shapes->push_back(std::move(shape));
+    }
+
+    if (err) {
+        (*err) += errss.str();
+    }
+
+    attrib->vertices.swap(v);
+    attrib->normals.swap(vn);
+    attrib->texcoords.swap(vt);
+
+    return true;
+}
+
+bool Model::StreamObj(const std::string& filepath, const ObjStreamHandler& handler,
+    std::vector<material_t>* materials, std::vector<std::string>* libraries, std::string* err)
+{
+    std::stringstream errss;
+
+    MappedFile file(filepath);
+    if (!file.isOpen()) {
+        errss << "Cannot open file [" << filepath << "]" << std::endl;
+        if (err) {
+            (*err) = errss.str();
+        }
+        return false;
+    }
+
+    const std::string baseDir = filepath.substr(0, filepath.find_last_of("/") + 1);
+
+    // the counts resolve relative indices, as the attributes are not kept
+    int vertexCount = 0, normalCount = 0, texcoordCount = 0;
+    std::vector<vertex_index> face;
+    std::vector<index_t> triangles;
+
+    std::map<std::string, int> material_map;
+    int material = -1;
+
+    const char* cursor = file.data();
+    const char* const fileEnd = cursor + file.size();
+    while (cursor < fileEnd) {
+        const char* lineEnd;
+        const char* next = nextLine(cursor, fileEnd, &lineEnd);
+        const char* token = skipBlank(cursor, lineEnd);
+        cursor = next;
+
+        if (token == lineEnd || token[0] == '#') continue;
+
+        const ptrdiff_t length = lineEnd - token;
+
+        // vertex
+        if (length > 1 && token[0] == 'v' && (token[1] == ' ' || token[1] == '\t')) {
+            token += 2;
+            float xyz[3] = { 0.0f, 0.0f, 0.0f };
+            parseFloat(token, lineEnd, &xyz[0]) && parseFloat(token, lineEnd, &xyz[1]) && parseFloat(token, lineEnd, &xyz[2]);
+            ++vertexCount;
+            if (handler.position) handler.position(xyz);
+            continue;
+        }
+
+        // normal
+        if (length > 2 && token[0] == 'v' && token[1] == 'n' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float xyz[3] = { 0.0f, 0.0f, 0.0f };
+            parseFloat(token, lineEnd, &xyz[0]) && parseFloat(token, lineEnd, &xyz[1]) && parseFloat(token, lineEnd, &xyz[2]);
+            ++normalCount;
+            if (handler.normal) handler.normal(xyz);
+            continue;
+        }
+
+        // texcoord
+        if (length > 2 && token[0] == 'v' && token[1] == 't' && (token[2] == ' ' || token[2] == '\t')) {
+            token += 3;
+            float uv[2] = { 0.0f, 0.0f };
+            parseFloat(token, lineEnd, &uv[0]) && parseFloat(token, lineEnd, &uv[1]);
+            ++texcoordCount;
+            if (handler.texCoord) handler.texCoord(uv);
+            continue;
+        }
+
+        // face
+        if (length > 1 && token[0] == 'f' && (token[1] == ' ' || token[1] == '\t')) {
+            face.clear();
+            parseFace(token + 2, lineEnd, vertexCount, normalCount, texcoordCount, &face);
+            if (face.size() >= 3 && handler.triangle) {
+                triangles.resize(3 * (face.size() - 2));
+                triangulateFace(face.data(), face.size(), triangles.data());
+                for (size_t t = 0; t < triangles.size(); t += 3) {
+                    handler.triangle(triangles.data() + t, material);
+                }
+            }
+            continue;
+        }
+
+        // use mtl
+        if (startsWithKeyword(token, lineEnd, "usemtl", 6)) {
+            token = skipSpace(token + 7, lineEnd);
+            auto iter = material_map.find(std::string(token, skipNonSpace(token, lineEnd)));
+            material = iter != material_map.end() ? iter->second : -1;
+            continue;
+        }
+
+        // load mtl
+        if (startsWithKeyword(token, lineEnd, "mtllib", 6)) {
+            loadMaterialLibraries(std::string(token + 7, lineEnd), baseDir, materials, &material_map, libraries, err);
+            continue;
+        }
+    }
+
+    if (err) {
+        (*err) += errss.str();
+    }
+
+    return true;
+}
+
+struct Model::obj_chunk_t {
+    enum class record_t { Faces, UseMtl, Group, Object, MtlLib };
+
+    // a run of consecutive faces, or a state change to replay in file order
+    struct event_t {
+        record_t type;
+        size_t faceCount;
+        size_t triangleBegin;
+        size_t triangleEnd;
+        std::string text;
+    };
+
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    // filled by the counting pass, the bases are prefix sums over the chunks
+    size_t vertexCount = 0;
+    size_t normalCount = 0;
+    size_t texcoordCount = 0;
+    size_t vertexBase = 0;
+    size_t normalBase = 0;
+    size_t texcoordBase = 0;
+
+    // fan-triangulated corners, three per triangle
+    std::vector<index_t> triangles;
+    std::vector<event_t> events;
+};
+
+bool Model::LoadObjParallel(attrib_t* attrib, std::vector<shape_t>* shapes,
+    std::vector<material_t>* materials, std::string* err,
+    const char* filename, const char* mtl_basedir, unsigned threads)
+{
+    // chunks smaller than this are not worth a task of their own
+    constexpr size_t minChunkSize = 1 << 20;
+
+    attrib->vertices.clear();
+    attrib->normals.clear();
+    attrib->texcoords.clear();
+    shapes->clear();
+
+    std::stringstream errss;
+
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        errss << "Cannot open file [" << filename << "]" << std::endl;
+        if (err) {
+            (*err) = errss.str();
+        }
+        return false;
+    }
+
+    std::string baseDir;
+    if (mtl_basedir) {
+        baseDir = mtl_basedir;
+    }
+
+    // split the file right after a '\n', so no line and no '\r\n' spans two chunks
+    const unsigned workers = getWorkerCount(threads);
+    const char* const fileBegin = file.data();
+    const char* const fileEnd = fileBegin + file.size();
+    const size_t chunkCount = std::max<size_t>(1,
+        std::min<size_t>(workers * 4, file.size() / minChunkSize));
+    const size_t chunkSize = file.size() / chunkCount + 1;
+
+    std::vector<obj_chunk_t> chunks;
+    chunks.reserve(chunkCount);
+    const char* cursor = fileBegin;
+    while (cursor < fileEnd) {
+        const char* split = cursor + std::min<size_t>(chunkSize, fileEnd - cursor);
+        if (split < fileEnd) {
+            const char* newline = static_cast<const char*>(memchr(split, '\n', fileEnd - split));
+            split = newline ? newline + 1 : fileEnd;
+        }
+
+        chunks.emplace_back();
+        chunks.back().begin = cursor;
+        chunks.back().end = split;
+        cursor = split;
+    }
+
+    // pass 1: count the attributes so every chunk knows its global offsets,
+    // which lets relative indices be resolved without waiting for the others
+    parallelFor(chunks.size(), [&](size_t i) { countObjChunk(&chunks[i]); }, workers);
+
+    size_t vertexCount = 0, normalCount = 0, texcoordCount = 0;
+    for (auto& chunk : chunks) {
+        chunk.vertexBase = vertexCount;
+        chunk.normalBase = normalCount;
+        chunk.texcoordBase = texcoordCount;
+        vertexCount += chunk.vertexCount;
+        normalCount += chunk.normalCount;
+        texcoordCount += chunk.texcoordCount;
+    }
+
+    attrib->vertices.resize(3 * vertexCount);
+    attrib->normals.resize(3 * normalCount);
+    attrib->texcoords.resize(2 * texcoordCount);
+
+    // pass 2: attributes go straight to their final place, faces are
+    // triangulated into per-chunk buffers
+    parallelFor(chunks.size(), [&](size_t i) { parseObjChunk(&chunks[i], attrib); }, workers);
+
+    // replay the records in file order, this is the same state machine as
+    // LoadObj except that faces are referenced as ranges instead of copied
+    struct segment_t {
+        size_t chunk;
+        size_t triangleBegin;
+        size_t triangleEnd;
+        int material;
+        size_t shape;
+        size_t offset;
+    };
+
+    std::vector<segment_t> segments;
+    std::vector<size_t> triangleCounts;
+    std::map<std::string, int> material_map;
+    int material = -1;
+    std::string name;
+    size_t groupFaces = 0;
+    size_t groupTriangles = 0;
+    size_t groupSegmentBegin = 0;
+
+    auto flushGroup = [&]() {
+        if (groupFaces > 0) {
+            for (size_t i = groupSegmentBegin; i < segments.size(); ++i) {
+                segments[i].shape = shapes->size();
+            }
+            shapes->push_back(shape_t());
+            shapes->back().name = name;
+            triangleCounts.push_back(groupTriangles);
+        }
+
+        groupSegmentBegin = segments.size();
+        groupFaces = 0;
+        groupTriangles = 0;
+    };
+
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        for (const auto& event : chunks[c].events) {
+            switch (event.type) {
+            case obj_chunk_t::record_t::Faces:
+                groupFaces += event.faceCount;
+                if (event.triangleEnd > event.triangleBegin) {
+                    segments.push_back({ c, event.triangleBegin, event.triangleEnd, material, 0, groupTriangles });
+                    groupTriangles += event.triangleEnd - event.triangleBegin;
+                }
+                break;
+            case obj_chunk_t::record_t::UseMtl: {
+                int newMaterialId = -1;
+                auto iter = material_map.find(event.text);
+                if (iter != material_map.end()) {
+                    newMaterialId = iter->second;
+                }
+                if (newMaterialId != material) {
+                    flushGroup();
+                    material = newMaterialId;
+                }
+                break;
+            }
+            case obj_chunk_t::record_t::MtlLib:
+                loadMaterialLibraries(event.text, baseDir, materials, &material_map, &_materialLibraries, err);
+                break;
+            case obj_chunk_t::record_t::Group:
+            case obj_chunk_t::record_t::Object:
+                flushGroup();
+                name = event.text;
+                break;
+            }
+        }
+    }
+
+    // the trailing group is kept only if it produced triangles, and like
+    // LoadObj an empty shape is appended when the file ends on a flushed group
+    if (groupFaces == 0) {
+        shapes->push_back(shape_t());
+        triangleCounts.push_back(0);
+    }
+    else if (groupTriangles > 0) {
+        flushGroup();
+    }
+
+    for (size_t i = 0; i < shapes->size(); ++i) {
+        mesh_t& mesh = (*shapes)[i].mesh;
+        mesh.indices.resize(3 * triangleCounts[i]);
+        mesh.num_face_vertices.assign(triangleCounts[i], 3);
+        mesh.material_ids.resize(triangleCounts[i]);
+    }
+
+    parallelFor(segments.size(), [&](size_t i) {
+        const segment_t& segment = segments[i];
+        mesh_t& mesh = (*shapes)[segment.shape].mesh;
+        const auto& triangles = chunks[segment.chunk].triangles;
+        std::copy(triangles.begin() + 3 * segment.triangleBegin,
+            triangles.begin() + 3 * segment.triangleEnd,
+            mesh.indices.begin() + 3 * segment.offset);
+        std::fill(mesh.material_ids.begin() + segment.offset,
+            mesh.material_ids.begin() + segment.offset + (segment.triangleEnd - segment.triangleBegin),
+            segment.material);
+    }, workers);
+
+    if (err) {
+        (*err) += errss.str();
+    }
+
+    return true;
+}
+
+void Model::countObjChunk(obj_chunk_t* chunk) {
+    const char* cursor = chunk->begin;
+    while (cursor < chunk->end) {
+        const char* lineEnd;
+        const char* next = nextLine(cursor, chunk->end, &lineEnd);
+        const char* token = skipBlank(cursor, lineEnd);
+        cursor = next;
+
+        if (lineEnd - token < 2 || token[0] != 'v') continue;
+
+        if (token[1] == ' ' || token[1] == '\t') {
+            ++chunk->vertexCount;
+        }
+        else if (lineEnd - token > 2 && (token[2] == ' ' || token[2] == '\t')) {
+            if (token[1] == 'n') ++chunk->normalCount;
+            else if (token[1] == 't') ++chunk->texcoordCount;
+        }
+    }
+}
+
+void Model::parseObjChunk(obj_chunk_t* chunk, attrib_t* attrib) {
+    float* vertices = attrib->vertices.data() + 3 * chunk->vertexBase;
+    float* normals = attrib->normals.data() + 3 * chunk->normalBase;
+    float* texcoords = attrib->texcoords.data() + 2 * chunk->texcoordBase;
+    size_t vertexCount = 0, normalCount = 0, texcoordCount = 0;
+
+    std::vector<vertex_index> face;
+    face.reserve(8);
+
+    const char* cursor = chunk->begin;
+    while (cursor < chunk->end) {
+        const char* lineEnd;
+        const char* next = nextLine(cursor, chunk->end, &lineEnd);
+        const char* token = skipBlank(cursor, lineEnd);
+        cursor = next;
+
+        if (token == lineEnd || token[0] == '#') continue;
+
+        const ptrdiff_t length = lineEnd - token;
 
         // vertex
-        if (token[0] == 'v' && (token[1] == ' ' || token[1] == '\t')) {
+        if (length > 1 && token[0] == 'v' && (token[1] == ' ' || token[1] == '\t')) {
             token += 2;
-            float x, y, z;
-            std::istringstream in(token);
-            in >> x >> y >> z;
-            v.push_back(x);
-            v.push_back(y);
-            v.push_back(z);
+            float* xyz = vertices + 3 * vertexCount++;
+            xyz[0] = xyz[1] = xyz[2] = 0.0f;
+            parseFloat(token, lineEnd, &xyz[0]) && parseFloat(token, lineEnd, &xyz[1]) && parseFloat(token, lineEnd, &xyz[2]);
             continue;
         }
 
         // normal
-        if (token[0] == 'v' && token[1] == 'n' && (token[2] == ' ' || token[2] == '\t')) {
+        if (length > 2 && token[0] == 'v' && token[1] == 'n' && (token[2] == ' ' || token[2] == '\t')) {
             token += 3;
-            float x, y, z;
-            std::istringstream in(token);
-            in >> x >> y >> z;
-            vn.push_back(x);
-            vn.push_back(y);
-            vn.push_back(z);
+            float* xyz = normals + 3 * normalCount++;
+            xyz[0] = xyz[1] = xyz[2] = 0.0f;
+            parseFloat(token, lineEnd, &xyz[0]) && parseFloat(token, lineEnd, &xyz[1]) && parseFloat(token, lineEnd, &xyz[2]);
             continue;
         }
 
         // texcoord
-        if (token[0] == 'v' && token[1] == 't' && (token[2] == ' ' || token[2] == '\t')) {
+        if (length > 2 && token[0] == 'v' && token[1] == 't' && (token[2] == ' ' || token[2] == '\t')) {
             token += 3;
-            float x, y;
-            std::istringstream in(token);
-            in >> x >> y;
-            vt.push_back(x);
-            vt.push_back(y);
+            float* uv = texcoords + 2 * texcoordCount++;
+            uv[0] = uv[1] = 0.0f;
+            parseFloat(token, lineEnd, &uv[0]) && parseFloat(token, lineEnd, &uv[1]);
             continue;
         }
 
         // face
-        if (token[0] == 'f' && (token[1] == ' ' || token[1] == '\t')) {
-            token += 2;
-            token += strspn(token, " \t");
-
-            std::vector<vertex_index> face;
-            face.reserve(3);
-
-            while (!((token[0] == '\r') || (token[0] == '\n') || (token[0] == '\0'))) {
-                vertex_index vi(-1);
-                int vsize = static_cast<int>(v.size() / 3);
-                int vnsize = static_cast<int>(vn.size() / 3);
-                int vtsize = static_cast<int>(vt.size() / 2);
-                vi.v_idx = fixIndex(atoi((token)), vsize);
-                token += strcspn((token), "/ \t\r");
-                if ((token)[0] != '/') {
-                    face.push_back(vi);
-                    size_t n = strspn(token, " \t\r");
-                    token += n;
-                    continue;
-                }
-                token++;
-
-                // i//k
-                if (token[0] == '/') {
-                    token++;
-                    vi.vn_idx = fixIndex(atoi(token), vnsize);
-                    token += strcspn(token, "/ \t\r");
-                    face.push_back(vi);
-                    size_t n = strspn(token, " \t\r");
-                    token += n;
-                    continue;
-                }
+        if (length > 1 && token[0] == 'f' && (token[1] == ' ' || token[1] == '\t')) {
+            face.clear();
+            parseFace(token + 2, lineEnd,
+                static_cast<int>(chunk->vertexBase + vertexCount),
+                static_cast<int>(chunk->normalBase + normalCount),
+                static_cast<int>(chunk->texcoordBase + texcoordCount), &face);
+
+            if (chunk->events.empty() || chunk->events.back().type != obj_chunk_t::record_t::Faces) {
+                const size_t triangleCount = chunk->triangles.size() / 3;
+                chunk->events.push_back({ obj_chunk_t::record_t::Faces, 0, triangleCount, triangleCount, std::string() });
+            }
 
-                // i/j/k or i/j
-                vi.vt_idx = fixIndex(atoi(token), vtsize);
-                token += strcspn(token, "/ \t\r");
-                if (token[0] != '/') {
-                    face.push_back(vi);
-                    size_t n = strspn(token, " \t\r");
-                    token += n;
-                    continue;
-                }
+            obj_chunk_t::event_t& run = chunk->events.back();
+            ++run.faceCount;
 
-                // i/j/k
-                token++;  // skip '/'
-                vi.vn_idx = fixIndex(atoi(token), vnsize);
-                token += strcspn(token, "/ \t\r");
-                face.push_back(vi);
-                size_t n = strspn(token, " \t\r");
-                token += n;
+            if (face.size() >= 3) {
+                const size_t first = chunk->triangles.size();
+                chunk->triangles.resize(first + 3 * (face.size() - 2));
+                triangulateFace(face.data(), face.size(), chunk->triangles.data() + first);
+                run.triangleEnd += face.size() - 2;
             }
 
-            // replace with emplace_back + std::move on C++11
-            faceGroup.push_back(std::vector<vertex_index>());
-            faceGroup[faceGroup.size() - 1].swap(face);
-
             continue;
         }
 
         // use mtl
-        if ((0 == strncmp(token, "usemtl", 6)) && (token[6] == ' ' || token[6] == '\t')) {
-            char namebuf[SSCANF_BUFFER_SIZE];
-            token += 7;
-            std::sscanf(token, "%s", namebuf);
-            int newMaterialId = -1;
-            if (material_map.find(namebuf) != material_map.end()) {
-                newMaterialId = material_map[namebuf];
-            }
-            else {
-                // { error!! material not found }
-            }
-
-            if (newMaterialId != material) {
-                if (!faceGroup.empty())
-                {
-                    // Flatten vertices and indices
-                    for (size_t i = 0; i < faceGroup.size(); i++) {
-                        const std::vector<vertex_index>& face = faceGroup[i];
-
-                        vertex_index i0 = face[0];
-                        vertex_index i1(-1);
-                        vertex_index i2 = face[1];
-
-                        size_t npolys = face.size();
-
-                        // Polygon -> triangle fan conversion
-                        for (size_t k = 2; k < npolys; k++) {
-                            i1 = i2;
-                            i2 = face[k];
-
-                            index_t idx0, idx1, idx2;
-                            idx0.vertex_index = i0.v_idx;
-                            idx0.normal_index = i0.vn_idx;
-                            idx0.texcoord_index = i0.vt_idx;
-                            idx1.vertex_index = i1.v_idx;
-                            idx1.normal_index = i1.vn_idx;
-                            idx1.texcoord_index = i1.vt_idx;
-                            idx2.vertex_index = i2.v_idx;
-                            idx2.normal_index = i2.vn_idx;
-                            idx2.texcoord_index = i2.vt_idx;
-
-                            shape.mesh.indices.push_back(idx0);
-                            shape.mesh.indices.push_back(idx1);
-                            shape.mesh.indices.push_back(idx2);
-
-                            shape.mesh.num_face_vertices.push_back(3);
-                            shape.mesh.material_ids.push_back(material);
-                        }
-                    }
-                    shape.name = name;
-                    shapes->push_back(shape);
-                }
-                shape = shape_t();
-
-                faceGroup.clear();
-                material = newMaterialId;
-            }
-
+        if (startsWithKeyword(token, lineEnd, "usemtl", 6)) {
+            token = skipSpace(token + 7, lineEnd);
+            chunk->events.push_back({ obj_chunk_t::record_t::UseMtl, 0, 0, 0,
+                std::string(token, skipNonSpace(token, lineEnd)) });
             continue;
         }
 
         // load mtl
-        if ((0 == strncmp(token, "mtllib", 6)) && (token[6] == ' ' || token[6] == '\t')) {
-            token += 7;
-
-            std::vector<std::string> filenames;
-            std::stringstream ss(token);
-            std::string item;
-            while (std::getline(ss, item, ' ')) {
-                filenames.push_back(baseDir + item);
-            }
-
-            if (filenames.empty()) {
-                if (err) {
-                    (*err) +=
-                        "WARN: Looks like empty filename for mtllib. Use default "
-                        "material. \n";
-                }
-            }
-            else {
-                bool found = false;
-                for (size_t s = 0; s < filenames.size(); s++) {
-                    std::string err_mtl;
-                    bool ok = materialFileReader(filenames[s].c_str(), materials,
-                        &material_map, &err_mtl);
-                    if (err && (!err_mtl.empty())) {
-                        (*err) += err_mtl;  // This should be warn message.
-                    }
-
-                    if (ok) {
-                        found = true;
-                        break;
-                    }
-                }
-
-                if (!found) {
-                    if (err) {
-                        (*err) +=
-                            "WARN: Failed to load material file(s). Use default "
-                            "material.\n";
-                    }
-                }
-            }
-
+        if (startsWithKeyword(token, lineEnd, "mtllib", 6)) {
+            chunk->events.push_back({ obj_chunk_t::record_t::MtlLib, 0, 0, 0,
+                std::string(token + 7, lineEnd) });
             continue;
         }
 
         // group name
-        if (token[0] == 'g' && (token[1] == ' ' || token[1] == '\t')) {
-            // flush previous face group.
-            if (!faceGroup.empty())
-            {
-                // Flatten vertices and indices
-                for (size_t i = 0; i < faceGroup.size(); i++) {
-                    const std::vector<vertex_index>& face = faceGroup[i];
-
-                    vertex_index i0 = face[0];
-                    vertex_index i1(-1);
-                    vertex_index i2 = face[1];
-
-                    size_t npolys = face.size();
-
-                    // Polygon -> triangle fan conversion
-                    for (size_t k = 2; k < npolys; k++) {
-                        i1 = i2;
-                        i2 = face[k];
-
-                        index_t idx0, idx1, idx2;
-                        idx0.vertex_index = i0.v_idx;
-                        idx0.normal_index = i0.vn_idx;
-                        idx0.texcoord_index = i0.vt_idx;
-                        idx1.vertex_index = i1.v_idx;
-                        idx1.normal_index = i1.vn_idx;
-                        idx1.texcoord_index = i1.vt_idx;
-                        idx2.vertex_index = i2.v_idx;
-                        idx2.normal_index = i2.vn_idx;
-                        idx2.texcoord_index = i2.vt_idx;
-
-                        shape.mesh.indices.push_back(idx0);
-                        shape.mesh.indices.push_back(idx1);
-                        shape.mesh.indices.push_back(idx2);
-
-                        shape.mesh.num_face_vertices.push_back(3);
-                        shape.mesh.material_ids.push_back(material);
-                    }
-                }
-                shape.name = name;
-
-                shapes->push_back(shape);
-            }
-
-            shape = shape_t();
-
-            // material = -1;
-            faceGroup.clear();
-
-            std::vector<std::string> names;
-            names.reserve(2);
-
-            while (!((token[0] == '\r') || (token[0] == '\n') || (token[0] == '\0'))) {
-                std::string s;
-                token += strspn(token, " \t");
-                size_t e = strcspn(token, " \t\r");
-                s = std::string(token, &token[e]);
-                token += e;
-                names.push_back(s);
-                token += strspn(token, " \t\r");  // skip tag
-            }
-
-            assert(names.size() > 0);
-
-            // names[0] must be 'g', so skip the 0th element.
-            if (names.size() > 1) {
-                name = names[1];
-            }
-            else {
-                name = "";
-            }
-
+        if (length > 1 && token[0] == 'g' && (token[1] == ' ' || token[1] == '\t')) {
+            token = skipBlankCr(skipIndex(token, lineEnd), lineEnd);
+            const char* nameEnd = token;
+            while (nameEnd < lineEnd && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r') ++nameEnd;
+            chunk->events.push_back({ obj_chunk_t::record_t::Group, 0, 0, 0, std::string(token, nameEnd) });
             continue;
         }
 
         // object name
-        if (token[0] == 'o' && (token[1] == ' ' || token[1] == '\t')) {
-            // flush previous face group.
-            if (!faceGroup.empty())
-            {
-                // Flatten vertices and indices
-                for (size_t i = 0; i < faceGroup.size(); i++) {
-                    const std::vector<vertex_index>& face = faceGroup[i];
-
-                    vertex_index i0 = face[0];
-                    vertex_index i1(-1);
-                    vertex_index i2 = face[1];
-
-                    size_t npolys = face.size();
-
-                    // Polygon -> triangle fan conversion
-                    for (size_t k = 2; k < npolys; k++) {
-                        i1 = i2;
-                        i2 = face[k];
-
-                        index_t idx0, idx1, idx2;
-                        idx0.vertex_index = i0.v_idx;
-                        idx0.normal_index = i0.vn_idx;
-                        idx0.texcoord_index = i0.vt_idx;
-                        idx1.vertex_index = i1.v_idx;
-                        idx1.normal_index = i1.vn_idx;
-                        idx1.texcoord_index = i1.vt_idx;
-                        idx2.vertex_index = i2.v_idx;
-                        idx2.normal_index = i2.vn_idx;
-                        idx2.texcoord_index = i2.vt_idx;
-
-                        shape.mesh.indices.push_back(idx0);
-                        shape.mesh.indices.push_back(idx1);
-                        shape.mesh.indices.push_back(idx2);
-
-                        shape.mesh.num_face_vertices.push_back(3);
-                        shape.mesh.material_ids.push_back(material);
-                    }
-                }
-                shape.name = name;
-
-                shapes->push_back(shape);
-            }
-
-            // material = -1;
-            faceGroup.clear();
-            shape = shape_t();
+        if (length > 1 && token[0] == 'o' && (token[1] == ' ' || token[1] == '\t')) {
+            token = skipSpace(token + 2, lineEnd);
+            chunk->events.push_back({ obj_chunk_t::record_t::Object, 0, 0, 0,
+                std::string(token, skipNonSpace(token, lineEnd)) });
+            continue;
+        }
+    }
+}
 
-            // @todo { multiple object name? }
-            char namebuf[SSCANF_BUFFER_SIZE];
-            token += 2;
-            std::sscanf(token, "%s", namebuf);
-            name = std::string(namebuf);
+void Model::parseFace(const char* token, const char* lineEnd,
+    int vsize, int vnsize, int vtsize, std::vector<vertex_index>* face)
+{
+    token = skipBlank(token, lineEnd);
+
+    while (token < lineEnd) {
+        vertex_index vi(-1);
+        vi.v_idx = fixIndex(parseInt(token, lineEnd), vsize);
+        token = skipIndex(token, lineEnd);
+        if (token == lineEnd || token[0] != '/') {
+            face->push_back(vi);
+            token = skipBlankCr(token, lineEnd);
+            continue;
+        }
+        token++;
+
+        // i//k
+        if (token < lineEnd && token[0] == '/') {
+            token++;
+            vi.vn_idx = fixIndex(parseInt(token, lineEnd), vnsize);
+            token = skipIndex(token, lineEnd);
+            face->push_back(vi);
+            token = skipBlankCr(token, lineEnd);
+            continue;
+        }
 
+        // i/j/k or i/j
+        vi.vt_idx = fixIndex(parseInt(token, lineEnd), vtsize);
+        token = skipIndex(token, lineEnd);
+        if (token == lineEnd || token[0] != '/') {
+            face->push_back(vi);
+            token = skipBlankCr(token, lineEnd);
             continue;
         }
+
+        // i/j/k
+        token++;  // skip '/'
+        vi.vn_idx = fixIndex(parseInt(token, lineEnd), vnsize);
+        token = skipIndex(token, lineEnd);
+        face->push_back(vi);
+        token = skipBlankCr(token, lineEnd);
     }
+}
 
-    if (!faceGroup.empty())
-    {
-        // Flatten vertices and indices
-        for (size_t i = 0; i < faceGroup.size(); i++) {
-            const std::vector<vertex_index>& face = faceGroup[i];
+void Model::flushFaceGroup(const face_group_t& faceGroup, int material, shape_t* shape) {
+    mesh_t& mesh = shape->mesh;
+    const size_t first = mesh.material_ids.size();
+    const size_t count = first + faceGroup.triangleCount;
+    mesh.indices.resize(3 * count);
+    mesh.num_face_vertices.resize(count, 3);
+    mesh.material_ids.resize(count, material);
+
+    index_t* out = mesh.indices.data() + 3 * first;
+    for (size_t i = 0; i + 1 < faceGroup.offsets.size(); ++i) {
+        out = triangulateFace(faceGroup.corners.data() + faceGroup.offsets[i],
+            faceGroup.offsets[i + 1] - faceGroup.offsets[i], out);
+    }
+}
 
-            vertex_index i0 = face[0];
-            vertex_index i1(-1);
-            vertex_index i2 = face[1];
+Model::index_t* Model::triangulateFace(const vertex_index* face, size_t count, index_t* out) {
+    // Polygon -> triangle fan conversion
+    for (size_t k = 2; k < count; k++) {
+        const vertex_index* corners[3] = { &face[0], &face[k - 1], &face[k] };
+        for (const vertex_index* corner : corners) {
+            out->vertex_index = corner->v_idx;
+            out->normal_index = corner->vn_idx;
+            out->texcoord_index = corner->vt_idx;
+            ++out;
+        }
+    }
 
-            size_t npolys = face.size();
+    return out;
+}
 
-            // Polygon -> triangle fan conversion
-            for (size_t k = 2; k < npolys; k++) {
-                i1 = i2;
-                i2 = face[k];
+void Model::loadMaterialLibraries(const std::string& line, const std::string& baseDir,
+    std::vector<material_t>* materials, std::map<std::string, int>* material_map,
+    std::vector<std::string>* libraries, std::string* err)
+{
+    std::vector<std::string> filenames;
+    std::stringstream ss(line);
+    std::string item;
+    while (std::getline(ss, item, ' ')) {
+        filenames.push_back(baseDir + item);
+    }
 
-                index_t idx0, idx1, idx2;
-                idx0.vertex_index = i0.v_idx;
-                idx0.normal_index = i0.vn_idx;
-                idx0.texcoord_index = i0.vt_idx;
-                idx1.vertex_index = i1.v_idx;
-                idx1.normal_index = i1.vn_idx;
-                idx1.texcoord_index = i1.vt_idx;
-                idx2.vertex_index = i2.v_idx;
-                idx2.normal_index = i2.vn_idx;
-                idx2.texcoord_index = i2.vt_idx;
+    if (filenames.empty()) {
+        if (err) {
+            (*err) +=
+                "WARN: Looks like empty filename for mtllib. Use default "
+                "material. \n";
+        }
+        return;
+    }
 
-                shape.mesh.indices.push_back(idx0);
-                shape.mesh.indices.push_back(idx1);
-                shape.mesh.indices.push_back(idx2);
+    bool found = false;
+    for (size_t s = 0; s < filenames.size(); s++) {
+        if (libraries) {
+            libraries->push_back(filenames[s]);
+        }
 
-                shape.mesh.num_face_vertices.push_back(3);
-                shape.mesh.material_ids.push_back(material);
-            }
+        std::string err_mtl;
+        bool ok = materialFileReader(filenames[s].c_str(), materials,
+            material_map, &err_mtl);
+        if (err && (!err_mtl.empty())) {
+            (*err) += err_mtl;  // This should be warn message.
         }
-        shape.name = name;
-    }
-    if (faceGroup.empty() || shape.mesh.indices.size()) {
-        shapes->push_back(shape);
-    }
-    faceGroup.clear();  // for safety
 
-    if (err) {
-        (*err) += errss.str();
+        if (ok) {
+            found = true;
+            break;
+        }
     }
 
-    attrib->vertices.swap(v);
-    attrib->normals.swap(vn);
-    attrib->texcoords.swap(vt);
-
-    return true;
+    if (!found) {
+        if (err) {
+            (*err) +=
+                "WARN: Failed to load material file(s). Use default "
+                "material.\n";
+        }
+    }
 }
 
 bool Model::materialFileReader(const std::string& filepath,
@@ -735,8 +2634,8 @@ bool Model::materialFileReader(const std::string& filepath,
     std::map<std::string, int>* matMap,
     std::string* err)
 {
-    std::ifstream inStream(filepath.c_str());
-    if (!inStream) {
+    MappedFile file;
+    if (!file.open(filepath)) {
         std::stringstream ss;
         ss << "WARN: Material file [ " << filepath << " ] not found." << std::endl;
         if (err) {
@@ -745,201 +2644,126 @@ bool Model::materialFileReader(const std::string& filepath,
         return false;
     }
 
-    std::string warning;
-
-    // Create a default material anyway.
-    material_t material;
-    material.name = "";
-    for (int i = 0; i < 3; i++) {
-        material.ka[i] = 0.f;
-        material.kd[i] = 0.f;
-        material.ks[i] = 0.f;
-        material.ke[i] = 0.f;
+    // materials that only differ by name share one entry, the earlier ones
+    // of other libraries included, so the material table and the draw runs
+    // split by material stay as small as the distinct looks
+    std::unordered_map<std::string, int> contentMap;
+    for (size_t i = 0; i < materials->size(); ++i) {
+        contentMap.insert(std::make_pair(materialContentKey((*materials)[i]), static_cast<int>(i)));
     }
-    material.illum = 0;
-    material.ni = 1.f;
-    material.ns = 1.f;
-    material.d = 1.f;
-
-    std::stringstream ss;
 
-    std::string linebuf;
-    while (inStream.peek() != -1) {
-        safeGetline(inStream, linebuf);
-        // Trim trailing whitespace.
-        if (linebuf.size() > 0) {
-            linebuf = linebuf.substr(0, linebuf.find_last_not_of(" \t") + 1);
+    const auto flushMaterial = [&](const material_t& material) {
+        const auto inserted = contentMap.insert(
+            std::make_pair(materialContentKey(material), static_cast<int>(materials->size())));
+        matMap->insert(std::pair<std::string, int>(material.name, inserted.first->second));
+        if (inserted.second) {
+            materials->push_back(material);
         }
+    };
 
-        // Trim newline '\r\n' or '\n'
-        if (linebuf.size() > 0) {
-            if (linebuf[linebuf.size() - 1] == '\n')
-                linebuf.erase(linebuf.size() - 1);
-        }
-        if (linebuf.size() > 0) {
-            if (linebuf[linebuf.size() - 1] == '\r')
-                linebuf.erase(linebuf.size() - 1);
-        }
+    // Create a default material anyway.
+    const material_t defaultMaterial = makeDefaultMaterial();
+    material_t material = defaultMaterial;
 
-        // Skip if empty line.
-        if (linebuf.empty()) {
-            continue;
+    const char* cursor = file.data();
+    const char* const end = cursor + file.size();
+    while (cursor < end) {
+        const char* lineEnd = nullptr;
+        const char* const lineStart = cursor;
+        cursor = nextLine(cursor, end, &lineEnd);
+
+        // Trim trailing whitespace.
+        while (lineEnd > lineStart && (lineEnd[-1] == ' ' || lineEnd[-1] == '\t')) {
+            --lineEnd;
         }
 
         // Skip leading space.
-        const char* token = linebuf.c_str();
-        token += strspn(token, " \t");
-
-        assert(token);
-        if (token[0] == '\0') continue;  // empty line
+        const char* token = skipBlank(lineStart, lineEnd);
+        if (token == lineEnd) continue;  // empty line
 
         if (token[0] == '#') continue;  // comment line
 
         // new mtl
-        if ((0 == strncmp(token, "newmtl", 6)) && (token[6] == ' ' || token[6] == '\t')) {
+        if (startsWithKeyword(token, lineEnd, "newmtl", 6)) {
             // flush previous material.
             if (!material.name.empty()) {
-                matMap->insert(std::pair<std::string, int>(
-                    material.name, static_cast<int>(materials->size())));
-                materials->push_back(material);
+                flushMaterial(material);
             }
 
             // initial temporary material
-            material.name = "";
-            for (int i = 0; i < 3; i++) {
-                material.ka[i] = 0.f;
-                material.kd[i] = 0.f;
-                material.ks[i] = 0.f;
-                material.ke[i] = 0.f;
-            }
-            material.illum = 0;
-            material.ni = 1.f;
-            material.ns = 1.f;
-            material.d = 1.f;
+            material = defaultMaterial;
 
             // set new mtl name
-            char namebuf[SSCANF_BUFFER_SIZE];
-            token += 7;
-            std::sscanf(token, "%s", namebuf);
-            material.name = namebuf;
+            const char* name = skipSpace(token + 7, lineEnd);
+            material.name.assign(name, skipNonSpace(name, lineEnd));
 
             continue;
         }
 
         // ambient
-        if (token[0] == 'K' && token[1] == 'a' && (token[2] == ' ' || token[2] == '\t')) {
-            token += 2;
-            float r, g, b;
-            std::istringstream in(token);
-            in >> r >> g >> b;
-            material.ka[0] = r;
-            material.ka[1] = g;
-            material.ka[2] = b;
+        if (startsWithKeyword(token, lineEnd, "Ka", 2)) {
+            parseColor(token + 2, lineEnd, material.ka);
             continue;
         }
 
         // diffuse
-        if (token[0] == 'K' && token[1] == 'd' && (token[2] == ' ' || token[2] == '\t')) {
-            token += 2;
-            float r, g, b;
-            std::istringstream in(token);
-            in >> r >> g >> b;
-            material.kd[0] = r;
-            material.kd[1] = g;
-            material.kd[2] = b;
+        if (startsWithKeyword(token, lineEnd, "Kd", 2)) {
+            parseColor(token + 2, lineEnd, material.kd);
             continue;
         }
 
         // specular
-        if (token[0] == 'K' && token[1] == 's' && (token[2] == ' ' || token[2] == '\t')) {
-            token += 2;
-            float r, g, b;
-            std::istringstream in(token);
-            in >> r >> g >> b;
-            material.ks[0] = r;
-            material.ks[1] = g;
-            material.ks[2] = b;
+        if (startsWithKeyword(token, lineEnd, "Ks", 2)) {
+            parseColor(token + 2, lineEnd, material.ks);
             continue;
         }
 
         // emission
-        if (token[0] == 'K' && token[1] == 'e' && (token[2] == ' ' || token[2] == '\t')) {
-            token += 2;
-            float r, g, b;
-            std::istringstream in(token);
-            in >> r >> g >> b;
-            material.ke[0] = r;
-            material.ke[1] = g;
-            material.ke[2] = b;
+        if (startsWithKeyword(token, lineEnd, "Ke", 2)) {
+            parseColor(token + 2, lineEnd, material.ke);
             continue;
         }
 
         // shininess
-        if (token[0] == 'N' && token[1] == 's' && (token[2] == ' ' || token[2] == '\t')) {
+        if (startsWithKeyword(token, lineEnd, "Ns", 2)) {
             token += 2;
-            float ns;
-            std::istringstream in(token);
-            in >> ns;
-            material.ns = ns;
+            parseFloatOrZero(token, lineEnd, &material.ns);
             continue;
         }
 
         // ior(index of refraction)
-        if (token[0] == 'N' && token[1] == 'i' && (token[2] == ' ' || token[2] == '\t')) {
+        if (startsWithKeyword(token, lineEnd, "Ni", 2)) {
             token += 2;
-            float ni;
-            std::istringstream in(token);
-            in >> ni;
-            material.ni = ni;
+            parseFloatOrZero(token, lineEnd, &material.ni);
             continue;
         }
 
         // illum model
-        if (0 == strncmp(token, "illum", 5) && (token[5] == ' ' || token[5] == '\t')) {
-            token += 6;
-            int illum;
-            std::istringstream in(token);
-            in >> illum;
-            material.illum = illum;
+        if (startsWithKeyword(token, lineEnd, "illum", 5)) {
+            material.illum = parseInt(token + 6, lineEnd);
             continue;
         }
 
         // dissolve
-        if (token[0] == 'd' && (token[1] == ' ' || token[1] == '\t')) {
+        if (startsWithKeyword(token, lineEnd, "d", 1)) {
             token += 1;
-            float d;
-            std::istringstream in(token);
-            in >> d;
-            material.d = d;
+            parseFloatOrZero(token, lineEnd, &material.d);
             continue;
         }
 
         // unknown parameter
-        const char* _space = strchr(token, ' ');
+        const char* _space = static_cast<const char*>(memchr(token, ' ', lineEnd - token));
         if (!_space) {
-            _space = strchr(token, '\t');
+            _space = static_cast<const char*>(memchr(token, '\t', lineEnd - token));
         }
         if (_space) {
-            std::ptrdiff_t len = _space - token;
-            std::string key(token, static_cast<size_t>(len));
-            std::string value = _space + 1;
-            material.unknown_parameter.insert(
-                std::pair<std::string, std::string>(key, value));
+            material.unknown_parameter.insert(std::pair<std::string, std::string>(
+                std::string(token, _space), std::string(_space + 1, lineEnd)));
         }
     }
 
     // flush last material.
-    matMap->insert(std::pair<std::string, int>(
-        material.name, static_cast<int>(materials->size())));
-    materials->push_back(material);
-
-    warning = ss.str();
-
-    if (!warning.empty()) {
-        if (err) {
-            (*err) += warning;
-        }
-    }
+    flushMaterial(material);
 
     return true;
 }
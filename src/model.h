@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
@@ -7,10 +9,144 @@
 #include <glad/glad.h>
 
 #include "./base/bounding_box.h"
+#include "./base/camera.h"
 #include "./base/transform.h"
 #include "./base/vertex.h"
+#include "meshlet_builder.h"
+#include "normal_generator.h"
+
+struct ModelLoadOptions {
+    enum class ObjReader {
+        // std::ifstream with one std::string per line
+        Stream,
+        // tokenize in place over a memory-mapped view of the file
+        MemoryMapped,
+        // memory-mapped, parsed as newline-aligned chunks on all cores
+        ParallelMapped
+    };
+
+    ObjReader objReader = ObjReader::ParallelMapped;
+
+    // fill in smooth normals for the face corners of the obj without a vn
+    bool generateNormals = true;
+
+    // generateNormals: how the faces around a vertex are weighted
+    NormalWeighting normalWeighting = NormalWeighting::Angle;
+
+    // generateNormals: faces meeting at a larger angle, in degrees, keep
+    // their own normals across the edge
+    float normalCreaseAngle = 60.0f;
+
+    enum class VertexWeld {
+        // one pass through an open-addressing table sized from the corner count
+        Hash,
+        // sort the corners by hash and vertex on all cores, hash-table free
+        ParallelSort,
+        // also merge near duplicates within the weld tolerances below
+        Tolerance
+    };
+
+    // Hash and ParallelSort produce the same vertices in the same order
+    VertexWeld vertexWeld = VertexWeld::Hash;
+
+    // Tolerance: max distance between merged positions, in model units
+    float weldPositionEpsilon = 1e-5f;
+
+    // Tolerance: max angle between merged normals, in degrees
+    float weldNormalAngle = 1.0f;
+
+    // Tolerance: max difference per texture coordinate component
+    float weldTexCoordEpsilon = 1e-4f;
+
+    enum class MeshOptimization {
+        // keep the triangle order of the obj
+        None,
+        // reorder triangles for the post-transform vertex cache, then
+        // renumber vertices in the order they are first fetched
+        VertexCache,
+        // as VertexCache, but also sort triangle clusters to reduce overdraw
+        VertexCacheOverdraw
+    };
+
+    MeshOptimization meshOptimization = MeshOptimization::VertexCache;
+
+    // entries of the fifo cache the triangle order is tuned for
+    unsigned vertexCacheSize = 16;
+
+    // VertexCacheOverdraw: how much the acmr may grow to get smaller clusters
+    float overdrawThreshold = 1.05f;
+
+    // coarser versions of every submesh made by quadric edge collapse, each
+    // aiming at half the triangles of the previous one. 0 disables them
+    unsigned lodLevels = 0;
+
+    // largest surface deviation a level may reach, relative to the largest
+    // extent of its submesh. levels stop early once it is exhausted
+    float lodMaxError = 0.05f;
+
+    // regroup the triangles of every submesh into meshlets that drawMeshlets
+    // culls one by one against the frustum and their normal cones
+    bool buildMeshlets = false;
+
+    // vertex and triangle limits of a meshlet
+    unsigned meshletMaxVertices = 64;
+    unsigned meshletMaxTriangles = 124;
+
+    enum class VertexFormat {
+        // Vertex, 32 bytes of 32-bit floats
+        Float,
+        // Model::CompactVertex, 16 bytes, dequantized in the vertex shader
+        Compact
+    };
+
+    // layout of the gpu vertex buffer, the cpu side copies stay in floats
+    VertexFormat vertexFormat = VertexFormat::Float;
+
+    // worker threads for the parallel paths, 0 = one per hardware thread
+    unsigned threads = 0;
+
+    // reuse "<obj>.cache" written by a previous load of the same file,
+    // or write it after parsing so the next launch can skip the obj
+    bool useCache = true;
+
+    // always compare the content hash, not only when the mtime changed
+    bool verifyCacheHash = false;
+
+    // store the buffers of the cache through mesh_codec, several times
+    // smaller than raw. the vertices read back are quantized as with
+    // VertexFormat::Compact, the floats of the obj are not kept
+    bool compressCache = false;
+
+    // parse and process the obj on a worker thread. the constructor returns
+    // at once and updateLoad() uploads the shapes processed so far, so the
+    // model can be drawn while it grows. a valid cache is still loaded in place
+    bool loadInBackground = false;
+
+    enum class CpuRetention {
+        // keep the vertices and the indices
+        All,
+        // keep the positions and the indices, enough for a TriangleBvh
+        Positions,
+        // drop the mesh data once it is on the gpu
+        None
+    };
+
+    // what the model keeps in memory after the upload, the submeshes and
+    // the bounding box are always kept
+    CpuRetention cpuRetention = CpuRetention::All;
+};
 
 class Model {
+public:
+    // the attributes of a face corner, indices into the v, vn and vt records
+    // of the obj numbered from 0, -1 when the corner has none
+    typedef struct {
+        int vertex_index;
+        int normal_index;
+        int texcoord_index;
+    } index_t;
+
+private:
     // obj loader
     typedef struct {
         std::vector<float> vertices;
@@ -18,12 +154,6 @@ class Model {
         std::vector<float> texcoords;
     } attrib_t;
 
-    typedef struct {
-        int vertex_index;
-        int normal_index;
-        int texcoord_index;
-    } index_t;
-
     typedef struct {
         std::vector<index_t> indices;
         std::vector<unsigned char> num_face_vertices;  // The number of vertices per
@@ -37,6 +167,7 @@ class Model {
         mesh_t mesh;
     } shape_t;
 
+public:
     typedef struct {
         std::string name;
         float ka[3];
@@ -50,16 +181,67 @@ class Model {
         std::map<std::string, std::string> unknown_parameter;
     } material_t;
 
-    struct VertexMaterial {
-        glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec2 texCoord;
-        int material_id;
-        VertexMaterial() : material_id(-1){}
-        VertexMaterial(const Vertex& vertex, int material)
-            : position(vertex.position), normal(vertex.normal), texCoord(vertex.texCoord), material_id(material) {}
+    // the VertexFormat::Compact layout. positions are unorm16 within the
+    // bounding box, normals are octahedral encoded snorm16 and texture
+    // coordinates are half floats. padding keeps the 16-byte stride
+    struct CompactVertex {
+        uint16_t position[3];
+        uint16_t padding;
+        int16_t normal[2];
+        uint16_t texCoord[2];
+    };
+
+    // the position and padding of a CompactVertex, the 8-byte element of
+    // the position only stream of a compact model
+    struct CompactPosition {
+        uint16_t position[4];
+    };
+
+    // a coarser index range of a submesh over the same vertices. error is the
+    // largest surface deviation, relative to the largest extent of the submesh
+    struct SubmeshLod {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        float error = 0.0f;
+    };
+
+    // the faces of one shape ('o'/'g' group) of the obj under one material.
+    // all submeshes share the vertex and index buffers: the indices of a
+    // submesh are [firstIndex, firstIndex + indexCount) and relative to its
+    // baseVertex, its vertices are [baseVertex, baseVertex + vertexCount).
+    // submeshes are sorted by material, so the submeshes of a material are
+    // drawn in one run. their base ranges are contiguous in both buffers too,
+    // except after a background load: its batches stay in the buffers in the
+    // order they were uploaded, only the table is sorted once it finished
+    struct Submesh {
+        std::string name;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        uint32_t baseVertex = 0;
+        uint32_t vertexCount = 0;
+        int material = -1;
+        BoundingBox boundingBox;
+        // level i + 1 of selectLod, the ranges follow every base range in the
+        // index buffer and are relative to the same baseVertex
+        std::vector<SubmeshLod> lods;
+        // consecutive clusters covering the base range, their firstIndex is
+        // in the shared index buffer
+        std::vector<Meshlet> meshlets;
     };
 
+    // what a drawMeshlets call left out
+    struct MeshletCullStats {
+        size_t meshlets = 0;
+        size_t triangles = 0;
+        size_t frustumCulledMeshlets = 0;
+        size_t frustumCulledTriangles = 0;
+        size_t backfaceCulledMeshlets = 0;
+        size_t backfaceCulledTriangles = 0;
+
+        size_t getCulledTriangles() const { return frustumCulledTriangles + backfaceCulledTriangles; }
+    };
+
+private:
     struct vertex_index {
         int v_idx, vt_idx, vn_idx;
         vertex_index() : v_idx(-1), vt_idx(-1), vn_idx(-1) {}
@@ -68,11 +250,71 @@ class Model {
             : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {}
     };
 
+    // polygons of the current face group stored back to back, face i spans
+    // corners[offsets[i], offsets[i + 1]). clear() keeps the capacity, so the
+    // same two buffers serve every group of the file
+    struct face_group_t {
+        std::vector<vertex_index> corners;
+        std::vector<size_t> offsets = std::vector<size_t>(1, 0);
+        size_t triangleCount = 0;
+
+        bool empty() const { return offsets.size() == 1; }
+
+        void clear() {
+            corners.clear();
+            offsets.resize(1);
+            triangleCount = 0;
+        }
+
+        // close the polygon made of the corners appended since the last call
+        void endFace() {
+            const size_t count = corners.size() - offsets.back();
+            if (count >= 3) triangleCount += count - 2;
+            offsets.push_back(corners.size());
+        }
+    };
+
     bool LoadObj(attrib_t* attrib, std::vector<shape_t>* shapes,
         std::vector<material_t>* materials, std::string* err,
         const char* filename, const char* mtl_basedir);
 
-    bool materialFileReader(const std::string& filepath,
+    // same output as LoadObj, but parses the mapped bytes directly without
+    // building a std::string per line or going through std::istringstream
+    bool LoadObjMapped(attrib_t* attrib, std::vector<shape_t>* shapes,
+        std::vector<material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basedir);
+
+    // records of one newline-aligned slice of a mapped obj file
+    struct obj_chunk_t;
+
+    // same output as LoadObj, the file is split into chunks whose v/vn/vt/f
+    // records are parsed concurrently, then usemtl/g/o/mtllib are replayed
+    // in file order to stitch the chunks back into shapes
+    bool LoadObjParallel(attrib_t* attrib, std::vector<shape_t>* shapes,
+        std::vector<material_t>* materials, std::string* err,
+        const char* filename, const char* mtl_basedir, unsigned threads);
+
+    static void countObjChunk(obj_chunk_t* chunk);
+
+    static void parseObjChunk(obj_chunk_t* chunk, attrib_t* attrib);
+
+    // parse the corners of an 'f' record, token points past the tag
+    static void parseFace(const char* token, const char* lineEnd,
+        int vsize, int vnsize, int vtsize, std::vector<vertex_index>* face);
+
+    // fan-triangulate the polygons of a face group into the shape
+    static void flushFaceGroup(const face_group_t& faceGroup, int material, shape_t* shape);
+
+    // write the fan triangulation of a polygon to out, 3 * (count - 2) corners
+    static index_t* triangulateFace(const vertex_index* face, size_t count, index_t* out);
+
+    // parse the file list of an mtllib record and read the first one found.
+    // the files tried are appended to libraries, if given
+    static void loadMaterialLibraries(const std::string& line, const std::string& baseDir,
+        std::vector<material_t>* materials, std::map<std::string, int>* material_map,
+        std::vector<std::string>* libraries, std::string* err);
+
+    static bool materialFileReader(const std::string& filepath,
         std::vector<material_t>* materials,
         std::map<std::string, int>* matMap,
         std::string* err);
@@ -109,24 +351,85 @@ class Model {
         }
     }
 
+    // the vertex referenced by one face corner
+    static Vertex getCornerVertex(const attrib_t& attrib, const index_t& index);
+
+    // merge the equal corners of every run of same material faces of a shape
+    // into a submesh, appending to _vertices, _indices and _submeshes in
+    // material order. vertices are not shared between submeshes
+    void weldVertices(const attrib_t& attrib, const std::vector<shape_t>& shapes,
+        const ModelLoadOptions& options);
+
+    // reorder the welded triangles and vertices of every submesh as selected
+    // by meshOptimization
+    void optimizeMesh(const ModelLoadOptions& options);
+
+    // append lodLevels simplified index ranges per submesh
+    void buildLods(const ModelLoadOptions& options);
+
+    // reorder the base range of every submesh into meshlets
+    void clusterMeshlets(const ModelLoadOptions& options);
+
+    // read the obj and its materials with the selected reader, throws on failure
+    void parseObj(const std::string& filepath, const ModelLoadOptions& options,
+        attrib_t* attrib, std::vector<shape_t>* shapes, std::vector<material_t>* materials);
+
+    // point the corners without a normal at smooth normals computed from
+    // the faces around their position, appended to attrib->normals
+    static void generateMissingNormals(attrib_t* attrib, std::vector<shape_t>* shapes,
+        const ModelLoadOptions& options);
+
+    // weld, optimize, cluster and simplify the shapes into this model
+    void processShapes(const attrib_t& attrib, const std::vector<shape_t>& shapes,
+        const ModelLoadOptions& options);
+
+    // state shared with the loadInBackground worker
+    struct async_load_t;
+
+    // the worker: parse, then queue the shapes in batches, each processed
+    // into a staging model without gl resources
+    void loadInBackground(const std::string& filepath, const ModelLoadOptions& options);
+
+    // an empty staging model of the worker
+    Model();
+
+    // the serial weld loop shared by VertexWelder and VertexToleranceWelder
+    template <typename Welder>
+    void weldCorners(const attrib_t& attrib, const index_t* corners, size_t count, Welder* welder);
+
     // Make index zero-base, and also support relative index.
-    inline int fixIndex(int idx, int n) {
+    static inline int fixIndex(int idx, int n) {
         if (idx > 0) return idx - 1;
         if (idx == 0) return 0;
         return n + idx;  // negative value = relative
     }
 
 public:
-    Model(const std::string& filepath);
+    Model(const std::string& filepath, const ModelLoadOptions& options = ModelLoadOptions());
 
-    Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+    Model(std::vector<Vertex> vertices, std::vector<uint32_t> indices);
 
-    Model(Model&& rhs) noexcept;
+    // the gl objects and the worker of a background load are bound to the
+    // instance, models are held through pointers instead
+    Model(Model&& rhs) = delete;
 
     virtual ~Model();
 
+    // upload what the background load has processed since the last call,
+    // true once the whole model is on the gpu. call it on the gl thread,
+    // it rethrows a failure of the worker
+    bool updateLoad();
+
+    bool isLoading() const;
+
+    // fraction of the obj's corners processed by the worker
+    float getLoadProgress() const;
+
     GLuint getVao() const;
 
+    // reads only the tightly packed positions, for depth only passes
+    GLuint getDepthVao() const;
+
     GLuint getBoundingBoxVao() const;
 
     size_t getVertexCount() const;
@@ -135,40 +438,170 @@ public:
 
     BoundingBox getBoundingBox() const;
 
-    virtual void draw() const;
+    ModelLoadOptions::VertexFormat getVertexFormat() const;
+
+    // sets up the shader for the faces of a material, -1 for none
+    typedef std::function<void(int material)> MaterialBinder;
+
+    // the draw calls below issue one multi draw per run of consecutive
+    // submeshes with the same material, after calling bindMaterial for it
+    // when given. a depth only pass can leave it empty
+
+    // draw every submesh
+    virtual void draw(const MaterialBinder& bindMaterial = MaterialBinder()) const;
+
+    // draw every submesh through the depth vao
+    void drawDepth() const;
+
+    // draw the listed submeshes
+    void drawSubmeshes(const std::vector<uint32_t>& submeshes,
+        const MaterialBinder& bindMaterial = MaterialBinder()) const;
+
+    // as above, submeshes[i] drawn at level lods[i] of selectLod
+    void drawSubmeshes(const std::vector<uint32_t>& submeshes, const std::vector<uint32_t>& lods,
+        const MaterialBinder& bindMaterial = MaterialBinder()) const;
+
+    // the coarsest level of a submesh whose error, scaled by the projected
+    // size of its bounding box, stays within pixelError pixels. 0 is the
+    // full submesh
+    uint32_t selectLod(uint32_t submesh, const PerspectiveCamera& camera,
+        float viewportHeight, float pixelError) const;
+
+    // draw the meshlets of the listed submeshes that are inside the camera
+    // frustum and, with coneCulling, have a triangle facing the camera.
+    // visible neighbours are merged into one range, submeshes without
+    // meshlets are drawn whole. stats accumulates what was culled
+    void drawMeshlets(const std::vector<uint32_t>& submeshes, const PerspectiveCamera& camera,
+        bool coneCulling, MeshletCullStats* stats = nullptr,
+        const MaterialBinder& bindMaterial = MaterialBinder()) const;
 
     virtual void drawBoundingBox() const;
 
+    const std::vector<Submesh>& getSubmeshes() const { return _submeshes; }
+    // relative to the baseVertex of their submesh, empty with CpuRetention::None
     const std::vector<uint32_t>& getIndices() const { return _indices; }
+    // empty unless CpuRetention::All
     const std::vector<Vertex>& getVertices() const { return _vertices; }
     const Vertex& getVertex(int i) const { return _vertices[i]; }
+    // with CpuRetention::All or Positions
+    const glm::vec3& getPosition(size_t i) const {
+        return _vertices.empty() ? _positions[i] : _vertices[i].position;
+    }
+
+    // bytes of the mesh data kept on the cpu
+    size_t getMemoryUsage() const;
+
+    // the records of an obj handed out one by one, none of them kept
+    struct ObjStreamHandler {
+        // the v, vn and vt records in file order
+        std::function<void(const float* xyz)> position;
+        std::function<void(const float* xyz)> normal;
+        std::function<void(const float* uv)> texCoord;
+        // a face, fan-triangulated, under the material in effect, -1 for none
+        std::function<void(const index_t* corners, int material)> triangle;
+    };
+
+    // read an obj through the mapped file without building a mesh, for
+    // meshes larger than memory. the materials of its mtllib records are
+    // read into materials and the mtl files tried appended to libraries,
+    // false with err set if the file cannot be opened
+    static bool StreamObj(const std::string& filepath, const ObjStreamHandler& handler,
+        std::vector<material_t>* materials, std::vector<std::string>* libraries, std::string* err);
+
+    // pack vertices into the VertexFormat::Compact layout
+    static std::vector<CompactVertex> quantizeVertices(const Vertex* vertices, size_t vertexCount,
+        const BoundingBox& boundingBox);
 public:
     Transform transform;
     std::vector<material_t> _materials;
 
 protected:
+    // the mtl files the last parse tried, found or not, so the cache can
+    // tell when they change
+    std::vector<std::string> _materialLibraries;
+
     // vertices of the table represented in model's own coordinate
     std::vector<Vertex> _vertices;
-    std::vector<VertexMaterial> _vertex_material;
     std::vector<uint32_t> _indices;
+    std::vector<Submesh> _submeshes;
+    // the positions of _vertices once CpuRetention::Positions released them
+    std::vector<glm::vec3> _positions;
 
-    // bounding box
+    ModelLoadOptions::CpuRetention _cpuRetention = ModelLoadOptions::CpuRetention::All;
+
+    // bounding box of the whole model
     BoundingBox _boundingBox;
 
+    ModelLoadOptions::VertexFormat _vertexFormat = ModelLoadOptions::VertexFormat::Float;
+
     // opengl objects
     GLuint _vao = 0;
     GLuint _vbo = 0;
     GLuint _ebo = 0;
 
+    // position only stream over the same vertices, sharing _ebo
+    GLuint _depthVao = 0;
+    GLuint _positionVbo = 0;
+
     GLuint _boxVao = 0;
     GLuint _boxVbo = 0;
     GLuint _boxEbo = 0;
 
+    // glMultiDrawElementsBaseVertex arguments, kept to avoid allocating per draw
+    mutable std::vector<GLsizei> _drawCounts;
+    mutable std::vector<const void*> _drawOffsets;
+    mutable std::vector<GLint> _drawBaseVertices;
+    // the material of each queued draw
+    mutable std::vector<int> _drawMaterials;
+
+    // queue a level of a submesh for the next flushDraws
+    void appendDraw(const Submesh& submesh, uint32_t lod = 0) const;
+
+    void flushDraws(const MaterialBinder& bindMaterial, GLuint vao) const;
+
+    // bounding boxes of every submesh and of the whole model
     void computeBoundingBox();
 
     void initGLResources();
 
+    void initGLResources(const Vertex* vertices, size_t vertexCount,
+        const uint32_t* indices, size_t indexCount);
+
+    bool loadCache(const std::string& cachePath, const std::string& filepath,
+        const ModelLoadOptions& options);
+
+    // identifies the load options that change the final buffers, so a cache
+    // built with different options is not mistaken for a valid one
+    static uint64_t getCacheVariant(const ModelLoadOptions& options);
+
+    // empty vertex and index buffers with room for the background load
+    void allocateGLResources(size_t vertexCapacity, size_t indexCapacity);
+
+    // the vertex attributes of _vertexFormat on the bound vao and vbo
+    void setupVertexAttributes();
+
+    // the depth vao over a position buffer with room for vertexCapacity vertices
+    void initDepthGLResources(size_t vertexCapacity);
+
+    // write the positions of vertices [firstVertex, firstVertex + count) to the position buffer
+    void uploadPositions(size_t firstVertex, const Vertex* vertices, size_t count);
+
+    void uploadPositions(size_t firstVertex, const CompactVertex* vertices, size_t count);
+
+    // append a staging model of the worker to the buffers
+    void appendBatch(Model* batch);
+
     void initBoxGLResources();
 
+    // free the cpu side copies _cpuRetention does not keep, or move them to
+    // releasedVertices and releasedIndices when given, and report the rest
+    void releaseCpuCopies(std::vector<Vertex>* releasedVertices = nullptr,
+        std::vector<uint32_t>* releasedIndices = nullptr);
+
     void cleanup();
+
+    std::unique_ptr<async_load_t> _asyncLoad;
+
+    // indices the element buffer can hold before appendBatch grows it
+    size_t _indexCapacity = 0;
 };
\ No newline at end of file
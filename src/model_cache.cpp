@@ -0,0 +1,681 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+#include "model_cache.h"
+#include "mesh_codec.h"
+#include "./base/parallel.h"
+
+namespace {
+struct header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertexStride;
+	uint64_t variant;
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint64_t sourceHash;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t materialCount;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t materialOffset;
+	uint64_t materialSize;
+	uint64_t submeshOffset;
+	uint64_t submeshSize;
+	float boundsMin[3];
+	float boundsMax[3];
+	// the mesh_codec image replacing the vertex and index sections, if any
+	uint64_t codecOffset;
+	uint64_t codecSize;
+	// the sources of the material table
+	uint64_t libraryOffset;
+	uint64_t librarySize;
+};
+
+const char cacheMagic[8] = { 'L', 'O', 'F', 'T', 'M', 'S', 'H', '\0' };
+
+// sections start on 16-byte boundaries
+constexpr uint64_t sectionAlignment = 16;
+
+uint64_t alignOffset(uint64_t offset) {
+	return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+bool statFile(const std::string& path, uint64_t* size, int64_t* mtime) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0) {
+		return false;
+	}
+	*mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) {
+		return false;
+	}
+#if defined(__APPLE__)
+	*mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+	*mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+	*mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#endif
+#endif
+	*size = static_cast<uint64_t>(st.st_size);
+	return true;
+}
+
+inline uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+// 64-bit hash over 32-byte stripes with four independent lanes (xxHash-style
+// mixing), so hashing a mapped file runs close to memory bandwidth
+uint64_t hashBytes(const char* data, size_t size) {
+	constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+	constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+	constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+	auto round = [](uint64_t acc, uint64_t value) {
+		acc += value * prime2;
+		acc = rotl(acc, 31);
+		return acc * prime1;
+	};
+
+	uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		for (int lane = 0; lane < 4; ++lane) {
+			uint64_t value;
+			memcpy(&value, data + i + 8 * lane, sizeof(value));
+			lanes[lane] = round(lanes[lane], value);
+		}
+	}
+
+	uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+	hash += static_cast<uint64_t>(size);
+
+	for (; i + 8 <= size; i += 8) {
+		uint64_t value;
+		memcpy(&value, data + i, sizeof(value));
+		hash ^= round(0, value);
+		hash = rotl(hash, 27) * prime1 + prime4;
+	}
+
+	for (; i < size; ++i) {
+		hash ^= static_cast<uint8_t>(data[i]) * prime5;
+		hash = rotl(hash, 11) * prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+// overwrite the source mtime recorded in the header of a cache
+bool writeSourceMtime(const std::string& cachePath, int64_t sourceMtime) {
+	std::fstream stream(cachePath, std::ios::binary | std::ios::in | std::ios::out);
+	if (!stream) {
+		return false;
+	}
+
+	stream.seekp(offsetof(header_t, sourceMtime));
+	stream.write(reinterpret_cast<const char*>(&sourceMtime), sizeof(sourceMtime));
+	return static_cast<bool>(stream);
+}
+
+bool hashFile(const std::string& path, uint64_t* hash) {
+	MappedFile file(path);
+	if (!file.isOpen()) {
+		return false;
+	}
+
+	*hash = hashBytes(file.data(), file.size());
+	return true;
+}
+
+template <typename T>
+void writeValue(std::string& out, const T& value) {
+	out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeString(std::string& out, const std::string& value) {
+	writeValue(out, static_cast<uint32_t>(value.size()));
+	out.append(value);
+}
+
+template <typename T>
+bool readValue(const char*& p, const char* end, T* value) {
+	if (static_cast<size_t>(end - p) < sizeof(T)) {
+		return false;
+	}
+
+	memcpy(value, p, sizeof(T));
+	p += sizeof(T);
+	return true;
+}
+
+bool readString(const char*& p, const char* end, std::string* value) {
+	uint32_t length;
+	if (!readValue(p, end, &length) || static_cast<size_t>(end - p) < length) {
+		return false;
+	}
+
+	value->assign(p, length);
+	p += length;
+	return true;
+}
+
+// every range of the submeshes lies within the buffers and every index
+// within the vertices of its submesh, so a corrupt cache can not make the
+// draws read out of bounds
+bool checkSubmeshes(const std::vector<Model::Submesh>& submeshes, const uint32_t* indices,
+	uint64_t vertexCount, uint64_t indexCount, uint64_t materialCount, unsigned threads) {
+	std::vector<char> valid(submeshes.size(), 0);
+	parallelFor(submeshes.size(), [&](size_t i) {
+		const Model::Submesh& submesh = submeshes[i];
+		auto checkRange = [&](uint64_t firstIndex, uint64_t count) {
+			if (firstIndex + count > indexCount) {
+				return false;
+			}
+			for (uint64_t j = firstIndex; j < firstIndex + count; ++j) {
+				if (indices[j] >= submesh.vertexCount) {
+					return false;
+				}
+			}
+			return true;
+		};
+
+		if (static_cast<uint64_t>(submesh.baseVertex) + submesh.vertexCount > vertexCount ||
+			submesh.material < -1 || submesh.material >= static_cast<int64_t>(materialCount) ||
+			!checkRange(submesh.firstIndex, submesh.indexCount)) {
+			return;
+		}
+		for (const auto& lod : submesh.lods) {
+			if (!checkRange(lod.firstIndex, lod.indexCount)) {
+				return;
+			}
+		}
+		const uint64_t baseEnd = static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount;
+		for (const auto& meshlet : submesh.meshlets) {
+			if (meshlet.firstIndex < submesh.firstIndex ||
+				static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount > baseEnd) {
+				return;
+			}
+		}
+		valid[i] = 1;
+	}, threads);
+
+	return std::find(valid.begin(), valid.end(), 0) == valid.end();
+}
+}
+
+std::string ModelCache::getCachePath(const std::string& sourcePath) {
+	return sourcePath + ".cache";
+}
+
+bool ModelCache::open(const std::string& cachePath, const std::string& sourcePath,
+	uint64_t variant, bool verifyHash, std::string* err, unsigned threads) {
+	std::stringstream errss;
+
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	if (!statFile(sourcePath, &sourceSize, &sourceMtime)) {
+		errss << "Cannot stat file [" << sourcePath << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		return false;
+	}
+
+	if (!_file.open(cachePath)) {
+		return false;
+	}
+
+	header_t header;
+	if (_file.size() < sizeof(header)) {
+		_file.close();
+		return false;
+	}
+	memcpy(&header, _file.data(), sizeof(header));
+
+	// a compressed cache leaves the raw sections empty
+	const uint64_t fileSize = _file.size();
+	const uint64_t rawVertexCount = header.codecSize != 0 ? 0 : header.vertexCount;
+	const uint64_t rawIndexCount = header.codecSize != 0 ? 0 : header.indexCount;
+	const bool valid =
+		memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) == 0 &&
+		header.version == version &&
+		header.vertexStride == sizeof(Vertex) &&
+		header.variant == variant &&
+		header.sourceSize == sourceSize &&
+		header.vertexOffset + rawVertexCount * sizeof(Vertex) <= fileSize &&
+		header.indexOffset + rawIndexCount * sizeof(uint32_t) <= fileSize &&
+		header.materialOffset + header.materialSize <= fileSize &&
+		header.submeshOffset + header.submeshSize <= fileSize &&
+		header.codecOffset + header.codecSize <= fileSize &&
+		header.libraryOffset + header.librarySize <= fileSize;
+	if (!valid) {
+		_file.close();
+		return false;
+	}
+
+	if (verifyHash || header.sourceMtime != sourceMtime) {
+		uint64_t sourceHash;
+		if (!hashFile(sourcePath, &sourceHash) || sourceHash != header.sourceHash) {
+			_file.close();
+			return false;
+		}
+
+		// the source was touched but not changed, record its mtime so the
+		// next open does not hash it again. a cache that can not be written
+		// to stays valid, it is only hashed on every open
+		if (header.sourceMtime != sourceMtime) {
+			_file.close();
+			writeSourceMtime(cachePath, sourceMtime);
+			if (!_file.open(cachePath) || _file.size() != fileSize) {
+				_file.close();
+				return false;
+			}
+		}
+	}
+
+	if (!checkSources(_file.data() + header.libraryOffset, static_cast<size_t>(header.librarySize), verifyHash)) {
+		_file.close();
+		return false;
+	}
+
+	_compressed = header.codecSize != 0;
+	if (_compressed) {
+		if (!decodeMesh(_file.data() + header.codecOffset, static_cast<size_t>(header.codecSize),
+			&_decodedVertices, &_decodedIndices, threads) ||
+			_decodedVertices.size() != header.vertexCount || _decodedIndices.size() != header.indexCount) {
+			_file.close();
+			return false;
+		}
+		_vertices = reinterpret_cast<const char*>(_decodedVertices.data());
+		_indices = reinterpret_cast<const char*>(_decodedIndices.data());
+	}
+	else {
+		_vertices = _file.data() + header.vertexOffset;
+		_indices = _file.data() + header.indexOffset;
+	}
+	_materials = _file.data() + header.materialOffset;
+	_materialsEnd = _materials + header.materialSize;
+	_vertexCount = static_cast<size_t>(header.vertexCount);
+	_indexCount = static_cast<size_t>(header.indexCount);
+
+	const char* submeshes = _file.data() + header.submeshOffset;
+	if (!readSubmeshes(submeshes, submeshes + header.submeshSize, &_submeshes) ||
+		!checkSubmeshes(_submeshes, getIndices(), header.vertexCount, header.indexCount, header.materialCount, threads)) {
+		close();
+		return false;
+	}
+	_boundingBox.min = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	_boundingBox.max = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+	return true;
+}
+
+void ModelCache::close() {
+	_file.close();
+	std::vector<Vertex>().swap(_decodedVertices);
+	std::vector<uint32_t>().swap(_decodedIndices);
+	_submeshes.clear();
+	_compressed = false;
+}
+
+bool ModelCache::isCompressed() const {
+	return _compressed;
+}
+
+const Vertex* ModelCache::getVertices() const {
+	return reinterpret_cast<const Vertex*>(_vertices);
+}
+
+size_t ModelCache::getVertexCount() const {
+	return _vertexCount;
+}
+
+const uint32_t* ModelCache::getIndices() const {
+	return reinterpret_cast<const uint32_t*>(_indices);
+}
+
+size_t ModelCache::getIndexCount() const {
+	return _indexCount;
+}
+
+BoundingBox ModelCache::getBoundingBox() const {
+	return _boundingBox;
+}
+
+std::vector<Model::material_t> ModelCache::getMaterials() const {
+	return readMaterials(_materials, static_cast<size_t>(_materialsEnd - _materials));
+}
+
+std::vector<Model::material_t> ModelCache::readMaterials(const char* data, size_t size) {
+	std::vector<Model::material_t> materials;
+
+	const char* p = data;
+	const char* const end = data + size;
+	uint64_t count = 0;
+	if (!readValue(p, end, &count)) {
+		return materials;
+	}
+
+	for (uint64_t i = 0; i < count; ++i) {
+		Model::material_t material;
+		uint32_t parameterCount = 0;
+		bool ok = readString(p, end, &material.name) &&
+			readValue(p, end, &material.ka) &&
+			readValue(p, end, &material.kd) &&
+			readValue(p, end, &material.ks) &&
+			readValue(p, end, &material.ke) &&
+			readValue(p, end, &material.ns) &&
+			readValue(p, end, &material.ni) &&
+			readValue(p, end, &material.d) &&
+			readValue(p, end, &material.illum) &&
+			readValue(p, end, &parameterCount);
+
+		for (uint32_t j = 0; ok && j < parameterCount; ++j) {
+			std::string key, value;
+			ok = readString(p, end, &key) && readString(p, end, &value);
+			material.unknown_parameter.insert(std::make_pair(key, value));
+		}
+
+		if (!ok) {
+			break;
+		}
+
+		materials.push_back(material);
+	}
+
+	return materials;
+}
+
+const std::vector<Model::Submesh>& ModelCache::getSubmeshes() const {
+	return _submeshes;
+}
+
+bool ModelCache::readSubmeshes(const char* p, const char* end, std::vector<Model::Submesh>* submeshes) {
+	uint64_t count = 0;
+	if (!readValue(p, end, &count)) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < count; ++i) {
+		Model::Submesh submesh;
+		bool ok = readString(p, end, &submesh.name) &&
+			readValue(p, end, &submesh.firstIndex) &&
+			readValue(p, end, &submesh.indexCount) &&
+			readValue(p, end, &submesh.baseVertex) &&
+			readValue(p, end, &submesh.vertexCount) &&
+			readValue(p, end, &submesh.material) &&
+			readValue(p, end, &submesh.boundingBox.min) &&
+			readValue(p, end, &submesh.boundingBox.max);
+
+		uint32_t lodCount = 0;
+		ok = ok && readValue(p, end, &lodCount);
+		for (uint32_t level = 0; ok && level < lodCount; ++level) {
+			Model::SubmeshLod lod;
+			ok = readValue(p, end, &lod.firstIndex) &&
+				readValue(p, end, &lod.indexCount) &&
+				readValue(p, end, &lod.error);
+			submesh.lods.push_back(lod);
+		}
+
+		uint32_t meshletCount = 0;
+		ok = ok && readValue(p, end, &meshletCount);
+		for (uint32_t j = 0; ok && j < meshletCount; ++j) {
+			Meshlet meshlet;
+			ok = readValue(p, end, &meshlet);
+			submesh.meshlets.push_back(meshlet);
+		}
+		if (!ok) {
+			return false;
+		}
+
+		submeshes->push_back(std::move(submesh));
+	}
+
+	return true;
+}
+
+void ModelCache::writeMaterials(const std::vector<Model::material_t>& materials, std::string* out) {
+	writeValue(*out, static_cast<uint64_t>(materials.size()));
+	for (const auto& material : materials) {
+		writeString(*out, material.name);
+		writeValue(*out, material.ka);
+		writeValue(*out, material.kd);
+		writeValue(*out, material.ks);
+		writeValue(*out, material.ke);
+		writeValue(*out, material.ns);
+		writeValue(*out, material.ni);
+		writeValue(*out, material.d);
+		writeValue(*out, material.illum);
+		writeValue(*out, static_cast<uint32_t>(material.unknown_parameter.size()));
+		for (const auto& parameter : material.unknown_parameter) {
+			writeString(*out, parameter.first);
+			writeString(*out, parameter.second);
+		}
+	}
+}
+
+bool ModelCache::writeSources(const std::vector<std::string>& paths, std::string* out, std::string* err) {
+	writeValue(*out, static_cast<uint64_t>(paths.size()));
+	for (const auto& path : paths) {
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+		const uint32_t exists = statFile(path, &size, &mtime) ? 1 : 0;
+		if (exists && !hashFile(path, &hash)) {
+			if (err) {
+				(*err) = "Cannot read file [" + path + "]\n";
+			}
+			return false;
+		}
+
+		writeString(*out, path);
+		writeValue(*out, exists);
+		writeValue(*out, size);
+		writeValue(*out, mtime);
+		writeValue(*out, hash);
+	}
+	return true;
+}
+
+bool ModelCache::checkSources(const char* data, size_t size, bool verifyHash) {
+	const char* p = data;
+	const char* const end = data + size;
+	uint64_t count = 0;
+	if (!readValue(p, end, &count)) {
+		return false;
+	}
+
+	for (uint64_t i = 0; i < count; ++i) {
+		std::string path;
+		uint32_t exists;
+		uint64_t recordedSize;
+		int64_t recordedMtime;
+		uint64_t recordedHash;
+		if (!readString(p, end, &path) || !readValue(p, end, &exists) || !readValue(p, end, &recordedSize) ||
+			!readValue(p, end, &recordedMtime) || !readValue(p, end, &recordedHash)) {
+			return false;
+		}
+
+		uint64_t sourceSize;
+		int64_t sourceMtime;
+		if (!statFile(path, &sourceSize, &sourceMtime)) {
+			if (exists) {
+				return false;
+			}
+			continue;
+		}
+		if (!exists || sourceSize != recordedSize) {
+			return false;
+		}
+
+		uint64_t sourceHash;
+		if ((verifyHash || sourceMtime != recordedMtime) &&
+			(!hashFile(path, &sourceHash) || sourceHash != recordedHash)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ModelCache::write(const std::string& cachePath, const std::string& sourcePath,
+	const std::vector<std::string>& materialLibraries, uint64_t variant,
+	const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	const std::vector<Model::Submesh>& submeshes, const BoundingBox& boundingBox, const std::vector<Model::material_t>& materials,
+	bool compress, std::string* err, unsigned threads) {
+	std::stringstream errss;
+
+	header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = version;
+	header.vertexStride = sizeof(Vertex);
+	header.variant = variant;
+
+	if (!statFile(sourcePath, &header.sourceSize, &header.sourceMtime) ||
+		!hashFile(sourcePath, &header.sourceHash)) {
+		errss << "Cannot read file [" << sourcePath << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		return false;
+	}
+
+	std::string libraryData;
+	if (!writeSources(materialLibraries, &libraryData, err)) {
+		return false;
+	}
+
+	std::string materialData;
+	writeMaterials(materials, &materialData);
+
+	std::string submeshData;
+	writeValue(submeshData, static_cast<uint64_t>(submeshes.size()));
+	for (const auto& submesh : submeshes) {
+		writeString(submeshData, submesh.name);
+		writeValue(submeshData, submesh.firstIndex);
+		writeValue(submeshData, submesh.indexCount);
+		writeValue(submeshData, submesh.baseVertex);
+		writeValue(submeshData, submesh.vertexCount);
+		writeValue(submeshData, submesh.material);
+		writeValue(submeshData, submesh.boundingBox.min);
+		writeValue(submeshData, submesh.boundingBox.max);
+		writeValue(submeshData, static_cast<uint32_t>(submesh.lods.size()));
+		for (const auto& lod : submesh.lods) {
+			writeValue(submeshData, lod.firstIndex);
+			writeValue(submeshData, lod.indexCount);
+			writeValue(submeshData, lod.error);
+		}
+		writeValue(submeshData, static_cast<uint32_t>(submesh.meshlets.size()));
+		for (const auto& meshlet : submesh.meshlets) {
+			writeValue(submeshData, meshlet);
+		}
+	}
+
+	// every submesh and lod range numbers its vertices from 0
+	std::string codecData;
+	if (compress) {
+		std::vector<size_t> rangeStarts;
+		for (const auto& submesh : submeshes) {
+			rangeStarts.push_back(submesh.firstIndex);
+			for (const auto& lod : submesh.lods) {
+				rangeStarts.push_back(lod.firstIndex);
+			}
+		}
+		encodeMesh(vertices.data(), vertices.size(), indices.data(), indices.size(), rangeStarts, &codecData, threads);
+	}
+	const size_t rawVertexCount = compress ? 0 : vertices.size();
+	const size_t rawIndexCount = compress ? 0 : indices.size();
+
+	header.vertexCount = vertices.size();
+	header.indexCount = indices.size();
+	header.materialCount = materials.size();
+	header.vertexOffset = alignOffset(sizeof(header));
+	header.indexOffset = alignOffset(header.vertexOffset + rawVertexCount * sizeof(Vertex));
+	header.codecOffset = alignOffset(header.indexOffset + rawIndexCount * sizeof(uint32_t));
+	header.codecSize = codecData.size();
+	header.materialOffset = alignOffset(header.codecOffset + codecData.size());
+	header.materialSize = materialData.size();
+	header.submeshOffset = alignOffset(header.materialOffset + materialData.size());
+	header.submeshSize = submeshData.size();
+	header.libraryOffset = alignOffset(header.submeshOffset + submeshData.size());
+	header.librarySize = libraryData.size();
+	for (int i = 0; i < 3; ++i) {
+		header.boundsMin[i] = boundingBox.min[i];
+		header.boundsMax[i] = boundingBox.max[i];
+	}
+
+	// write next to the target and rename, so a crash never leaves a torn cache
+	const std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream outStream(tempPath, std::ios::binary | std::ios::trunc);
+		if (!outStream) {
+			errss << "Cannot open file [" << tempPath << "]" << std::endl;
+			if (err) {
+				(*err) = errss.str();
+			}
+			return false;
+		}
+
+		const char padding[sectionAlignment] = {};
+		auto pad = [&](uint64_t offset) {
+			outStream.write(padding, static_cast<std::streamsize>(offset - static_cast<uint64_t>(outStream.tellp())));
+		};
+
+		outStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		pad(header.vertexOffset);
+		outStream.write(reinterpret_cast<const char*>(vertices.data()),
+			static_cast<std::streamsize>(rawVertexCount * sizeof(Vertex)));
+		pad(header.indexOffset);
+		outStream.write(reinterpret_cast<const char*>(indices.data()),
+			static_cast<std::streamsize>(rawIndexCount * sizeof(uint32_t)));
+		pad(header.codecOffset);
+		outStream.write(codecData.data(), static_cast<std::streamsize>(codecData.size()));
+		pad(header.materialOffset);
+		outStream.write(materialData.data(), static_cast<std::streamsize>(materialData.size()));
+		pad(header.submeshOffset);
+		outStream.write(submeshData.data(), static_cast<std::streamsize>(submeshData.size()));
+		pad(header.libraryOffset);
+		outStream.write(libraryData.data(), static_cast<std::streamsize>(libraryData.size()));
+
+		if (!outStream) {
+			errss << "Write file [" << tempPath << "] failure" << std::endl;
+			if (err) {
+				(*err) = errss.str();
+			}
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		errss << "Cannot rename [" << tempPath << "] to [" << cachePath << "]" << std::endl;
+		if (err) {
+			(*err) = errss.str();
+		}
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
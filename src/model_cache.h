@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "./base/bounding_box.h"
+#include "./base/mapped_file.h"
+#include "model.h"
+
+// binary image of a loaded Model: the final vertex and index buffers, the
+// submesh table with its lod ranges and meshlets, the bounding box and the
+// material table. It is keyed by the size, mtime and content hash of the
+// source obj and of the mtl files it read, plus a variant id for the load
+// options. the vertex and index buffers are either stored raw or as one
+// mesh_codec image
+class ModelCache {
+public:
+	// bump whenever the file layout, Vertex or Meshlet changes
+	static constexpr uint32_t version = 7;
+
+	static std::string getCachePath(const std::string& sourcePath);
+
+	// map the cache, false if it is missing, stale, out of bounds or was
+	// written by another version. the hash of the source is compared when
+	// its mtime differs from the recorded one, which is then updated, or
+	// always with verifyHash. the material libraries are checked the same
+	// way, without updating their mtimes. a compressed cache is decoded here on up to
+	// threads threads
+	bool open(const std::string& cachePath, const std::string& sourcePath,
+		uint64_t variant, bool verifyHash, std::string* err, unsigned threads = 0);
+
+	bool isCompressed() const;
+
+	// the buffers point into the mapping, or into the decoded copies of a
+	// compressed cache, and stay valid while the cache is open
+	const Vertex* getVertices() const;
+
+	size_t getVertexCount() const;
+
+	const uint32_t* getIndices() const;
+
+	size_t getIndexCount() const;
+
+	BoundingBox getBoundingBox() const;
+
+	std::vector<Model::material_t> getMaterials() const;
+
+	// read and checked against the buffers by open()
+	const std::vector<Model::Submesh>& getSubmeshes() const;
+
+	// the layout of the material section, shared with the octree files
+	static void writeMaterials(const std::vector<Model::material_t>& materials, std::string* out);
+
+	static std::vector<Model::material_t> readMaterials(const char* data, size_t size);
+
+	// the size, mtime and hash of the files a model was read from, or that
+	// it tried to read and did not exist, in the layout shared with the
+	// octree files
+	static bool writeSources(const std::vector<std::string>& paths, std::string* out, std::string* err);
+
+	// false if any of the recorded files was changed, created or removed
+	// since. a hash is only compared when the mtime differs, or always with
+	// verifyHash
+	static bool checkSources(const char* data, size_t size, bool verifyHash);
+
+	static bool write(const std::string& cachePath, const std::string& sourcePath,
+		const std::vector<std::string>& materialLibraries, uint64_t variant,
+		const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		const std::vector<Model::Submesh>& submeshes, const BoundingBox& boundingBox, const std::vector<Model::material_t>& materials,
+		bool compress, std::string* err, unsigned threads = 0);
+
+private:
+	static bool readSubmeshes(const char* p, const char* end, std::vector<Model::Submesh>* submeshes);
+
+	void close();
+
+	MappedFile _file;
+
+	const char* _vertices = nullptr;
+	const char* _indices = nullptr;
+	const char* _materials = nullptr;
+	const char* _materialsEnd = nullptr;
+	std::vector<Model::Submesh> _submeshes;
+	size_t _vertexCount = 0;
+	size_t _indexCount = 0;
+	BoundingBox _boundingBox;
+
+	std::vector<Vertex> _decodedVertices;
+	std::vector<uint32_t> _decodedIndices;
+	bool _compressed = false;
+};
@@ -0,0 +1,166 @@
+#include "normal_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "./base/parallel.h"
+
+namespace {
+glm::vec3 getPosition(const float* positions, uint32_t index) {
+	return glm::vec3(positions[3 * index + 0], positions[3 * index + 1], positions[3 * index + 2]);
+}
+
+// angle of a triangle at corner, between the edges to a and b
+float getCornerAngle(const glm::vec3& corner, const glm::vec3& a, const glm::vec3& b) {
+	const glm::vec3 u = a - corner;
+	const glm::vec3 v = b - corner;
+	const float lengths = std::sqrt(glm::dot(u, u) * glm::dot(v, v));
+	if (lengths == 0.0f) {
+		return 0.0f;
+	}
+	return std::acos(glm::clamp(glm::dot(u, v) / lengths, -1.0f, 1.0f));
+}
+}
+
+void generateNormals(const float* positions, size_t positionCount,
+	const uint32_t* corners, size_t cornerCount, float creaseAngle, NormalWeighting weighting,
+	std::vector<glm::vec3>* normals, std::vector<uint32_t>* cornerNormals, unsigned threads) {
+	normals->clear();
+	cornerNormals->assign(cornerCount, 0);
+	if (positionCount == 0 || cornerCount == 0) {
+		return;
+	}
+	if (cornerCount > 0xffffffffu) {
+		throw std::runtime_error("too many face corners for 32-bit corner ids");
+	}
+
+	const size_t triangleCount = cornerCount / 3;
+	const size_t grain = 1 << 16;
+	const float cosCrease = std::cos(creaseAngle);
+
+	// unit face normals for the crease test, and the weight of every corner's face
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<float> cornerWeights(cornerCount);
+	parallelForRange(triangleCount, grain, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; ++t) {
+			const glm::vec3 p[3] = {
+				getPosition(positions, corners[3 * t + 0]),
+				getPosition(positions, corners[3 * t + 1]),
+				getPosition(positions, corners[3 * t + 2])
+			};
+			const glm::vec3 cross = glm::cross(p[1] - p[0], p[2] - p[0]);
+			const float length = glm::length(cross);
+			faceNormals[t] = length > 0.0f ? cross / length : glm::vec3(0.0f);
+			for (int k = 0; k < 3; ++k) {
+				cornerWeights[3 * t + k] = weighting == NormalWeighting::Area ? length :
+					getCornerAngle(p[k], p[(k + 1) % 3], p[(k + 2) % 3]);
+			}
+		}
+	}, threads);
+
+	// scatter the corners into buckets of consecutive positions: every slice
+	// of corners counts its buckets, a prefix sum over (bucket, slice) gives
+	// each slice its own write cursor per bucket, so no two threads share one
+	const size_t workers = getWorkerCount(threads);
+	const size_t bucketCount = std::min<size_t>(workers * 4, positionCount);
+	const size_t bucketSize = (positionCount + bucketCount - 1) / bucketCount;
+	const size_t sliceCount = std::max<size_t>(std::min<size_t>((cornerCount + grain - 1) / grain, workers * 4), 1);
+
+	std::vector<size_t> cursors(sliceCount * bucketCount, 0);
+	parallelFor(sliceCount, [&](size_t slice) {
+		size_t* counts = cursors.data() + slice * bucketCount;
+		for (size_t c = cornerCount * slice / sliceCount; c < cornerCount * (slice + 1) / sliceCount; ++c) {
+			++counts[corners[c] / bucketSize];
+		}
+	}, threads);
+
+	std::vector<size_t> bucketStarts(bucketCount + 1, 0);
+	size_t sum = 0;
+	for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+		bucketStarts[bucket] = sum;
+		for (size_t slice = 0; slice < sliceCount; ++slice) {
+			const size_t count = cursors[slice * bucketCount + bucket];
+			cursors[slice * bucketCount + bucket] = sum;
+			sum += count;
+		}
+	}
+	bucketStarts[bucketCount] = sum;
+
+	std::vector<uint32_t> bucketed(cornerCount);
+	parallelFor(sliceCount, [&](size_t slice) {
+		size_t* next = cursors.data() + slice * bucketCount;
+		for (size_t c = cornerCount * slice / sliceCount; c < cornerCount * (slice + 1) / sliceCount; ++c) {
+			bucketed[next[corners[c] / bucketSize]++] = static_cast<uint32_t>(c);
+		}
+	}, threads);
+
+	// every bucket groups its corners by position and averages each group,
+	// cornerNormals first holds indices into the normals of the bucket
+	std::vector<std::vector<glm::vec3>> bucketNormals(bucketCount);
+	parallelFor(bucketCount, [&](size_t bucket) {
+		const size_t firstPosition = bucket * bucketSize;
+		if (firstPosition >= positionCount) {
+			return;
+		}
+		const size_t bucketPositions = std::min(bucketSize, positionCount - firstPosition);
+		const uint32_t* bucketCorners = bucketed.data() + bucketStarts[bucket];
+		const size_t bucketCornerCount = bucketStarts[bucket + 1] - bucketStarts[bucket];
+
+		std::vector<uint32_t> groupStarts(bucketPositions + 1, 0);
+		for (size_t i = 0; i < bucketCornerCount; ++i) {
+			++groupStarts[corners[bucketCorners[i]] - firstPosition + 1];
+		}
+		for (size_t p = 0; p < bucketPositions; ++p) {
+			groupStarts[p + 1] += groupStarts[p];
+		}
+		std::vector<uint32_t> grouped(bucketCornerCount);
+		std::vector<uint32_t> next(groupStarts.begin(), groupStarts.end() - 1);
+		for (size_t i = 0; i < bucketCornerCount; ++i) {
+			grouped[next[corners[bucketCorners[i]] - firstPosition]++] = bucketCorners[i];
+		}
+
+		std::vector<glm::vec3>& out = bucketNormals[bucket];
+		for (size_t p = 0; p < bucketPositions; ++p) {
+			const uint32_t* group = grouped.data() + groupStarts[p];
+			const size_t groupSize = groupStarts[p + 1] - groupStarts[p];
+			const size_t firstNormal = out.size();
+			for (size_t i = 0; i < groupSize; ++i) {
+				const glm::vec3& own = faceNormals[group[i] / 3];
+				glm::vec3 normal(0.0f);
+				for (size_t j = 0; j < groupSize; ++j) {
+					const glm::vec3& other = faceNormals[group[j] / 3];
+					if (glm::dot(own, other) >= cosCrease) {
+						normal += other * cornerWeights[group[j]];
+					}
+				}
+				const float length = glm::length(normal);
+				normal = length > 0.0f ? normal / length : own;
+
+				// smooth corners of the position mostly share one normal
+				size_t index = firstNormal;
+				while (index < out.size() && out[index] != normal) {
+					++index;
+				}
+				if (index == out.size()) {
+					out.push_back(normal);
+				}
+				(*cornerNormals)[group[i]] = static_cast<uint32_t>(index);
+			}
+		}
+	}, threads);
+
+	std::vector<size_t> normalStarts(bucketCount + 1, 0);
+	for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+		normalStarts[bucket + 1] = normalStarts[bucket] + bucketNormals[bucket].size();
+	}
+	normals->resize(normalStarts[bucketCount]);
+	parallelFor(bucketCount, [&](size_t bucket) {
+		std::copy(bucketNormals[bucket].begin(), bucketNormals[bucket].end(), normals->begin() + normalStarts[bucket]);
+		std::vector<glm::vec3>().swap(bucketNormals[bucket]);
+		const uint32_t offset = static_cast<uint32_t>(normalStarts[bucket]);
+		for (size_t i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i) {
+			(*cornerNormals)[bucketed[i]] += offset;
+		}
+	}, threads);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+enum class NormalWeighting {
+	// every face counts with its area
+	Area,
+	// every face counts with its angle at the corner, independent of how
+	// the surface around the vertex is tessellated
+	Angle
+};
+
+// smooth normals for a triangle list, corners[3t + k] is the position index
+// of corner k of triangle t into the xyz floats of positions. a corner gets
+// the weighted average of the faces around its position whose normal is
+// within creaseAngle radians of its own face, so sharper edges stay
+// faceted. corners of a position that end up with the same normal share it:
+// normals receives the distinct normals, cornerNormals[c] the one of corner
+// c. corners are bucketed by position without atomics, then every bucket is
+// processed on its own thread
+void generateNormals(const float* positions, size_t positionCount,
+	const uint32_t* corners, size_t cornerCount, float creaseAngle, NormalWeighting weighting,
+	std::vector<glm::vec3>* normals, std::vector<uint32_t>* cornerNormals, unsigned threads = 0);
@@ -0,0 +1,357 @@
+#include "octree_pager.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+
+#include "./base/gl_state.h"
+
+namespace {
+// 0 inside the box
+float getDistance(const glm::vec3& point, const BoundingBox& box) {
+	return glm::length(glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f)));
+}
+
+struct candidate_t {
+	uint32_t chunk;
+	bool visible;
+	float distance;
+};
+}
+
+OctreePager::OctreePager(const std::string& octreePath, const OctreePagerOptions& options)
+	: _options(options) {
+	std::string err;
+	if (!_octree.open(octreePath, &err)) {
+		throw std::runtime_error(err);
+	}
+
+	const auto& nodes = _octree.getNodes();
+	_nodeChunks.assign(nodes.size(), 0);
+	for (uint32_t i = 0; i < nodes.size(); ++i) {
+		if (nodes[i].isLeaf()) {
+			_nodeChunks[i] = static_cast<uint32_t>(_chunks.size());
+			chunk_t chunk;
+			chunk.node = i;
+			chunk.memory = nodes[i].getChunkMemory();
+			_chunks.push_back(chunk);
+		}
+	}
+
+	const unsigned threads = std::max(_options.threads, 1u);
+	for (unsigned i = 0; i < threads; ++i) {
+		_workers.emplace_back(&OctreePager::workerLoop, this);
+	}
+}
+
+OctreePager::~OctreePager() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_condition.notify_all();
+	for (auto& worker : _workers) {
+		worker.join();
+	}
+
+	for (auto& chunk : _chunks) {
+		if (chunk.state == ChunkState::Resident) {
+			evict(&chunk);
+		}
+	}
+}
+
+void OctreePager::workerLoop() {
+	for (;;) {
+		std::unique_ptr<decoded_chunk_t> decoded(new decoded_chunk_t);
+		{
+			// a chunk larger than the whole budget still loads on its own
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [&]() {
+				return _stopping || (!_requests.empty() &&
+					(_cpuUsage == 0 || _cpuUsage + _chunks[_requests.front()].memory <= _options.cpuBudget));
+			});
+			if (_stopping) {
+				return;
+			}
+
+			decoded->chunk = _requests.front();
+			_requests.pop_front();
+			_cpuUsage += _chunks[decoded->chunk].memory;
+		}
+
+		decoded->failed = !_octree.readChunk(_chunks[decoded->chunk].node, &decoded->vertices, &decoded->indices);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_decoded.push_back(std::move(decoded));
+	}
+}
+
+void OctreePager::update(const PerspectiveCamera& camera, float deltaTime) {
+	++_frame;
+
+	const glm::vec3 cameraPosition = camera.transform.position;
+	if (_hasLastCamera && deltaTime > 0.0f) {
+		_cameraVelocity = glm::mix(_cameraVelocity, (cameraPosition - _lastCameraPosition) / deltaTime, 0.25f);
+	}
+	_lastCameraPosition = cameraPosition;
+	_hasLastCamera = true;
+
+	PerspectiveCamera ahead = camera;
+	ahead.transform.position += _cameraVelocity * _options.prefetchTime;
+
+	const glm::mat4 modelMatrix = transform.getLocalMatrix();
+	const glm::mat4 toModel = glm::inverse(modelMatrix);
+	const Frustum frustum = camera.getFrustum();
+	const Frustum aheadFrustum = ahead.getFrustum();
+	const glm::vec3 eye = glm::vec3(toModel * glm::vec4(cameraPosition, 1.0f));
+	const glm::vec3 eyeAhead = glm::vec3(toModel * glm::vec4(ahead.transform.position, 1.0f));
+
+	// the leaves in either frustum and within maxDistance
+	const auto& nodes = _octree.getNodes();
+	std::vector<candidate_t> candidates;
+	std::vector<uint32_t> stack(1, 0);
+
+	_visibleChunks.clear();
+	while (!stack.empty()) {
+		const uint32_t index = stack.back();
+		stack.pop_back();
+		const MeshOctree::Node& node = nodes[index];
+
+		const float distance = std::min(getDistance(eye, node.boundingBox), getDistance(eyeAhead, node.boundingBox));
+		if (distance > _options.maxDistance) {
+			continue;
+		}
+		const bool visible = frustum.intersect(node.boundingBox, modelMatrix);
+		if (!visible && !aheadFrustum.intersect(node.boundingBox, modelMatrix)) {
+			continue;
+		}
+
+		if (!node.isLeaf()) {
+			for (uint32_t child = node.firstChild; child < node.firstChild + node.childCount; ++child) {
+				stack.push_back(child);
+			}
+			continue;
+		}
+
+		const uint32_t chunk = _nodeChunks[index];
+		if (_chunks[chunk].state == ChunkState::Failed) {
+			continue;
+		}
+		candidates.push_back({ chunk, visible, distance });
+		if (visible) {
+			_visibleChunks.push_back(chunk);
+		}
+	}
+
+	// the best ranked chunks that fit into the gpu budget are wanted
+	std::sort(candidates.begin(), candidates.end(), [](const candidate_t& lhs, const candidate_t& rhs) {
+		return lhs.visible != rhs.visible ? lhs.visible : lhs.distance < rhs.distance;
+	});
+	_wantedChunks.clear();
+	size_t wantedMemory = 0;
+	for (const auto& candidate : candidates) {
+		chunk_t& chunk = _chunks[candidate.chunk];
+		if (wantedMemory + chunk.memory > _options.gpuBudget) {
+			break;
+		}
+		wantedMemory += chunk.memory;
+		chunk.wantedFrame = _frame;
+		chunk.rank = _wantedChunks.size();
+		_wantedChunks.push_back(candidate.chunk);
+	}
+
+	// upload the decoded chunks that are still wanted, best ranked first
+	std::vector<std::unique_ptr<decoded_chunk_t>> decoded;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		decoded.swap(_decoded);
+	}
+	std::stable_sort(decoded.begin(), decoded.end(),
+		[&](const std::unique_ptr<decoded_chunk_t>& lhs, const std::unique_ptr<decoded_chunk_t>& rhs) {
+		const chunk_t& l = _chunks[lhs->chunk];
+		const chunk_t& r = _chunks[rhs->chunk];
+		const bool lhsWanted = l.wantedFrame == _frame;
+		const bool rhsWanted = r.wantedFrame == _frame;
+		return lhsWanted != rhsWanted ? lhsWanted : (lhsWanted && l.rank < r.rank);
+	});
+
+	std::vector<std::unique_ptr<decoded_chunk_t>> deferred;
+	size_t uploaded = 0;
+	size_t freed = 0;
+	for (auto& item : decoded) {
+		chunk_t& chunk = _chunks[item->chunk];
+		if (item->failed) {
+			std::cerr << "WARN: mesh octree chunk " << item->chunk << " could not be decoded" << std::endl;
+			chunk.state = ChunkState::Failed;
+			freed += chunk.memory;
+			continue;
+		}
+		if (chunk.wantedFrame != _frame) {
+			chunk.state = ChunkState::Unloaded;
+			freed += chunk.memory;
+			continue;
+		}
+
+		if (uploaded != 0 && uploaded + chunk.memory > _options.uploadBudget) {
+			chunk.state = ChunkState::Decoded;
+			deferred.push_back(std::move(item));
+			continue;
+		}
+
+		// evict the chunks wanted the longest time ago, never a wanted one
+		while (_gpuUsage + chunk.memory > _options.gpuBudget) {
+			chunk_t* victim = nullptr;
+			for (auto& resident : _chunks) {
+				if (resident.state == ChunkState::Resident && resident.wantedFrame != _frame &&
+					(victim == nullptr || resident.wantedFrame < victim->wantedFrame)) {
+					victim = &resident;
+				}
+			}
+			if (victim == nullptr) {
+				break;
+			}
+			evict(victim);
+		}
+
+		if (_gpuUsage + chunk.memory > _options.gpuBudget) {
+			chunk.state = ChunkState::Decoded;
+			deferred.push_back(std::move(item));
+			continue;
+		}
+
+		upload(&chunk, *item);
+		uploaded += chunk.memory;
+		freed += chunk.memory;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_cpuUsage -= freed;
+		for (auto& item : deferred) {
+			_decoded.push_back(std::move(item));
+		}
+
+		// requeue in rank order, dropping the chunks no longer wanted. the
+		// ones a worker already took arrive later and are judged then
+		for (uint32_t index : _requests) {
+			_chunks[index].state = ChunkState::Unloaded;
+		}
+		_requests.clear();
+		for (uint32_t index : _wantedChunks) {
+			if (_chunks[index].state == ChunkState::Unloaded) {
+				_chunks[index].state = ChunkState::Requested;
+				_requests.push_back(index);
+			}
+		}
+	}
+	_condition.notify_all();
+}
+
+void OctreePager::upload(chunk_t* chunk, const decoded_chunk_t& decoded) {
+	glGenVertexArrays(1, &chunk->vao);
+	glGenBuffers(1, &chunk->vbo);
+	glGenBuffers(1, &chunk->ebo);
+
+	GLStateCache::get().bindVertexArray(chunk->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * decoded.vertices.size(), decoded.vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk->ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * decoded.indices.size(), decoded.indices.data(), GL_STATIC_DRAW);
+
+	// the VertexFormat::Float layout, for the same shaders as Model
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+	glEnableVertexAttribArray(2);
+
+	GLStateCache::get().bindVertexArray(0);
+
+	chunk->state = ChunkState::Resident;
+	_gpuUsage += chunk->memory;
+}
+
+void OctreePager::evict(chunk_t* chunk) {
+	GLStateCache::get().forgetVertexArray(chunk->vao);
+	glDeleteVertexArrays(1, &chunk->vao);
+	glDeleteBuffers(1, &chunk->vbo);
+	glDeleteBuffers(1, &chunk->ebo);
+	chunk->vao = chunk->vbo = chunk->ebo = 0;
+
+	chunk->state = ChunkState::Unloaded;
+	_gpuUsage -= chunk->memory;
+}
+
+void OctreePager::draw(const Model::MaterialBinder& bindMaterial) const {
+	const auto& nodes = _octree.getNodes();
+	const auto& runs = _octree.getRuns();
+
+	_drawRuns.clear();
+	for (uint32_t index : _visibleChunks) {
+		const chunk_t& chunk = _chunks[index];
+		if (chunk.state != ChunkState::Resident) {
+			continue;
+		}
+		const MeshOctree::Node& node = nodes[chunk.node];
+		for (uint32_t run = node.firstRun; run < node.firstRun + node.runCount; ++run) {
+			_drawRuns.push_back({ runs[run].material, chunk.vao, runs[run].firstIndex, runs[run].indexCount });
+		}
+	}
+
+	std::stable_sort(_drawRuns.begin(), _drawRuns.end(), [](const draw_run_t& lhs, const draw_run_t& rhs) {
+		return lhs.material < rhs.material;
+	});
+
+	GLuint boundVao = 0;
+	for (size_t i = 0; i < _drawRuns.size(); ++i) {
+		const draw_run_t& run = _drawRuns[i];
+		if (bindMaterial && (i == 0 || run.material != _drawRuns[i - 1].material)) {
+			bindMaterial(run.material);
+		}
+		if (run.vao != boundVao) {
+			GLStateCache::get().bindVertexArray(run.vao);
+			boundVao = run.vao;
+		}
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(run.indexCount), GL_UNSIGNED_INT,
+			(void*)(run.firstIndex * sizeof(uint32_t)));
+	}
+	GLStateCache::get().bindVertexArray(0);
+}
+
+const std::vector<Model::material_t>& OctreePager::getMaterials() const {
+	return _octree.getMaterials();
+}
+
+BoundingBox OctreePager::getBoundingBox() const {
+	return _octree.getBoundingBox();
+}
+
+size_t OctreePager::getChunkCount() const {
+	return _chunks.size();
+}
+
+size_t OctreePager::getResidentChunkCount() const {
+	return static_cast<size_t>(std::count_if(_chunks.begin(), _chunks.end(),
+		[](const chunk_t& chunk) { return chunk.state == ChunkState::Resident; }));
+}
+
+size_t OctreePager::getVisibleChunkCount() const {
+	return _visibleChunks.size();
+}
+
+size_t OctreePager::getPendingChunkCount() const {
+	return static_cast<size_t>(std::count_if(_wantedChunks.begin(), _wantedChunks.end(),
+		[&](uint32_t index) { return _chunks[index].state != ChunkState::Resident; }));
+}
+
+size_t OctreePager::getGpuMemoryUsage() const {
+	return _gpuUsage;
+}
+
+size_t OctreePager::getCpuMemoryUsage() const {
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _cpuUsage;
+}
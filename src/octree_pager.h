@@ -0,0 +1,153 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "./base/camera.h"
+#include "./base/transform.h"
+#include "mesh_octree.h"
+
+struct OctreePagerOptions {
+	// decoded chunks not uploaded yet, bytes
+	size_t cpuBudget = size_t(256) << 20;
+
+	// vertex and index buffers of the resident chunks, bytes
+	size_t gpuBudget = size_t(512) << 20;
+
+	// bytes one update() uploads at most, bounding the stall of a frame
+	size_t uploadBudget = size_t(16) << 20;
+
+	// chunks farther from the camera are neither loaded nor kept, in model units
+	float maxDistance = std::numeric_limits<float>::max();
+
+	// the camera is also culled from where its motion takes it in this many
+	// seconds, so the chunks ahead are loaded before they come into view
+	float prefetchTime = 1.0f;
+
+	// threads reading and decoding chunks
+	unsigned threads = 1;
+};
+
+// draws a MeshOctree keeping only the chunks around the camera in memory.
+// every update ranks the leaves inside the frustum of the camera, or of
+// the camera moved ahead along its motion, by distance, visible ones first.
+// the best ranked that fit into gpuBudget are wanted: workers decode them
+// within cpuBudget, and update() uploads them, evicting the resident chunks
+// that were wanted the longest time ago to make room
+class OctreePager {
+public:
+	explicit OctreePager(const std::string& octreePath, const OctreePagerOptions& options = OctreePagerOptions());
+
+	OctreePager(const OctreePager&) = delete;
+
+	~OctreePager();
+
+	// rank, request, upload and evict, once per frame on the gl thread.
+	// deltaTime is the time since the previous call, in seconds
+	void update(const PerspectiveCamera& camera, float deltaTime);
+
+	// draw the resident chunks the last update() found in the frustum, one
+	// draw per material run, grouped by material
+	void draw(const Model::MaterialBinder& bindMaterial = Model::MaterialBinder()) const;
+
+	const std::vector<Model::material_t>& getMaterials() const;
+
+	BoundingBox getBoundingBox() const;
+
+	size_t getChunkCount() const;
+
+	size_t getResidentChunkCount() const;
+
+	// chunks in the frustum at the last update(), resident or not
+	size_t getVisibleChunkCount() const;
+
+	// wanted chunks that are not resident yet
+	size_t getPendingChunkCount() const;
+
+	size_t getGpuMemoryUsage() const;
+
+	size_t getCpuMemoryUsage() const;
+
+public:
+	Transform transform;
+
+private:
+	enum class ChunkState {
+		Unloaded,
+		// queued or being decoded
+		Requested,
+		// decoded, waiting for the upload
+		Decoded,
+		Resident,
+		// the chunk could not be decoded and is left out
+		Failed
+	};
+
+	struct chunk_t {
+		uint32_t node = 0;
+		ChunkState state = ChunkState::Unloaded;
+		size_t memory = 0;
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		GLuint ebo = 0;
+		// the update that last wanted it, and its rank then
+		uint64_t wantedFrame = 0;
+		size_t rank = 0;
+	};
+
+	struct decoded_chunk_t {
+		uint32_t chunk = 0;
+		bool failed = false;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	void workerLoop();
+
+	void upload(chunk_t* chunk, const decoded_chunk_t& decoded);
+
+	void evict(chunk_t* chunk);
+
+	MeshOctree _octree;
+	OctreePagerOptions _options;
+
+	// one per leaf, in node order
+	std::vector<chunk_t> _chunks;
+	std::vector<uint32_t> _nodeChunks;
+	std::vector<uint32_t> _visibleChunks;
+	// the chunks the last update wanted, best first
+	std::vector<uint32_t> _wantedChunks;
+	uint64_t _frame = 0;
+	size_t _gpuUsage = 0;
+
+	// camera motion, smoothed over a few frames
+	glm::vec3 _lastCameraPosition = glm::vec3(0.0f);
+	glm::vec3 _cameraVelocity = glm::vec3(0.0f);
+	bool _hasLastCamera = false;
+
+	// shared with the workers
+	mutable std::mutex _mutex;
+	std::condition_variable _condition;
+	std::deque<uint32_t> _requests;
+	std::vector<std::unique_ptr<decoded_chunk_t>> _decoded;
+	size_t _cpuUsage = 0;
+	bool _stopping = false;
+	std::vector<std::thread> _workers;
+
+	// draw lists, kept to avoid allocating per frame
+	struct draw_run_t {
+		int material;
+		GLuint vao;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+	};
+	mutable std::vector<draw_run_t> _drawRuns;
+};
@@ -6,6 +6,7 @@
 #include <iomanip>
 
 #include "six_basic.h"
+#include "./base/gl_state.h"
 
 #define MY_PI (3.141592653)
 
@@ -21,11 +22,12 @@ BaseGeo::BaseGeo(BaseGeo&& rhs) noexcept :_vao(rhs._vao), _vbo(rhs._vbo) {
 
 BaseGeo::~BaseGeo() {
     if (_vbo) {
-        glDeleteVertexArrays(1, &_vbo);
+        glDeleteBuffers(1, &_vbo);
         _vbo = 0;
     }
 
     if (_vao) {
+        GLStateCache::get().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
@@ -37,9 +39,9 @@ BaseGeo::~BaseGeo() {
 }
 
 void BaseGeo::draw() const {
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
     glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 bool BaseGeo::SaveObj(const std::string& filepath, const glm::mat4& view, std::string* err) const {
@@ -131,7 +133,7 @@ Cube::Cube(glm::vec3 global_position, float scale) : BaseGeo(global_position), _
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -142,7 +144,7 @@ Cube::Cube(glm::vec3 global_position, float scale) : BaseGeo(global_position), _
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 Cone::Cone(glm::vec3 global_position, float radius, float height, int corners)
@@ -192,7 +194,7 @@ Cone::Cone(glm::vec3 global_position, float radius, float height, int corners)
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -204,7 +206,7 @@ Cone::Cone(glm::vec3 global_position, float radius, float height, int corners)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 Cylinder::Cylinder(glm::vec3 global_position, float radius, float height, int corners)
@@ -271,7 +273,7 @@ Cylinder::Cylinder(glm::vec3 global_position, float radius, float height, int co
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -283,7 +285,7 @@ Cylinder::Cylinder(glm::vec3 global_position, float radius, float height, int co
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 Sphere::Sphere(glm::vec3 global_position, float radius, int segments) 
@@ -323,7 +325,7 @@ Sphere::Sphere(glm::vec3 global_position, float radius, int segments)
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -335,7 +337,7 @@ Sphere::Sphere(glm::vec3 global_position, float radius, int segments)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 Prism::Prism(glm::vec3 global_position, int corners, float radius, float height)
@@ -401,7 +403,7 @@ Prism::Prism(glm::vec3 global_position, int corners, float radius, float height)
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -413,7 +415,7 @@ Prism::Prism(glm::vec3 global_position, int corners, float radius, float height)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
 
 Frust::Frust(glm::vec3 global_position, int corners, float radius1, float radius2, float height)
@@ -479,7 +481,7 @@ Frust::Frust(glm::vec3 global_position, int corners, float radius1, float radius
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
+    GLStateCache::get().bindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(float) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
@@ -491,5 +493,5 @@ Frust::Frust(glm::vec3 global_position, int corners, float radius1, float radius
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    GLStateCache::get().bindVertexArray(0);
 }
\ No newline at end of file
@@ -0,0 +1,603 @@
+#include "triangle_bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#include "model.h"
+#include "./base/parallel.h"
+
+namespace {
+constexpr int binCount = 16;
+// leaves are split whenever the heuristic allows it, and always above this size
+constexpr uint32_t maxLeafSize = 8;
+// cost of visiting a node relative to testing a triangle
+constexpr float traversalCost = 1.0f;
+// deeper nodes become leaves, so a fixed size traversal stack never overflows
+constexpr int maxDepth = 64;
+// nodes with more triangles are binned on all threads
+constexpr uint32_t parallelBinThreshold = 1 << 16;
+
+struct bin_t {
+	BoundingBox bounds;
+	uint32_t count = 0;
+};
+
+float getHalfArea(const BoundingBox& box) {
+	if (box.min.x > box.max.x) {
+		return 0.0f;
+	}
+	const glm::vec3 extent = box.max - box.min;
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+void expand(BoundingBox* box, const glm::vec3& min, const glm::vec3& max) {
+	box->min = glm::min(box->min, min);
+	box->max = glm::max(box->max, max);
+}
+
+// entry distance of the ray into the box, or infinity when it misses it within [tMin, tMax]
+inline float intersectBox(const glm::vec3& min, const glm::vec3& max,
+	const glm::vec3& origin, const glm::vec3& inverseDirection, float tMin, float tMax) {
+	const glm::vec3 t0 = (min - origin) * inverseDirection;
+	const glm::vec3 t1 = (max - origin) * inverseDirection;
+	const glm::vec3 slabEnter = glm::min(t0, t1);
+	const glm::vec3 slabExit = glm::max(t0, t1);
+	const float enter = std::max(std::max(slabEnter.x, slabEnter.y), std::max(slabEnter.z, tMin));
+	const float exit = std::min(std::min(slabExit.x, slabExit.y), std::min(slabExit.z, tMax));
+	return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+glm::vec3 getInverseDirection(const glm::vec3& direction) {
+	// a zero component gives an infinite slab, never a nan
+	glm::vec3 inverse;
+	for (int axis = 0; axis < 3; ++axis) {
+		inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : std::numeric_limits<float>::max();
+	}
+	return inverse;
+}
+}
+
+struct TriangleBvh::build_task_t {
+	uint32_t node;
+	uint32_t first;
+	uint32_t count;
+	int depth;
+};
+
+namespace {
+// the state shared by every task of one build
+struct builder_t {
+	std::vector<glm::vec3> minimums;
+	std::vector<glm::vec3> maximums;
+	std::vector<glm::vec3> centroids;
+	std::vector<uint32_t> primitives;
+	std::atomic<uint32_t> nodeCount{ 1 };
+	unsigned threads = 0;
+};
+}
+
+TriangleBvh::TriangleBvh(const Model& model, unsigned threads) {
+	std::vector<triangle_range_t> ranges;
+	size_t indexCount = 0;
+	for (const auto& submesh : model.getSubmeshes()) {
+		ranges.push_back({ submesh.firstIndex, submesh.indexCount, submesh.baseVertex, submesh.material });
+		indexCount += submesh.indexCount;
+	}
+	if (indexCount != 0 && model.getIndices().empty()) {
+		throw std::runtime_error("TriangleBvh: the model was loaded with CpuRetention::None");
+	}
+
+	// the positions are either those of the vertices or kept on their own
+	const char* positions = indexCount != 0 ? reinterpret_cast<const char*>(&model.getPosition(0)) : nullptr;
+	const size_t positionStride = model.getVertices().empty() ? sizeof(glm::vec3) : sizeof(Vertex);
+	build(positions, positionStride, model.getIndices().data(), ranges, threads);
+}
+
+TriangleBvh::TriangleBvh(const glm::vec3* positions, const uint32_t* indices, size_t indexCount, unsigned threads) {
+	const std::vector<triangle_range_t> ranges(1, { 0, static_cast<uint32_t>(indexCount), 0, -1 });
+	build(reinterpret_cast<const char*>(positions), sizeof(glm::vec3), indices, ranges, threads);
+}
+
+void TriangleBvh::build(const char* positions, size_t positionStride, const uint32_t* indices,
+	const std::vector<triangle_range_t>& ranges, unsigned threads) {
+	std::vector<uint32_t> firstTriangles(ranges.size() + 1, 0);
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		firstTriangles[i + 1] = firstTriangles[i] + ranges[i].indexCount / 3;
+		_submeshMaterials.push_back(ranges[i].material);
+	}
+	const uint32_t triangleCount = firstTriangles.back();
+	if (triangleCount == 0) {
+		return;
+	}
+
+	auto getPosition = [&](uint32_t vertex) -> const glm::vec3& {
+		return *reinterpret_cast<const glm::vec3*>(positions + vertex * positionStride);
+	};
+
+	builder_t builder;
+	builder.threads = threads;
+	builder.minimums.resize(triangleCount);
+	builder.maximums.resize(triangleCount);
+	builder.centroids.resize(triangleCount);
+	builder.primitives.resize(triangleCount);
+	std::vector<triangle_t> triangles(triangleCount);
+	std::vector<uint32_t> triangleIds(triangleCount);
+	std::vector<uint32_t> submeshIds(triangleCount);
+
+	parallelFor(ranges.size(), [&](size_t i) {
+		const triangle_range_t& submesh = ranges[i];
+		for (uint32_t t = 0; t < submesh.indexCount / 3; ++t) {
+			const uint32_t* corners = &indices[submesh.firstIndex + t * 3];
+			const glm::vec3& p0 = getPosition(submesh.baseVertex + corners[0]);
+			const glm::vec3& p1 = getPosition(submesh.baseVertex + corners[1]);
+			const glm::vec3& p2 = getPosition(submesh.baseVertex + corners[2]);
+
+			const uint32_t id = firstTriangles[i] + t;
+			builder.minimums[id] = glm::min(glm::min(p0, p1), p2);
+			builder.maximums[id] = glm::max(glm::max(p0, p1), p2);
+			builder.centroids[id] = (builder.minimums[id] + builder.maximums[id]) * 0.5f;
+			builder.primitives[id] = id;
+			triangles[id] = { p0, p1 - p0, p2 - p0 };
+			triangleIds[id] = submesh.firstIndex / 3 + t;
+			submeshIds[id] = static_cast<uint32_t>(i);
+		}
+	}, threads);
+
+	_nodes.resize(2 * static_cast<size_t>(triangleCount) - 1);
+
+	const unsigned workerCount = getWorkerCount(threads);
+
+	// bound the node of a task, then either make it a leaf or partition its
+	// primitives at the cheapest of the binned splits of all three axes
+	auto split = [&](const build_task_t& task, bool parallel, build_task_t* left, build_task_t* right) {
+		uint32_t* primitives = builder.primitives.data() + task.first;
+		const size_t count = task.count;
+		// each slice of the primitives reduces into its own bounds and bins
+		const size_t slices = parallel ? workerCount : 1;
+		auto forEachSlice = [&](const std::function<void(size_t, size_t, size_t)>& body) {
+			if (slices == 1) {
+				body(0, 0, count);
+				return;
+			}
+			parallelFor(slices, [&](size_t slice) {
+				body(slice, count * slice / slices, count * (slice + 1) / slices);
+			}, threads);
+		};
+
+		BoundingBox bounds, centroidBounds;
+		{
+			std::vector<BoundingBox> sliceBounds(slices), sliceCentroids(slices);
+			forEachSlice([&](size_t slice, size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					const uint32_t primitive = primitives[i];
+					expand(&sliceBounds[slice], builder.minimums[primitive], builder.maximums[primitive]);
+					expand(&sliceCentroids[slice], builder.centroids[primitive], builder.centroids[primitive]);
+				}
+			});
+			for (size_t slice = 0; slice < slices; ++slice) {
+				expand(&bounds, sliceBounds[slice].min, sliceBounds[slice].max);
+				expand(&centroidBounds, sliceCentroids[slice].min, sliceCentroids[slice].max);
+			}
+		}
+
+		node_t& node = _nodes[task.node];
+		node.min = bounds.min;
+		node.max = bounds.max;
+		node.first = task.first;
+		node.count = task.count;
+		if (task.count <= 2 || task.depth >= maxDepth) {
+			return false;
+		}
+
+		const glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+		int bestAxis = -1;
+		int bestBin = 0;
+		float bestCost = std::numeric_limits<float>::max();
+		if (glm::max(glm::max(centroidExtent.x, centroidExtent.y), centroidExtent.z) > 0.0f) {
+			std::vector<bin_t> bins(slices * 3 * binCount);
+			glm::vec3 scale(0.0f);
+			for (int axis = 0; axis < 3; ++axis) {
+				if (centroidExtent[axis] > 0.0f) {
+					scale[axis] = binCount / centroidExtent[axis];
+				}
+			}
+			forEachSlice([&](size_t slice, size_t begin, size_t end) {
+				bin_t* sliceBins = &bins[slice * 3 * binCount];
+				for (size_t i = begin; i < end; ++i) {
+					const uint32_t primitive = primitives[i];
+					const glm::vec3 offset = (builder.centroids[primitive] - centroidBounds.min) * scale;
+					for (int axis = 0; axis < 3; ++axis) {
+						const int b = std::min(static_cast<int>(offset[axis]), binCount - 1);
+						bin_t& bin = sliceBins[axis * binCount + b];
+						expand(&bin.bounds, builder.minimums[primitive], builder.maximums[primitive]);
+						++bin.count;
+					}
+				}
+			});
+			for (size_t slice = 1; slice < slices; ++slice) {
+				for (int i = 0; i < 3 * binCount; ++i) {
+					const bin_t& bin = bins[slice * 3 * binCount + i];
+					expand(&bins[i].bounds, bin.bounds.min, bin.bounds.max);
+					bins[i].count += bin.count;
+				}
+			}
+
+			for (int axis = 0; axis < 3; ++axis) {
+				if (centroidExtent[axis] <= 0.0f) {
+					continue;
+				}
+
+				// cost of the right side of every split plane, swept from the end
+				const bin_t* axisBins = &bins[axis * binCount];
+				float rightCosts[binCount];
+				BoundingBox rightBounds;
+				uint32_t rightCount = 0;
+				for (int b = binCount - 1; b > 0; --b) {
+					expand(&rightBounds, axisBins[b].bounds.min, axisBins[b].bounds.max);
+					rightCount += axisBins[b].count;
+					rightCosts[b] = rightCount * getHalfArea(rightBounds);
+				}
+
+				BoundingBox leftBounds;
+				uint32_t leftCount = 0;
+				for (int b = 1; b < binCount; ++b) {
+					expand(&leftBounds, axisBins[b - 1].bounds.min, axisBins[b - 1].bounds.max);
+					leftCount += axisBins[b - 1].count;
+					const float cost = leftCount * getHalfArea(leftBounds) + rightCosts[b];
+					if (leftCount != 0 && leftCount != task.count && cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+		}
+
+		uint32_t leftCount = task.count / 2;
+		if (bestAxis >= 0) {
+			// not worth splitting when the extra node costs more than the triangles it skips
+			const float area = getHalfArea(bounds);
+			if (bestCost + traversalCost * area >= task.count * area && task.count <= maxLeafSize) {
+				return false;
+			}
+
+			const float scale = binCount / centroidExtent[bestAxis];
+			const float origin = centroidBounds.min[bestAxis];
+			uint32_t* middle = std::partition(primitives, primitives + task.count, [&](uint32_t primitive) {
+				const int b = std::min(static_cast<int>((builder.centroids[primitive][bestAxis] - origin) * scale), binCount - 1);
+				return b < bestBin;
+			});
+			leftCount = static_cast<uint32_t>(middle - primitives);
+		}
+		else if (task.count <= maxLeafSize) {
+			return false;
+		}
+
+		// coincident centroids are split in the middle of the list
+		if (leftCount == 0 || leftCount == task.count) {
+			leftCount = task.count / 2;
+		}
+
+		const uint32_t children = builder.nodeCount.fetch_add(2);
+		node.first = children;
+		node.count = 0;
+		*left = { children, task.first, leftCount, task.depth + 1 };
+		*right = { children + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 };
+		return true;
+	};
+
+	// split the large nodes one at a time with parallel binning until every
+	// thread has subtrees of its own, then build those concurrently
+	std::vector<build_task_t> pending(1, build_task_t{ 0, 0, triangleCount, 0 });
+	const size_t subtreeGoal = workerCount * 4;
+	while (pending.size() < subtreeGoal) {
+		auto largest = std::max_element(pending.begin(), pending.end(),
+			[](const build_task_t& lhs, const build_task_t& rhs) { return lhs.count < rhs.count; });
+		if (largest->count < parallelBinThreshold) {
+			break;
+		}
+
+		const build_task_t task = *largest;
+		pending.erase(largest);
+		build_task_t left, right;
+		if (split(task, true, &left, &right)) {
+			pending.push_back(left);
+			pending.push_back(right);
+		}
+	}
+
+	parallelFor(pending.size(), [&](size_t i) {
+		std::vector<build_task_t> stack(1, pending[i]);
+		while (!stack.empty()) {
+			const build_task_t task = stack.back();
+			stack.pop_back();
+			build_task_t left, right;
+			if (split(task, false, &left, &right)) {
+				stack.push_back(right);
+				stack.push_back(left);
+			}
+		}
+	}, threads);
+
+	_nodes.resize(builder.nodeCount);
+	_nodes.shrink_to_fit();
+
+	// triangle data in leaf order
+	_triangles.resize(triangleCount);
+	_triangleIds.resize(triangleCount);
+	_submeshIds.resize(triangleCount);
+	parallelForRange(triangleCount, 1 << 14, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const uint32_t primitive = builder.primitives[i];
+			_triangles[i] = triangles[primitive];
+			_triangleIds[i] = triangleIds[primitive];
+			_submeshIds[i] = submeshIds[primitive];
+		}
+	}, threads);
+}
+
+BoundingBox TriangleBvh::getBoundingBox() const {
+	BoundingBox box;
+	if (!_nodes.empty()) {
+		box.min = _nodes[0].min;
+		box.max = _nodes[0].max;
+	}
+	return box;
+}
+
+size_t TriangleBvh::getMemoryUsage() const {
+	return _nodes.size() * sizeof(node_t) + _triangles.size() * sizeof(triangle_t) +
+		(_triangleIds.size() + _submeshIds.size()) * sizeof(uint32_t);
+}
+
+namespace {
+// Moller-Trumbore, both faces count
+template <typename Triangle>
+inline bool intersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction,
+	float tMin, float tMax, float* t, float* u, float* v) {
+	const glm::vec3 p = glm::cross(direction, triangle.edge2);
+	const float determinant = glm::dot(triangle.edge1, p);
+	if (std::abs(determinant) < std::numeric_limits<float>::min()) {
+		return false;
+	}
+
+	const float inverse = 1.0f / determinant;
+	const glm::vec3 s = origin - triangle.v0;
+	const float hitU = glm::dot(s, p) * inverse;
+	if (hitU < 0.0f || hitU > 1.0f) {
+		return false;
+	}
+
+	const glm::vec3 q = glm::cross(s, triangle.edge1);
+	const float hitV = glm::dot(direction, q) * inverse;
+	if (hitV < 0.0f || hitU + hitV > 1.0f) {
+		return false;
+	}
+
+	const float hitT = glm::dot(triangle.edge2, q) * inverse;
+	if (hitT < tMin || hitT > tMax) {
+		return false;
+	}
+
+	*t = hitT;
+	*u = hitU;
+	*v = hitV;
+	return true;
+}
+}
+
+void TriangleBvh::fillHit(uint32_t triangle, float t, float u, float v, RayHit* hit) const {
+	hit->triangle = _triangleIds[triangle];
+	hit->submesh = _submeshIds[triangle];
+	hit->material = _submeshMaterials[hit->submesh];
+	hit->t = t;
+	hit->barycentric = glm::vec2(u, v);
+}
+
+bool TriangleBvh::intersect(const Ray& ray, RayHit* hit) const {
+	if (_nodes.empty()) {
+		return false;
+	}
+
+	const glm::vec3 inverseDirection = getInverseDirection(ray.direction);
+	float closest = ray.tMax;
+	uint32_t closestTriangle = RayHit::noTriangle;
+	float closestU = 0.0f, closestV = 0.0f;
+
+	// nodes still to visit and the distance at which the ray enters them
+	struct entry_t {
+		uint32_t node;
+		float t;
+	} stack[maxDepth + 2];
+	int size = 0;
+
+	const float rootT = intersectBox(_nodes[0].min, _nodes[0].max, ray.origin, inverseDirection, ray.tMin, closest);
+	if (rootT != std::numeric_limits<float>::infinity()) {
+		stack[size++] = { 0, rootT };
+	}
+
+	while (size > 0) {
+		const entry_t entry = stack[--size];
+		if (entry.t > closest) {
+			continue;
+		}
+
+		const node_t& node = _nodes[entry.node];
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t, u, v;
+				if (intersectTriangle(_triangles[i], ray.origin, ray.direction, ray.tMin, closest, &t, &u, &v)) {
+					closest = t;
+					closestTriangle = i;
+					closestU = u;
+					closestV = v;
+				}
+			}
+			continue;
+		}
+
+		const node_t& left = _nodes[node.first];
+		const node_t& right = _nodes[node.first + 1];
+		float nearT = intersectBox(left.min, left.max, ray.origin, inverseDirection, ray.tMin, closest);
+		float farT = intersectBox(right.min, right.max, ray.origin, inverseDirection, ray.tMin, closest);
+		uint32_t nearChild = node.first;
+		uint32_t farChild = node.first + 1;
+		if (farT < nearT) {
+			std::swap(nearT, farT);
+			std::swap(nearChild, farChild);
+		}
+		if (farT != std::numeric_limits<float>::infinity()) {
+			stack[size++] = { farChild, farT };
+		}
+		if (nearT != std::numeric_limits<float>::infinity()) {
+			stack[size++] = { nearChild, nearT };
+		}
+	}
+
+	if (closestTriangle == RayHit::noTriangle) {
+		return false;
+	}
+
+	if (hit) {
+		fillHit(closestTriangle, closest, closestU, closestV, hit);
+	}
+	return true;
+}
+
+bool TriangleBvh::occluded(const Ray& ray) const {
+	if (_nodes.empty()) {
+		return false;
+	}
+
+	const glm::vec3 inverseDirection = getInverseDirection(ray.direction);
+	uint32_t stack[maxDepth + 2];
+	int size = 0;
+	stack[size++] = 0;
+	while (size > 0) {
+		const node_t& node = _nodes[stack[--size]];
+		if (intersectBox(node.min, node.max, ray.origin, inverseDirection, ray.tMin, ray.tMax) ==
+			std::numeric_limits<float>::infinity()) {
+			continue;
+		}
+
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				float t, u, v;
+				if (intersectTriangle(_triangles[i], ray.origin, ray.direction, ray.tMin, ray.tMax, &t, &u, &v)) {
+					return true;
+				}
+			}
+			continue;
+		}
+
+		stack[size++] = node.first + 1;
+		stack[size++] = node.first;
+	}
+
+	return false;
+}
+
+void TriangleBvh::intersect4(const Ray rays[4], RayHit hits[4]) const {
+	intersectPacket<4>(rays, hits);
+}
+
+void TriangleBvh::intersect8(const Ray rays[8], RayHit hits[8]) const {
+	intersectPacket<8>(rays, hits);
+}
+
+template <int N>
+void TriangleBvh::intersectPacket(const Ray* rays, RayHit* hits) const {
+	for (int lane = 0; lane < N; ++lane) {
+		hits[lane] = RayHit();
+	}
+	if (_nodes.empty()) {
+		return;
+	}
+
+	// the packet in structure of arrays form, so the per lane loops vectorize
+	float originX[N], originY[N], originZ[N];
+	float inverseX[N], inverseY[N], inverseZ[N];
+	float tMin[N], closest[N];
+	uint32_t closestTriangle[N];
+	float closestU[N], closestV[N];
+	for (int lane = 0; lane < N; ++lane) {
+		const glm::vec3 inverse = getInverseDirection(rays[lane].direction);
+		originX[lane] = rays[lane].origin.x;
+		originY[lane] = rays[lane].origin.y;
+		originZ[lane] = rays[lane].origin.z;
+		inverseX[lane] = inverse.x;
+		inverseY[lane] = inverse.y;
+		inverseZ[lane] = inverse.z;
+		tMin[lane] = rays[lane].tMin;
+		closest[lane] = rays[lane].tMax;
+		closestTriangle[lane] = RayHit::noTriangle;
+		closestU[lane] = closestV[lane] = 0.0f;
+	}
+
+	// entry distance of every lane into a box, infinity for the lanes that miss it
+	auto intersectPacketBox = [&](const node_t& node, float* enter) {
+		bool any = false;
+		for (int lane = 0; lane < N; ++lane) {
+			const float x0 = (node.min.x - originX[lane]) * inverseX[lane];
+			const float x1 = (node.max.x - originX[lane]) * inverseX[lane];
+			const float y0 = (node.min.y - originY[lane]) * inverseY[lane];
+			const float y1 = (node.max.y - originY[lane]) * inverseY[lane];
+			const float z0 = (node.min.z - originZ[lane]) * inverseZ[lane];
+			const float z1 = (node.max.z - originZ[lane]) * inverseZ[lane];
+			const float laneEnter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), tMin[lane]));
+			const float laneExit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), closest[lane]));
+			enter[lane] = laneEnter <= laneExit ? laneEnter : std::numeric_limits<float>::infinity();
+			any |= laneEnter <= laneExit;
+		}
+		return any;
+	};
+
+	uint32_t stack[maxDepth + 2];
+	int size = 0;
+	stack[size++] = 0;
+	float enter[N];
+	while (size > 0) {
+		const node_t& node = _nodes[stack[--size]];
+		if (!intersectPacketBox(node, enter)) {
+			continue;
+		}
+
+		if (node.count != 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				for (int lane = 0; lane < N; ++lane) {
+					float t, u, v;
+					if (enter[lane] != std::numeric_limits<float>::infinity() &&
+						intersectTriangle(_triangles[i], rays[lane].origin, rays[lane].direction, tMin[lane], closest[lane], &t, &u, &v)) {
+						closest[lane] = t;
+						closestTriangle[lane] = i;
+						closestU[lane] = u;
+						closestV[lane] = v;
+					}
+				}
+			}
+			continue;
+		}
+
+		// the child nearer along the mean direction of the packet goes first
+		const node_t& left = _nodes[node.first];
+		const node_t& right = _nodes[node.first + 1];
+		glm::vec3 direction(0.0f);
+		for (int lane = 0; lane < N; ++lane) {
+			direction += rays[lane].direction;
+		}
+		const bool rightFirst = glm::dot((right.min + right.max) - (left.min + left.max), direction) < 0.0f;
+		stack[size++] = rightFirst ? node.first : node.first + 1;
+		stack[size++] = rightFirst ? node.first + 1 : node.first;
+	}
+
+	for (int lane = 0; lane < N; ++lane) {
+		if (closestTriangle[lane] != RayHit::noTriangle) {
+			fillHit(closestTriangle[lane], closest[lane], closestU[lane], closestV[lane], &hits[lane]);
+		}
+	}
+}
+
+template void TriangleBvh::intersectPacket<4>(const Ray* rays, RayHit* hits) const;
+template void TriangleBvh::intersectPacket<8>(const Ray* rays, RayHit* hits) const;
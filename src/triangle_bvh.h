@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "./base/bounding_box.h"
+
+class Model;
+
+// a ray in the model space of the bvh, hits are searched within [tMin, tMax]
+// along direction, which needs not be normalized
+struct Ray {
+	glm::vec3 origin = glm::vec3(0.0f);
+	float tMin = 0.0f;
+	glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+	float tMax = std::numeric_limits<float>::max();
+
+	Ray() = default;
+	Ray(const glm::vec3& origin, const glm::vec3& direction,
+		float tMin = 0.0f, float tMax = std::numeric_limits<float>::max())
+		: origin(origin), tMin(tMin), direction(direction), tMax(tMax) {}
+};
+
+struct RayHit {
+	static constexpr uint32_t noTriangle = 0xffffffffu;
+
+	// triangle t of Model::getIndices(), indices [3t, 3t + 3)
+	uint32_t triangle = noTriangle;
+	uint32_t submesh = 0;
+	// the Model::_materials entry of the submesh, -1 for none
+	int material = -1;
+	float t = std::numeric_limits<float>::max();
+	// weights of the second and third corner, the first gets 1 - u - v
+	glm::vec2 barycentric = glm::vec2(0.0f);
+
+	bool isHit() const { return triangle != noTriangle; }
+};
+
+// bounding volume hierarchy over the base triangles of a Model (lod ranges
+// excluded), built with binned surface area heuristic splits. nodes are 32
+// bytes, siblings are stored next to each other and the triangles are copied
+// in leaf order, so a traversal reads memory mostly forward. the model may be
+// destroyed after the build
+class TriangleBvh {
+public:
+	explicit TriangleBvh(const Model& model, unsigned threads = 0);
+
+	// over a bare triangle list, triangle t being indices [3t, 3t + 3), for
+	// meshes that do not come from a Model. hits report submesh 0
+	TriangleBvh(const glm::vec3* positions, const uint32_t* indices, size_t indexCount, unsigned threads = 0);
+
+	// the closest hit along the ray
+	bool intersect(const Ray& ray, RayHit* hit) const;
+
+	// any hit along the ray, for line of sight and collision probes
+	bool occluded(const Ray& ray) const;
+
+	// closest hits of 4 or 8 rays traversed together: a node is visited
+	// once for all the rays of the packet that still overlap it, which pays
+	// off for coherent rays such as neighbouring pixels
+	void intersect4(const Ray rays[4], RayHit hits[4]) const;
+
+	void intersect8(const Ray rays[8], RayHit hits[8]) const;
+
+	BoundingBox getBoundingBox() const;
+
+	size_t getNodeCount() const { return _nodes.size(); }
+
+	size_t getTriangleCount() const { return _triangles.size(); }
+
+	// bytes of nodes and triangle data
+	size_t getMemoryUsage() const;
+
+private:
+	// an interior node has count 0 and its children at first and first + 1,
+	// a leaf owns the triangles [first, first + count)
+	struct node_t {
+		glm::vec3 min;
+		uint32_t first;
+		glm::vec3 max;
+		uint32_t count;
+	};
+
+	// precomputed for the Moller-Trumbore test
+	struct triangle_t {
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	struct build_task_t;
+
+	// the triangles of a submesh, indices relative to baseVertex
+	struct triangle_range_t {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t baseVertex;
+		int material;
+	};
+
+	std::vector<node_t> _nodes;
+	std::vector<triangle_t> _triangles;
+	// model triangle and submesh of every entry of _triangles
+	std::vector<uint32_t> _triangleIds;
+	std::vector<uint32_t> _submeshIds;
+	std::vector<int> _submeshMaterials;
+
+	// positions are read with a stride of positionStride bytes
+	void build(const char* positions, size_t positionStride, const uint32_t* indices,
+		const std::vector<triangle_range_t>& ranges, unsigned threads);
+
+	void fillHit(uint32_t triangle, float t, float u, float v, RayHit* hit) const;
+
+	template <int N>
+	void intersectPacket(const Ray* rays, RayHit* hits) const;
+};
@@ -0,0 +1,366 @@
+#include "vertex_welder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "./base/parallel.h"
+
+namespace {
+// the table is kept at most 3/4 full
+size_t getSlotCount(size_t vertexCount) {
+	size_t slots = 16;
+	while (slots - slots / 4 < vertexCount) {
+		slots <<= 1;
+	}
+	return slots;
+}
+
+// component bits with -0.0 folded into +0.0, in the same spirit as hashVertex
+inline uint32_t getKeyBits(float value) {
+	uint32_t bits = 0;
+	if (value != 0.0f) {
+		memcpy(&bits, &value, sizeof(bits));
+	}
+	return bits;
+}
+
+// total order on vertices that agrees with the bitwise equality of their keys
+inline int compareVertices(const Vertex& lhs, const Vertex& rhs) {
+	const float* a = &lhs.position.x;
+	const float* b = &rhs.position.x;
+	for (int i = 0; i < 8; ++i) {
+		const uint32_t x = getKeyBits(a[i]);
+		const uint32_t y = getKeyBits(b[i]);
+		if (x != y) {
+			return x < y ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+struct corner_key_t {
+	uint64_t hash;
+	uint32_t corner;
+};
+}
+
+VertexWelder::VertexWelder(size_t maxVertices) {
+	_vertices.reserve(maxVertices);
+	rehash(getSlotCount(maxVertices));
+}
+
+uint32_t VertexWelder::weld(const Vertex& vertex, bool* inserted) {
+	if (_vertices.size() >= _capacity) {
+		rehash(_slots.size() * 2);
+	}
+
+	const uint64_t hash = hashVertex(vertex);
+	const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+	for (size_t i = static_cast<size_t>(hash) & _mask;; i = (i + 1) & _mask) {
+		slot_t& slot = _slots[i];
+		if (slot.index == _emptySlot) {
+			if (_vertices.size() >= _emptySlot) {
+				throw std::runtime_error("too many unique vertices for 32-bit indices");
+			}
+
+			slot.tag = tag;
+			slot.index = static_cast<uint32_t>(_vertices.size());
+			_vertices.push_back(vertex);
+			if (inserted) *inserted = true;
+			return slot.index;
+		}
+
+		if (slot.tag == tag && _vertices[slot.index] == vertex) {
+			if (inserted) *inserted = false;
+			return slot.index;
+		}
+	}
+}
+
+const std::vector<Vertex>& VertexWelder::getVertices() const {
+	return _vertices;
+}
+
+std::vector<Vertex> VertexWelder::releaseVertices() {
+	_slots.clear();
+	_mask = 0;
+	_capacity = 0;
+	return std::move(_vertices);
+}
+
+void VertexWelder::rehash(size_t slotCount) {
+	_slots.assign(slotCount, slot_t{ 0, _emptySlot });
+	_mask = slotCount - 1;
+	_capacity = slotCount - slotCount / 4;
+
+	for (uint32_t index = 0; index < _vertices.size(); ++index) {
+		const uint64_t hash = hashVertex(_vertices[index]);
+		size_t i = static_cast<size_t>(hash) & _mask;
+		while (_slots[i].index != _emptySlot) {
+			i = (i + 1) & _mask;
+		}
+		_slots[i].tag = static_cast<uint32_t>(hash >> 32);
+		_slots[i].index = index;
+	}
+}
+
+void VertexWelder::weldSorted(const std::vector<Vertex>& corners, std::vector<uint32_t>* indices,
+	std::vector<uint32_t>* firstCorners, unsigned threads) {
+	const size_t count = corners.size();
+	if (count >= _emptySlot) {
+		throw std::runtime_error("too many face corners for 32-bit indices");
+	}
+
+	const size_t grain = 1 << 16;
+
+	// sort the corners by (hash, vertex, corner), equal vertices end up in one
+	// run that starts with the corner where they first appeared
+	std::vector<corner_key_t> keys(count);
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			keys[i].hash = hashVertex(corners[i]);
+			keys[i].corner = static_cast<uint32_t>(i);
+		}
+	}, threads);
+
+	parallelSort(keys, [&](const corner_key_t& lhs, const corner_key_t& rhs) {
+		if (lhs.hash != rhs.hash) {
+			return lhs.hash < rhs.hash;
+		}
+		const int order = compareVertices(corners[lhs.corner], corners[rhs.corner]);
+		return order != 0 ? order < 0 : lhs.corner < rhs.corner;
+	}, threads);
+
+	auto sameVertex = [&](size_t a, size_t b) {
+		return keys[a].hash == keys[b].hash &&
+			compareVertices(corners[keys[a].corner], corners[keys[b].corner]) == 0;
+	};
+
+	// leaders[c] is the first corner holding the same vertex as corner c
+	std::vector<uint32_t> leaders(count);
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		size_t head = begin;
+		while (head > 0 && sameVertex(head - 1, head)) {
+			--head;
+		}
+
+		for (size_t i = begin; i < end; ++i) {
+			if (i != head && !sameVertex(i - 1, i)) {
+				head = i;
+			}
+			leaders[keys[i].corner] = keys[head].corner;
+		}
+	}, threads);
+
+	keys.clear();
+	keys.shrink_to_fit();
+
+	// number the leaders in corner order with a two pass prefix sum
+	const size_t slices = std::max<size_t>(std::min<size_t>((count + grain - 1) / grain,
+		getWorkerCount(threads) * 4), 1);
+	std::vector<size_t> sliceStarts(slices + 1, 0);
+	parallelFor(slices, [&](size_t slice) {
+		size_t leaderCount = 0;
+		for (size_t c = count * slice / slices; c < count * (slice + 1) / slices; ++c) {
+			leaderCount += leaders[c] == c;
+		}
+		sliceStarts[slice + 1] = leaderCount;
+	}, threads);
+	for (size_t slice = 0; slice < slices; ++slice) {
+		sliceStarts[slice + 1] += sliceStarts[slice];
+	}
+
+	indices->resize(count);
+	firstCorners->resize(sliceStarts[slices]);
+	parallelFor(slices, [&](size_t slice) {
+		uint32_t next = static_cast<uint32_t>(sliceStarts[slice]);
+		for (size_t c = count * slice / slices; c < count * (slice + 1) / slices; ++c) {
+			if (leaders[c] == c) {
+				(*firstCorners)[next] = static_cast<uint32_t>(c);
+				(*indices)[c] = next++;
+			}
+		}
+	}, threads);
+
+	parallelForRange(count, grain, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			if (leaders[c] != c) {
+				(*indices)[c] = (*indices)[leaders[c]];
+			}
+		}
+	}, threads);
+}
+
+VertexToleranceWelder::VertexToleranceWelder(size_t maxVertices, float positionEpsilon,
+	float normalAngle, float texCoordEpsilon)
+	: _positionEpsilon2(positionEpsilon * positionEpsilon),
+	_minNormalCos(std::cos(normalAngle)),
+	_texCoordEpsilon(texCoordEpsilon) {
+	// any cell size is correct for an epsilon of 0, only exact positions match
+	_cellSize = positionEpsilon > 0.0f ? 2.0 * positionEpsilon : 1e-6;
+	_vertices.reserve(maxVertices);
+	_next.reserve(maxVertices);
+	rehash(getSlotCount(maxVertices));
+}
+
+uint32_t VertexToleranceWelder::weld(const Vertex& vertex, bool* inserted) {
+	const cell_t cell = getCell(vertex.position);
+
+	// with 2 * epsilon cells the epsilon ball around the position reaches at
+	// most one neighbour per axis, the one on the side of the nearer face
+	cell_t base = cell;
+	int64_t* baseAxes = &base.x;
+	for (int axis = 0; axis < 3; ++axis) {
+		const double offset = vertex.position[axis] / _cellSize - static_cast<double>(baseAxes[axis]);
+		if (offset < 0.5) {
+			--baseAxes[axis];
+		}
+	}
+
+	uint32_t best = _emptySlot;
+	float bestDistance2 = 0.0f;
+	for (int i = 0; i < 8; ++i) {
+		const cell_t neighbour = { base.x + (i & 1), base.y + ((i >> 1) & 1), base.z + ((i >> 2) & 1) };
+		const slot_t* slot = findSlot(neighbour, hashCell(neighbour));
+		for (uint32_t index = slot->head; index != _emptySlot; index = _next[index]) {
+			const Vertex& candidate = _vertices[index];
+			if (!isMatch(vertex, candidate)) {
+				continue;
+			}
+
+			const glm::vec3 d = candidate.position - vertex.position;
+			const float distance2 = glm::dot(d, d);
+			if (best == _emptySlot || distance2 < bestDistance2 ||
+				(distance2 == bestDistance2 && index < best)) {
+				best = index;
+				bestDistance2 = distance2;
+			}
+		}
+	}
+
+	if (best != _emptySlot) {
+		if (inserted) *inserted = false;
+		return best;
+	}
+
+	if (_vertices.size() >= _emptySlot) {
+		throw std::runtime_error("too many unique vertices for 32-bit indices");
+	}
+
+	const uint64_t hash = hashCell(cell);
+	slot_t* slot = findSlot(cell, hash);
+	if (slot->head == _emptySlot) {
+		if (_cellCount >= _capacity) {
+			rehash(_slots.size() * 2);
+			slot = findSlot(cell, hash);
+		}
+		slot->tag = static_cast<uint32_t>(hash >> 32);
+		++_cellCount;
+	}
+
+	const uint32_t index = static_cast<uint32_t>(_vertices.size());
+	_vertices.push_back(vertex);
+	_next.push_back(slot->head);
+	slot->head = index;
+
+	if (inserted) *inserted = true;
+	return index;
+}
+
+const std::vector<Vertex>& VertexToleranceWelder::getVertices() const {
+	return _vertices;
+}
+
+std::vector<Vertex> VertexToleranceWelder::releaseVertices() {
+	_slots.clear();
+	_next.clear();
+	_mask = 0;
+	_capacity = 0;
+	_cellCount = 0;
+	return std::move(_vertices);
+}
+
+VertexToleranceWelder::cell_t VertexToleranceWelder::getCell(const glm::vec3& position) const {
+	// far out or non-finite coordinates are clamped, they only cost collisions
+	const double limit = 4611686018427387904.0;
+	cell_t cell;
+	int64_t* axes = &cell.x;
+	for (int axis = 0; axis < 3; ++axis) {
+		const double value = std::floor(position[axis] / _cellSize);
+		axes[axis] = value == value ? static_cast<int64_t>(std::max(-limit, std::min(limit, value))) : 0;
+	}
+	return cell;
+}
+
+uint64_t VertexToleranceWelder::hashCell(const cell_t& cell) {
+	uint64_t h = static_cast<uint64_t>(cell.x) * 0x9e3779b97f4a7c15ull;
+	h ^= static_cast<uint64_t>(cell.y) * 0xc2b2ae3d27d4eb4full;
+	h ^= static_cast<uint64_t>(cell.z) * 0x165667b19e3779f9ull;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 32;
+	return h;
+}
+
+VertexToleranceWelder::slot_t* VertexToleranceWelder::findSlot(const cell_t& cell, uint64_t hash) {
+	const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+	for (size_t i = static_cast<size_t>(hash) & _mask;; i = (i + 1) & _mask) {
+		slot_t& slot = _slots[i];
+		if (slot.head == _emptySlot) {
+			return &slot;
+		}
+
+		if (slot.tag == tag) {
+			// cells are not stored, the newest vertex in the slot tells which cell it is
+			const cell_t other = getCell(_vertices[slot.head].position);
+			if (other.x == cell.x && other.y == cell.y && other.z == cell.z) {
+				return &slot;
+			}
+		}
+	}
+}
+
+bool VertexToleranceWelder::isMatch(const Vertex& lhs, const Vertex& rhs) const {
+	const glm::vec3 d = lhs.position - rhs.position;
+	if (glm::dot(d, d) > _positionEpsilon2) {
+		return false;
+	}
+
+	if (std::abs(lhs.texCoord.x - rhs.texCoord.x) > _texCoordEpsilon ||
+		std::abs(lhs.texCoord.y - rhs.texCoord.y) > _texCoordEpsilon) {
+		return false;
+	}
+
+	if (lhs.normal != rhs.normal) {
+		// a missing (zero) normal only matches another missing one
+		const float lhsLength2 = glm::dot(lhs.normal, lhs.normal);
+		const float rhsLength2 = glm::dot(rhs.normal, rhs.normal);
+		if (lhsLength2 == 0.0f || rhsLength2 == 0.0f ||
+			glm::dot(lhs.normal, rhs.normal) < _minNormalCos * std::sqrt(lhsLength2 * rhsLength2)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void VertexToleranceWelder::rehash(size_t slotCount) {
+	_slots.assign(slotCount, slot_t{ 0, _emptySlot });
+	_mask = slotCount - 1;
+	_capacity = slotCount - slotCount / 4;
+	_cellCount = 0;
+
+	// visiting the vertices in order leaves the newest one of each cell as its head
+	for (uint32_t index = 0; index < _vertices.size(); ++index) {
+		const cell_t cell = getCell(_vertices[index].position);
+		const uint64_t hash = hashCell(cell);
+		slot_t* slot = findSlot(cell, hash);
+		if (slot->head == _emptySlot) {
+			slot->tag = static_cast<uint32_t>(hash >> 32);
+			++_cellCount;
+		}
+		slot->head = index;
+	}
+}
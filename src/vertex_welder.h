@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./base/vertex.h"
+
+// exact-match vertex deduplication. unique vertices are numbered in the
+// order they are first seen, so the output matches what the old
+// std::unordered_map<Vertex, uint32_t> pass produced
+class VertexWelder {
+public:
+	// size the table for `maxVertices` unique vertices so it never has to
+	// grow, the number of face corners is always a safe bound
+	explicit VertexWelder(size_t maxVertices);
+
+	// index of the vertex equal to `vertex`, appended if it is new.
+	// a single probe sequence serves both the lookup and the insertion
+	uint32_t weld(const Vertex& vertex, bool* inserted = nullptr);
+
+	const std::vector<Vertex>& getVertices() const;
+
+	std::vector<Vertex> releaseVertices();
+
+	// hash-free alternative over a whole corner array with the same output:
+	// indices[i] is the unique vertex of corners[i], and firstCorners[v] is
+	// the corner at which vertex v first appeared. every step is parallel
+	static void weldSorted(const std::vector<Vertex>& corners, std::vector<uint32_t>* indices,
+		std::vector<uint32_t>* firstCorners, unsigned threads = 0);
+
+private:
+	static constexpr uint32_t _emptySlot = 0xffffffffu;
+
+	// the upper hash bits ride along with the index so that a probe only
+	// touches the vertex array when the hashes already agree
+	struct slot_t {
+		uint32_t tag;
+		uint32_t index;
+	};
+
+	std::vector<slot_t> _slots;
+	std::vector<Vertex> _vertices;
+	size_t _mask = 0;
+	size_t _capacity = 0;
+
+	void rehash(size_t slotCount);
+};
+
+// merges vertices whose positions lie within positionEpsilon of each other,
+// whose normals differ by at most normalAngle radians and whose texture
+// coordinates differ by at most texCoordEpsilon per component. positions are
+// bucketed in a hashed grid of 2 * positionEpsilon cells, so a lookup visits
+// the 8 cells around the vertex and the whole weld stays O(n) expected.
+// a vertex snaps onto the closest matching one seen before it and is never
+// moved, so the result depends on the order of the corners
+class VertexToleranceWelder {
+public:
+	VertexToleranceWelder(size_t maxVertices, float positionEpsilon, float normalAngle, float texCoordEpsilon);
+
+	uint32_t weld(const Vertex& vertex, bool* inserted = nullptr);
+
+	const std::vector<Vertex>& getVertices() const;
+
+	std::vector<Vertex> releaseVertices();
+
+private:
+	static constexpr uint32_t _emptySlot = 0xffffffffu;
+
+	struct cell_t {
+		int64_t x, y, z;
+	};
+
+	// one slot per occupied cell, pointing at the newest vertex in it
+	struct slot_t {
+		uint32_t tag;
+		uint32_t head;
+	};
+
+	std::vector<slot_t> _slots;
+	std::vector<Vertex> _vertices;
+	// the next older vertex in the same cell
+	std::vector<uint32_t> _next;
+	size_t _mask = 0;
+	size_t _capacity = 0;
+	size_t _cellCount = 0;
+
+	double _cellSize;
+	float _positionEpsilon2;
+	float _minNormalCos;
+	float _texCoordEpsilon;
+
+	cell_t getCell(const glm::vec3& position) const;
+
+	static uint64_t hashCell(const cell_t& cell);
+
+	// the slot of the cell, or the empty slot where it would be inserted
+	slot_t* findSlot(const cell_t& cell, uint64_t hash);
+
+	bool isMatch(const Vertex& lhs, const Vertex& rhs) const;
+
+	void rehash(size_t slotCount);
+};